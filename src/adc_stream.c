@@ -0,0 +1,268 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(adc_stream, LOG_LEVEL_INF);
+
+#include "analog.h"
+#include "adc_stream.h"
+
+#define ADC_STREAM_STACK_SIZE   1024
+#define ADC_STREAM_PRIORITY     5
+#define ADC_STREAM_NUM_BLOCKS   2   /* ping-pong */
+
+static struct adc_stream_block stream_blocks[ADC_STREAM_NUM_BLOCKS];
+static struct k_sem block_free[ADC_STREAM_NUM_BLOCKS];
+
+K_MSGQ_DEFINE(adc_stream_msgq, sizeof(struct adc_stream_block *), ADC_STREAM_NUM_BLOCKS, 4);
+static K_SEM_DEFINE(stream_start_sem, 0, 1);
+static struct k_poll_signal stream_signal;
+
+static const struct adc_dt_spec *stream_specs;
+static size_t stream_count;
+static uint32_t stream_channels;
+static uint32_t stream_interval_us;
+static atomic_t stream_running;
+static struct adc_stream_stats stream_stats;
+
+/* The driver converts every sampling into the same slot, the callback moves it to the block being filled */
+static int16_t stream_sampling[ADC_SCAN_MAX_CHN];
+static struct adc_stream_block *stream_fill;
+static uint8_t stream_fill_idx;
+static uint32_t stream_seq;
+
+/* Takes the next block for filling, fails if the consumer still holds it */
+static bool adc_stream_claim_block(void){
+    struct adc_stream_block *block = &stream_blocks[stream_fill_idx];
+
+    if (k_sem_take(&block_free[stream_fill_idx], K_NO_WAIT) != 0) {
+        return false;
+    }
+
+    block->seq = stream_seq++;
+    block->timestamp = k_cycle_get_32();
+    block->channels = stream_count;
+    block->samplings = 0;
+    stream_fill = block;
+
+    return true;
+}
+
+static void adc_stream_hand_over(void){
+    /* Queue has room for every block, this never waits */
+    (void)k_msgq_put(&adc_stream_msgq, &stream_fill, K_NO_WAIT);
+    stream_stats.blocks++;
+    stream_fill = NULL;
+    stream_fill_idx = (stream_fill_idx + 1) % ADC_STREAM_NUM_BLOCKS;
+}
+
+/*
+ * Called after every sampling, in the driver's context. Repeating the
+ * sampling keeps a single read running for the whole stream, the interval
+ * timer never stops between blocks.
+ */
+static enum adc_action adc_stream_callback(const struct device *dev,
+                                           const struct adc_sequence *sequence,
+                                           uint16_t sampling_index)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(sequence);
+    ARG_UNUSED(sampling_index);
+
+    if (!atomic_get(&stream_running)) {
+        return ADC_ACTION_FINISH;
+    }
+
+    if ((stream_fill == NULL) && !adc_stream_claim_block()) {
+        /* Both blocks are with the consumer, the sampling is lost */
+        stream_stats.overruns++;
+        return ADC_ACTION_REPEAT;
+    }
+
+    memcpy(&stream_fill->samples[stream_fill->samplings * stream_count], stream_sampling,
+           stream_count * sizeof(stream_sampling[0]));
+    stream_fill->samplings++;
+    if (stream_fill->samplings == (ADC_STREAM_BLOCK_SAMPLES / stream_count)) {
+        adc_stream_hand_over();
+    }
+
+    return ADC_ACTION_REPEAT;
+}
+
+/* Runs the read until the stream is stopped or fails */
+static int32_t adc_stream_capture(void){
+    struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+                                                         K_POLL_MODE_NOTIFY_ONLY,
+                                                         &stream_signal);
+    unsigned int signaled;
+    int result;
+    int err;
+
+    struct adc_sequence_options options = {
+        .interval_us = stream_interval_us,
+        .callback = adc_stream_callback,
+    };
+
+	struct adc_sequence sequence = {
+		.options = &options,
+		.buffer = stream_sampling,
+		/* buffer size in bytes, not number of samples */
+		.buffer_size = stream_count * sizeof(stream_sampling[0]),
+	};
+
+    (void)adc_sequence_init_dt(&stream_specs[0], &sequence);
+    sequence.channels = stream_channels;
+
+    k_poll_signal_reset(&stream_signal);
+
+    err = adc_read_async(stream_specs[0].dev, &sequence, &stream_signal);
+    if (err < 0) {
+        LOG_ERR("Could not start stream (%d)", err);
+        return -1;
+    }
+
+    (void)k_poll(&event, 1, K_FOREVER);
+    k_poll_signal_check(&stream_signal, &signaled, &result);
+    if (result < 0) {
+        LOG_ERR("Stream read failed (%d)", result);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void adc_stream_thread(void *p1, void *p2, void *p3){
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (1) {
+        k_sem_take(&stream_start_sem, K_FOREVER);
+
+        stream_seq = 0;
+        stream_fill = NULL;
+        stream_fill_idx = 0;
+
+        if (adc_stream_capture() < 0) {
+            stream_stats.errors++;
+            atomic_clear(&stream_running);
+        }
+
+        /* The read is over, the block being filled is delivered with what it got */
+        if (stream_fill != NULL) {
+            if (stream_fill->samplings > 0) {
+                adc_stream_hand_over();
+            } else {
+                k_sem_give(&block_free[stream_fill_idx]);
+                stream_fill = NULL;
+            }
+        }
+    }
+}
+
+K_THREAD_DEFINE(adc_stream_tid, ADC_STREAM_STACK_SIZE, adc_stream_thread,
+                NULL, NULL, NULL, ADC_STREAM_PRIORITY, 0, 0);
+
+/*!
+* @brief Starts the continuous sampling of the given channels
+*
+* Samples are captured in the background by a single adc_read_async()
+* that repeats its sampling, each one is moved into two blocks used in
+* ping-pong. Full blocks are handed over through adc_stream_get() and must
+* be given back with adc_stream_release(), samplings taken while both are
+* held are dropped and counted as overruns.
+*
+* @param adc_specs Channels to sample, same device and resolution
+* @param count Number of entries in adc_specs
+* @param interval_us Time between two samplings, 0 for back to back
+*
+* @return 0 if successful
+* @return -1 if the stream is already running or the channels are not valid
+*
+*/
+int32_t adc_stream_start(const struct adc_dt_spec *adc_specs, size_t count, uint32_t interval_us){
+    uint32_t channels = 0;
+
+    if ((count == 0) || (count > ADC_SCAN_MAX_CHN)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if ((adc_specs[i].dev != adc_specs[0].dev) ||
+            (adc_specs[i].resolution != adc_specs[0].resolution)) {
+            return -1;
+        }
+        channels |= BIT(adc_specs[i].channel_id);
+    }
+
+    if (!atomic_cas(&stream_running, 0, 1)) {
+        return -1;
+    }
+
+    stream_specs = adc_specs;
+    stream_count = count;
+    stream_channels = channels;
+    stream_interval_us = interval_us;
+    stream_stats = (struct adc_stream_stats){0};
+
+    k_msgq_purge(&adc_stream_msgq);
+    for (size_t i = 0; i < ADC_STREAM_NUM_BLOCKS; i++) {
+        k_sem_init(&block_free[i], 1, 1);
+    }
+    k_poll_signal_init(&stream_signal);
+
+    k_sem_give(&stream_start_sem);
+
+    return 0;
+}
+
+/*!
+* @brief Stops the stream, the block being captured is finished early and still delivered
+*/
+void adc_stream_stop(void){
+    atomic_clear(&stream_running);
+}
+
+bool adc_stream_is_running(void){
+    return atomic_get(&stream_running) != 0;
+}
+
+/*!
+* @brief Gets the next full block of the stream
+*
+* @param block Where the pointer to the block is stored
+* @param timeout Time to wait for a block
+*
+* @return 0 if successful
+* @return -1 if no block was available before the timeout
+*
+*/
+int32_t adc_stream_get(struct adc_stream_block **block, k_timeout_t timeout){
+    if (k_msgq_get(&adc_stream_msgq, block, timeout) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!
+* @brief Gives a block obtained with adc_stream_get() back to the engine
+*/
+void adc_stream_release(struct adc_stream_block *block){
+    size_t idx = block - stream_blocks;
+
+    if (idx < ADC_STREAM_NUM_BLOCKS) {
+        k_sem_give(&block_free[idx]);
+    }
+}
+
+/*!
+* @brief Gets the counters of the current or last stream, reset when a stream starts
+*/
+void adc_stream_get_stats(struct adc_stream_stats *stats){
+    *stats = stream_stats;
+}
@@ -0,0 +1,36 @@
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/adc.h>
+
+/* Samples per block, shared by all the channels of the stream */
+#define ADC_STREAM_BLOCK_SAMPLES    512
+
+/* Default sampling interval (time between two samplings of all channels) */
+#define ADC_STREAM_DEFAULT_INTERVAL_US  100
+
+/* Block of consecutive samplings, samples interleaved by channel */
+struct adc_stream_block {
+    uint32_t seq;                               /* block sequence number */
+    uint32_t timestamp;                         /* k_cycle_get_32() at the start of the block */
+    uint16_t channels;                          /* samples per sampling */
+    uint16_t samplings;                         /* number of samplings in the block */
+    int16_t samples[ADC_STREAM_BLOCK_SAMPLES];
+};
+
+/* Sent to the host as is */
+struct adc_stream_stats {
+    uint32_t blocks;        /* blocks handed to consumers */
+    uint32_t overruns;      /* samplings dropped while both blocks were held by the consumer */
+    uint32_t errors;        /* failed async reads */
+};
+
+int32_t adc_stream_start(const struct adc_dt_spec *adc_specs, size_t count, uint32_t interval_us);
+void adc_stream_stop(void);
+bool adc_stream_is_running(void);
+int32_t adc_stream_get(struct adc_stream_block **block, k_timeout_t timeout);
+void adc_stream_release(struct adc_stream_block *block);
+void adc_stream_get_stats(struct adc_stream_stats *stats);
+
+#endif /* ADC_STREAM_H */
@@ -3,23 +3,68 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "analog.h"
+#include "phase_timing.h"
+
+LOG_MODULE_REGISTER(analog, LOG_LEVEL_INF);
 
 #define BUFFER_SIZE 1
 static int16_t m_sample_buffer[BUFFER_SIZE];
 
+/* Time of one SAADC conversion: 10us acquisition + 2us conversion */
+#define ADC_CONVERSION_TIME_US  12
+
+static int16_t m_window_buffer[ADC_CURRENT_MAX_SAMPLES];
+/* Samples of the window converted at a time, on the stack */
+#define ADC_CONVERT_CHUNK       64
+
+/* Voltage rails: 600mV reference, 1/6 gain, 12 bit and a 1/2 divider -> 7200/4096 mV per count */
+#define ADC_CAL_RAIL_GAIN_Q16   ((7200 << ADC_CAL_Q) / 4096)
+/* Current in the uA range: 879/(50*30) uA per count + 95uA */
+#define ADC_CAL_UA_GAIN_Q16     ((879 << ADC_CAL_Q) / (50*30))
+#define ADC_CAL_UA_OFFSET       95
+/* The mA range assumes a bypass path 100 times lower than the sense shunt */
+#define ADC_CAL_MA_GAIN_Q16     (ADC_CAL_UA_GAIN_Q16 * 100)
+
+#define ADC_CAL_RAIL_DEFAULT    { .gain_q16 = ADC_CAL_RAIL_GAIN_Q16, .offset = 0 }
+
+/* Active calibration, replaced as a whole by adc_cal_load() */
+static struct adc_cal_table m_cal = {
+    .magic = ADC_CAL_MAGIC,
+    .version = ADC_CAL_VERSION,
+    .chn = {
+        ADC_CAL_RAIL_DEFAULT, ADC_CAL_RAIL_DEFAULT, ADC_CAL_RAIL_DEFAULT, ADC_CAL_RAIL_DEFAULT,
+        ADC_CAL_RAIL_DEFAULT, ADC_CAL_RAIL_DEFAULT, ADC_CAL_RAIL_DEFAULT, ADC_CAL_RAIL_DEFAULT,
+    },
+    .current = {
+        [ADC_CURRENT_RANGE_UA] = { .gain_q16 = ADC_CAL_UA_GAIN_Q16, .offset = ADC_CAL_UA_OFFSET },
+        [ADC_CURRENT_RANGE_MA] = { .gain_q16 = ADC_CAL_MA_GAIN_Q16, .offset = 0 },
+    },
+};
+
+/* Range the current path is switched to, kept up to date by the current meter */
+static enum adc_current_range m_current_range = ADC_CURRENT_RANGE_UA;
+
 int32_t adc_init_chn(const struct adc_dt_spec *adc_spec){
 
     int err;
     
     if (!device_is_ready(adc_spec->dev)) {
-        printk("ADC controller device not ready\n");
+        LOG_ERR("ADC controller device not ready");
         return 1;
     }
 
     err = adc_channel_setup_dt(adc_spec);
     if (err < 0) {
-        printk("Could not setup channel: err (%d)\n", err);
+        LOG_ERR("Could not setup channel: err (%d)", err);
         return 2;
     }
 
@@ -39,7 +84,7 @@ int32_t adc_read_chn_raw(const struct adc_dt_spec *adc_spec){
 
     err = adc_read(adc_spec->dev, &sequence);
     if (err < 0) {
-        printk("Could not read (%d)\n", err);
+        LOG_ERR("Could not read (%d)", err);
         return -1;
 
     } else {
@@ -63,7 +108,7 @@ int32_t adc_read_chn_mV(const struct adc_dt_spec *adc_spec){
 
     err = adc_read(adc_spec->dev, &sequence);
     if (err < 0) {
-        printk("Could not read (%d)\n", err);
+        LOG_ERR("Could not read (%d)", err);
         return -1;
 
     } else {
@@ -72,7 +117,7 @@ int32_t adc_read_chn_mV(const struct adc_dt_spec *adc_spec){
         val_mv = m_sample_buffer[0];
         err = adc_raw_to_millivolts_dt(adc_spec, &val_mv);
         if (err < 0) {
-            printk(" (value in mV not available)\n");
+            LOG_WRN("Value in mV not available");
             return -1;
         } else {
             /* return mv value*/
@@ -85,29 +130,331 @@ int32_t adc_read_chn_mV(const struct adc_dt_spec *adc_spec){
 
 int32_t adc_read_dut_1v8(const struct adc_dt_spec *adc_spec){
 
-    int32_t val_mv;
+    int32_t raw;
     
-    val_mv = adc_read_chn_mV(adc_spec);
+    raw = adc_read_chn_raw(adc_spec);
+    if (raw < 0) {
+        return -1;
+    }
 
-    return val_mv*2;
+    return adc_cal_apply(adc_cal_get_chn(adc_spec), raw);
 
 }
 
 int32_t adc_read_ps_3v6(const struct adc_dt_spec *adc_spec){
-    int32_t val_mv;
+    int32_t raw;
     
-    val_mv = adc_read_chn_mV(adc_spec);
+    raw = adc_read_chn_raw(adc_spec);
+    if (raw < 0) {
+        return -1;
+    }
+
+    return adc_cal_apply(adc_cal_get_chn(adc_spec), raw);
+}
+
+
+int32_t adc_raw_to_current_uA(int32_t raw, enum adc_current_range range){
+    return adc_cal_apply(&m_cal.current[range], raw);
+}
+
+void adc_set_current_range(enum adc_current_range range){
+    m_current_range = range;
+}
+
+enum adc_current_range adc_get_current_range(void){
+    return m_current_range;
+}
+
+const struct adc_cal *adc_cal_get_chn(const struct adc_dt_spec *adc_spec){
+    return &m_cal.chn[adc_spec->channel_id];
+}
+
+const struct adc_cal *adc_cal_get_current(enum adc_current_range range){
+    return &m_cal.current[range];
+}
+
+/*!
+* @brief Replaces the active calibration table
+*
+* @param data Serialized struct adc_cal_table, from flash or a host command
+* @param len Length of data in bytes
+*
+* @return 0 if successful
+* @return -1 if the table is not valid, the active table is kept
+*
+*/
+int32_t adc_cal_load(const void *data, size_t len){
+    struct adc_cal_table table;
+
+    if (len != sizeof(table)) {
+        return -1;
+    }
+    memcpy(&table, data, sizeof(table));
+
+    if ((table.magic != ADC_CAL_MAGIC) || (table.version != ADC_CAL_VERSION) ||
+        (table.crc32 != crc32_ieee((const uint8_t *)&table, offsetof(struct adc_cal_table, crc32)))) {
+        LOG_WRN("Invalid calibration table");
+        return -1;
+    }
+
+    m_cal = table;
+
+    return 0;
+}
+
+/*!
+* @brief Loads the calibration table from the calibration flash partition
+*
+* @return 0 if successful
+* @return -1 if there is no partition or no valid table in it, the defaults are kept
+*
+*/
+int32_t adc_cal_load_flash(void){
+#if defined(CONFIG_FLASH_MAP) && FIXED_PARTITION_EXISTS(calibration_partition)
+    const struct flash_area *fa;
+    struct adc_cal_table table;
+    int err;
+
+    err = flash_area_open(FIXED_PARTITION_ID(calibration_partition), &fa);
+    if (err < 0) {
+        return -1;
+    }
+
+    err = flash_area_read(fa, 0, &table, sizeof(table));
+    flash_area_close(fa);
+    if (err < 0) {
+        return -1;
+    }
 
-    return val_mv*2;
+    return adc_cal_load(&table, sizeof(table));
+#else
+    return -1;
+#endif
 }
 
+/*!
+* @brief Converts a block of raw samples to engineering units
+*
+* @param raw First raw sample of the channel
+* @param stride Distance between two samples of the channel, number of interleaved channels
+* @param out Where the count converted values are stored, contiguous
+* @param count Number of samples to convert
+* @param cal Calibration of the channel
+*
+*/
+void adc_convert_block(const int16_t *raw, size_t stride, int32_t *out, size_t count, const struct adc_cal *cal){
+    const int64_t gain = cal->gain_q16;
+    const int64_t offset = ((int64_t)cal->offset << ADC_CAL_Q) + BIT(ADC_CAL_Q - 1);
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (int32_t)((raw[i * stride] * gain + offset) >> ADC_CAL_Q);
+    }
+}
 
 int32_t adc_read_dut_current_uA(const struct adc_dt_spec *adc_spec){
     int32_t current_uA;
-    int32_t offset = 95;
 
     current_uA = adc_read_chn_raw(adc_spec);
-    current_uA = ((current_uA*879)/50/30) + offset;
+    current_uA = adc_raw_to_current_uA(current_uA, m_current_range);
 
     return current_uA;
 }
+
+/*!
+* @brief Samples all the given channels in a single ADC sequence
+*
+* The channels are converted back to back by one adc_read() call, so the
+* readings are taken at (nearly) the same instant. The SAADC stores the
+* samples ordered by channel id, they are remapped here to the order of
+* adc_specs so the result can be indexed with the ADC_xxx_CHN macros.
+*
+* @param adc_specs Array of channels, usually the zephyr,user io-channels
+* @param count Number of entries in adc_specs
+* @param result Caller-owned structure where the readings are stored
+*
+* @return 0 if successful
+* @return -1 if the channels can not be sampled in one sequence or the read failed
+*
+*/
+int32_t adc_scan_chn(const struct adc_dt_spec *adc_specs, size_t count, struct adc_scan_result *result){
+    int16_t samples[ADC_SCAN_MAX_CHN];
+    uint32_t channels = 0;
+    int err;
+
+    if ((count == 0) || (count > ADC_SCAN_MAX_CHN)) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        /* One sequence means one device and one resolution for all channels */
+        if ((adc_specs[i].dev != adc_specs[0].dev) ||
+            (adc_specs[i].resolution != adc_specs[0].resolution)) {
+            LOG_ERR("Channel %u can not be scanned with channel %u",
+                    adc_specs[i].channel_id, adc_specs[0].channel_id);
+            return -1;
+        }
+        channels |= BIT(adc_specs[i].channel_id);
+    }
+
+	struct adc_sequence sequence = {
+		.buffer = samples,
+		/* buffer size in bytes, not number of samples */
+		.buffer_size = count * sizeof(samples[0]),
+	};
+
+    (void)adc_sequence_init_dt(&adc_specs[0], &sequence);
+    sequence.channels = channels;
+
+    result->timestamp = k_cycle_get_32();
+    err = adc_read(adc_specs[0].dev, &sequence);
+    phase_timing_end(PHASE_ADC_SCAN, result->timestamp);
+    if (err < 0) {
+        LOG_ERR("Could not scan (%d)", err);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        /* Position in the buffer = number of lower channels in the sequence */
+        uint8_t pos = popcount(channels & BIT_MASK(adc_specs[i].channel_id));
+
+        result->raw[i] = samples[pos];
+
+        if (i == ADC_CURRENT_CHN) {
+            result->value[i] = adc_raw_to_current_uA(samples[pos], m_current_range);
+        } else {
+            result->value[i] = adc_cal_apply(adc_cal_get_chn(&adc_specs[i]), samples[pos]);
+        }
+    }
+
+    return 0;
+}
+
+
+static int cmp_int16(const void *a, const void *b){
+    return *(const int16_t *)a - *(const int16_t *)b;
+}
+
+static uint32_t isqrt64(uint64_t val){
+    uint64_t res = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > val) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (val >= res + bit) {
+            val -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)res;
+}
+
+/*!
+* @brief Measures the DUT current over a time window
+*
+* The window is captured as one block of evenly spaced samplings, each of
+* them averaged in hardware by the SAADC oversampling. Mean, min, max, RMS
+* and the requested percentile are computed over the whole block, so short
+* wake-up spikes of a sleeping DUT do not decide the result on their own.
+*
+* @param adc_spec Current channel
+* @param window Capture configuration, NULL for the defaults
+* @param stats Where the statistics are stored
+*
+* @return 0 if successful
+* @return -1 if the read failed
+*
+*/
+int32_t adc_measure_dut_current(const struct adc_dt_spec *adc_spec, const struct adc_current_window *window,
+                                struct adc_current_stats *stats){
+    static const struct adc_current_window default_window = {
+        .window_ms = ADC_CURRENT_WINDOW_MS,
+        .oversampling = ADC_CURRENT_OVERSAMPLING,
+        .percentile = ADC_CURRENT_PERCENTILE,
+    };
+    uint32_t samples = ADC_CURRENT_MAX_SAMPLES;
+    uint32_t min_interval_us;
+    uint32_t interval_us;
+    int64_t sum = 0;
+    uint64_t sum_sq = 0;
+    const struct adc_cal *cal = adc_cal_get_current(m_current_range);
+    uint32_t start;
+    int err;
+
+    if (window == NULL) {
+        window = &default_window;
+    }
+
+    /* Fewer samples if the window is too short for the oversampled conversions */
+    min_interval_us = ADC_CONVERSION_TIME_US << window->oversampling;
+    interval_us = (window->window_ms * 1000) / samples;
+    if (interval_us < min_interval_us) {
+        interval_us = min_interval_us;
+        samples = MAX((window->window_ms * 1000) / interval_us, 1);
+    }
+
+    struct adc_sequence_options options = {
+        .interval_us = interval_us,
+        .extra_samplings = samples - 1,
+    };
+
+	struct adc_sequence sequence = {
+		.options = &options,
+		.buffer = m_window_buffer,
+		/* buffer size in bytes, not number of samples */
+		.buffer_size = samples * sizeof(m_window_buffer[0]),
+	};
+
+    (void)adc_sequence_init_dt(adc_spec, &sequence);
+    sequence.oversampling = window->oversampling;
+
+    start = phase_timing_begin();
+    err = adc_read(adc_spec->dev, &sequence);
+    phase_timing_end(PHASE_ADC_WINDOW, start);
+    if (err < 0) {
+        LOG_ERR("Could not read window (%d)", err);
+        return -1;
+    }
+
+    stats->samples = samples;
+    stats->min_uA = INT32_MAX;
+    stats->max_uA = INT32_MIN;
+
+    for (uint32_t i = 0; i < samples; i += ADC_CONVERT_CHUNK) {
+        int32_t current_uA[ADC_CONVERT_CHUNK];
+        size_t count = MIN(samples - i, ADC_CONVERT_CHUNK);
+
+        adc_convert_block(&m_window_buffer[i], 1, current_uA, count, cal);
+        for (size_t j = 0; j < count; j++) {
+            sum += current_uA[j];
+            sum_sq += (int64_t)current_uA[j] * current_uA[j];
+            stats->min_uA = MIN(stats->min_uA, current_uA[j]);
+            stats->max_uA = MAX(stats->max_uA, current_uA[j]);
+        }
+    }
+
+    stats->mean_uA = (int32_t)(sum / samples);
+    stats->rms_uA = (int32_t)isqrt64(sum_sq / samples);
+
+    /* The conversion is monotonic, the percentile can be taken on the raw values */
+    qsort(m_window_buffer, samples, sizeof(m_window_buffer[0]), cmp_int16);
+    stats->pct_uA = adc_cal_apply(cal,
+        m_window_buffer[((samples - 1) * CLAMP(window->percentile, 1, 100)) / 100]);
+
+    return 0;
+}
+
+/*!
+* @brief Pass/fail check of the sleep current on a measured window
+*
+* @return true if the mean current over the window is below DUT_MAX_SLEEP_CURRENT_UA
+*/
+bool adc_dut_sleep_current_ok(const struct adc_current_stats *stats){
+    return (stats->samples > 0) && (stats->mean_uA <= DUT_MAX_SLEEP_CURRENT_UA);
+}
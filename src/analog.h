@@ -20,11 +20,87 @@
 #define ADC_3v6_CHN         1
 #define ADC_3v45_CHN         2
 
+/* Maximum number of channels in a single scan (SAADC has 8 channels) */
+#define ADC_SCAN_MAX_CHN    8
+
+/* Per-rail results of a single multi-channel scan, indexed like adc_channels[] */
+struct adc_scan_result {
+    uint32_t timestamp;                     /* k_cycle_get_32() when the scan started */
+    int16_t raw[ADC_SCAN_MAX_CHN];          /* raw ADC counts */
+    int32_t value[ADC_SCAN_MAX_CHN];        /* uA for ADC_CURRENT_CHN, rail mV for the rest */
+};
+
+/* DUT current ranges, selected with SHUNT_EN_PIN / SHUNT_BYPASS_PIN */
+enum adc_current_range {
+    ADC_CURRENT_RANGE_UA,       /* sense shunt in the path, sleep currents */
+    ADC_CURRENT_RANGE_MA,       /* shunt bypassed, active currents */
+    ADC_CURRENT_RANGE_COUNT
+};
+
+/* Calibration in Q16.16 fixed point: value = ((raw * gain_q16) >> 16) + offset */
+#define ADC_CAL_Q               16
+#define ADC_CAL_MAGIC           0x4C414341  /* "ACAL" */
+#define ADC_CAL_VERSION         1
+
+struct adc_cal {
+    int32_t gain_q16;           /* engineering units (mV or uA) per count, Q16.16 */
+    int32_t offset;             /* engineering units */
+} __packed;
+
+/* Calibration table as stored in flash or sent by the host, crc32 covers everything before it */
+struct adc_cal_table {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    struct adc_cal chn[ADC_SCAN_MAX_CHN];               /* voltage rails, indexed by SAADC channel id */
+    struct adc_cal current[ADC_CURRENT_RANGE_COUNT];    /* current channel, per range */
+    uint32_t crc32;
+} __packed;
+
+static inline int32_t adc_cal_apply(const struct adc_cal *cal, int32_t raw){
+    return (int32_t)((((int64_t)raw * cal->gain_q16) + BIT(ADC_CAL_Q - 1)) >> ADC_CAL_Q) + cal->offset;
+}
+
+/* Sleep current window measurement defaults */
+#define ADC_CURRENT_WINDOW_MS           200
+#define ADC_CURRENT_OVERSAMPLING        4       /* 2^4 samples averaged by the SAADC */
+#define ADC_CURRENT_PERCENTILE          95
+#define ADC_CURRENT_MAX_SAMPLES         1024
+
+/* Current measurement window configuration */
+struct adc_current_window {
+    uint32_t window_ms;         /* length of the capture */
+    uint8_t oversampling;       /* 2^n samples averaged in hardware per stored sample */
+    uint8_t percentile;         /* percentile reported in pct_uA, 1..100 */
+};
+
+/* Statistics of the current over a capture window */
+struct adc_current_stats {
+    uint32_t samples;
+    int32_t mean_uA;
+    int32_t min_uA;
+    int32_t max_uA;
+    int32_t rms_uA;
+    int32_t pct_uA;
+};
+
 int32_t adc_init_chn(const struct adc_dt_spec *adc_spec);
 int32_t adc_read_chn_raw(const struct adc_dt_spec *adc_spec);
 int32_t adc_read_chn_mV(const struct adc_dt_spec *adc_spec);
 int32_t adc_read_dut_1v8(const struct adc_dt_spec *adc_spec);
 int32_t adc_read_ps_3v6(const struct adc_dt_spec *adc_spec);
 int32_t adc_read_dut_current_uA(const struct adc_dt_spec *adc_spec);
+int32_t adc_measure_dut_current(const struct adc_dt_spec *adc_spec, const struct adc_current_window *window,
+                                struct adc_current_stats *stats);
+int32_t adc_raw_to_current_uA(int32_t raw, enum adc_current_range range);
+void adc_set_current_range(enum adc_current_range range);
+enum adc_current_range adc_get_current_range(void);
+const struct adc_cal *adc_cal_get_chn(const struct adc_dt_spec *adc_spec);
+const struct adc_cal *adc_cal_get_current(enum adc_current_range range);
+int32_t adc_cal_load(const void *data, size_t len);
+int32_t adc_cal_load_flash(void);
+void adc_convert_block(const int16_t *raw, size_t stride, int32_t *out, size_t count, const struct adc_cal *cal);
+bool adc_dut_sleep_current_ok(const struct adc_current_stats *stats);
+int32_t adc_scan_chn(const struct adc_dt_spec *adc_specs, size_t count, struct adc_scan_result *result);
 
 #endif /* DUT_UART HEADER*/
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "bcd_time.h"
+
+#include <errno.h>
+
+#define SECS_PER_DAY        86400U
+#define DAYS_PER_4_YEARS    1461U
+
+// Register fields, flag bits (OS, AM/PM) masked off
+#define SEC_MASK            0x7F
+#define MIN_MASK            0x7F
+#define HOUR_MASK           0x3F
+#define DAY_MASK            0x3F
+#define WEEKDAY_MASK        0x07
+#define MONTH_MASK          0x1F
+
+/* Days before the first of each month, [leap][month 0..12] */
+static const uint16_t days_before_month[2][13] = {
+	{0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},
+	{0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366}};
+
+/* Days from 2000-01-01 to the given date, years 0..99 after 2000 */
+static uint32_t days_since_2000(uint32_t year, uint32_t month, uint32_t day)
+{
+	uint32_t leap = (year % 4) == 0; // 2000 is a leap year too, 2100 is out of range
+
+	return (year * 365) + ((year + 3) / 4) + days_before_month[leap][month - 1] + day - 1;
+}
+
+/* Checks the fields are BCD and within range, decoded into bin[] */
+static int decode_regs(const uint8_t regs[BCD_TIME_REGS], uint8_t bin[BCD_TIME_REGS])
+{
+	static const uint8_t masks[BCD_TIME_REGS] = {SEC_MASK, MIN_MASK, HOUR_MASK, DAY_MASK,
+						     WEEKDAY_MASK, MONTH_MASK, 0xFF};
+	uint8_t leap;
+
+	for(int i = 0; i < BCD_TIME_REGS; i++){
+		uint8_t reg = regs[i] & masks[i];
+
+		if(!bcd_valid(reg))
+			return -EINVAL;
+		bin[i] = bcd_decode(reg);
+	}
+
+	if((bin[BCD_TIME_SEC] > 59) || (bin[BCD_TIME_MIN] > 59) || (bin[BCD_TIME_HOUR] > 23) ||
+	   (bin[BCD_TIME_MONTH] < 1) || (bin[BCD_TIME_MONTH] > 12) || (bin[BCD_TIME_DAY] < 1))
+		return -EINVAL;
+
+	leap = (bin[BCD_TIME_YEAR] % 4) == 0;
+	if(bin[BCD_TIME_DAY] > (days_before_month[leap][bin[BCD_TIME_MONTH]] -
+				days_before_month[leap][bin[BCD_TIME_MONTH] - 1]))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*!
+* @brief Converts Unix time to the RTC time registers
+*
+* @param ts Seconds since January 01 1970 (UTC), years 2000 to 2099
+* @param regs Seconds .. Years registers, BCD, 24 hour format
+*
+* @return 0 if successful
+* @return -ERANGE if the time does not fit the RTC years register
+*
+*/
+int bcd_time_from_epoch(int64_t ts, uint8_t regs[BCD_TIME_REGS])
+{
+	uint32_t secs, days, sod, rem, year, month, leap;
+
+	if((ts < BCD_TIME_EPOCH_2000) || (ts >= BCD_TIME_EPOCH_2100))
+		return -ERANGE;
+
+	// A century of seconds fits in 32 bits
+	secs = (uint32_t)(ts - BCD_TIME_EPOCH_2000);
+	days = secs / SECS_PER_DAY;
+	sod = secs % SECS_PER_DAY;
+
+	// Four year cycles starting with a leap year, 2000 included
+	year = (days / DAYS_PER_4_YEARS) * 4;
+	rem = days % DAYS_PER_4_YEARS;
+	if(rem >= 366){
+		rem -= 366;
+		year += 1 + (rem / 365);
+		rem %= 365;
+		leap = 0;
+	}else{
+		leap = 1;
+	}
+
+	// rem / 32 never overshoots the month, at most two steps forward
+	month = rem / 32;
+	while(rem >= days_before_month[leap][month + 1])
+		month++;
+
+	regs[BCD_TIME_SEC] = bcd_encode(sod % 60);
+	regs[BCD_TIME_MIN] = bcd_encode((sod / 60) % 60);
+	regs[BCD_TIME_HOUR] = bcd_encode(sod / 3600);
+	regs[BCD_TIME_DAY] = bcd_encode(rem - days_before_month[leap][month] + 1);
+	regs[BCD_TIME_WEEKDAY] = (days + 6) % 7;	// 2000-01-01 was a Saturday
+	regs[BCD_TIME_MONTH] = bcd_encode(month + 1);
+	regs[BCD_TIME_YEAR] = bcd_encode(year);
+
+	return 0;
+}
+
+/*!
+* @brief Converts the RTC time registers to Unix time
+*
+* @param regs Seconds .. Years registers as read from the RTC, flag bits are ignored
+* @param ts Seconds since January 01 1970 (UTC)
+*
+* @return 0 if successful
+* @return -EINVAL if a register holds an invalid value
+*
+*/
+int bcd_time_to_epoch(const uint8_t regs[BCD_TIME_REGS], int64_t *ts)
+{
+	uint8_t bin[BCD_TIME_REGS];
+	int err = decode_regs(regs, bin);
+
+	if(err)
+		return err;
+
+	*ts = BCD_TIME_EPOCH_2000 +
+	      (int64_t)days_since_2000(bin[BCD_TIME_YEAR], bin[BCD_TIME_MONTH], bin[BCD_TIME_DAY]) * SECS_PER_DAY +
+	      (bin[BCD_TIME_HOUR] * 3600) + (bin[BCD_TIME_MIN] * 60) + bin[BCD_TIME_SEC];
+
+	return 0;
+}
+
+/*!
+* @brief Converts the RTC time registers to struct tm
+*
+* Weekday and day of the year are derived from the date, not from the weekday register.
+*
+* @param regs Seconds .. Years registers as read from the RTC, flag bits are ignored
+* @param time Broken down time, tm_mon 0 based and tm_year since 1900
+*
+* @return 0 if successful
+* @return -EINVAL if a register holds an invalid value
+*
+*/
+int bcd_time_to_tm(const uint8_t regs[BCD_TIME_REGS], struct tm *time)
+{
+	uint8_t bin[BCD_TIME_REGS];
+	uint32_t days;
+	int err = decode_regs(regs, bin);
+
+	if(err)
+		return err;
+
+	days = days_since_2000(bin[BCD_TIME_YEAR], bin[BCD_TIME_MONTH], bin[BCD_TIME_DAY]);
+
+	time->tm_sec = bin[BCD_TIME_SEC];
+	time->tm_min = bin[BCD_TIME_MIN];
+	time->tm_hour = bin[BCD_TIME_HOUR];
+	time->tm_mday = bin[BCD_TIME_DAY];
+	time->tm_mon = bin[BCD_TIME_MONTH] - 1;
+	time->tm_year = bin[BCD_TIME_YEAR] + 100;
+	time->tm_wday = (days + 6) % 7;
+	time->tm_yday = days - days_since_2000(bin[BCD_TIME_YEAR], 1, 1);
+	time->tm_isdst = 0;
+
+	return 0;
+}
+
+/* BCD nibbles are the digits already */
+static char *put_bcd(char *p, uint8_t bcd)
+{
+	p[0] = '0' + (bcd >> 4);
+	p[1] = '0' + (bcd & 0x0F);
+	return p + 2;
+}
+
+/*!
+* @brief Writes the RTC time registers as ISO-8601, "YYYY-MM-DDTHH:MM:SSZ"
+*
+* @param regs Seconds .. Years registers, flag bits are ignored
+* @param buf Destination
+* @param len Size of buf, at least BCD_TIME_ISO8601_SIZE
+*
+* @return Number of characters written, without the terminator
+* @return -ENOMEM if buf is too small
+*
+*/
+int bcd_time_format_regs(const uint8_t regs[BCD_TIME_REGS], char *buf, size_t len)
+{
+	char *p = buf;
+
+	if(len < BCD_TIME_ISO8601_SIZE)
+		return -ENOMEM;
+
+	*p++ = '2';
+	*p++ = '0';
+	p = put_bcd(p, regs[BCD_TIME_YEAR]);
+	*p++ = '-';
+	p = put_bcd(p, regs[BCD_TIME_MONTH] & MONTH_MASK);
+	*p++ = '-';
+	p = put_bcd(p, regs[BCD_TIME_DAY] & DAY_MASK);
+	*p++ = 'T';
+	p = put_bcd(p, regs[BCD_TIME_HOUR] & HOUR_MASK);
+	*p++ = ':';
+	p = put_bcd(p, regs[BCD_TIME_MIN] & MIN_MASK);
+	*p++ = ':';
+	p = put_bcd(p, regs[BCD_TIME_SEC] & SEC_MASK);
+	*p++ = 'Z';
+	*p = '\0';
+
+	return BCD_TIME_ISO8601_LEN;
+}
+
+/*!
+* @brief Writes Unix time as ISO-8601, "YYYY-MM-DDTHH:MM:SSZ"
+*
+* @param ts Seconds since January 01 1970 (UTC), years 2000 to 2099
+* @param buf Destination
+* @param len Size of buf, at least BCD_TIME_ISO8601_SIZE
+*
+* @return Number of characters written, without the terminator
+* @return -ERANGE if the time is out of range
+* @return -ENOMEM if buf is too small
+*
+*/
+int bcd_time_format(int64_t ts, char *buf, size_t len)
+{
+	uint8_t regs[BCD_TIME_REGS];
+	int err = bcd_time_from_epoch(ts, regs);
+
+	if(err)
+		return err;
+
+	return bcd_time_format_regs(regs, buf, len);
+}
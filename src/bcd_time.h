@@ -0,0 +1,56 @@
+#ifndef BCD_TIME_H
+#define BCD_TIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * BCD codec and epoch <-> RTC register conversion for the PCF8523 time
+ * registers (Seconds .. Years). Table based, no struct tm or gmtime() on
+ * the way, so every function is reentrant.
+ */
+
+// Time registers as laid out from PCF8523_SECONDS_ADD
+#define BCD_TIME_SEC                0
+#define BCD_TIME_MIN                1
+#define BCD_TIME_HOUR               2
+#define BCD_TIME_DAY                3
+#define BCD_TIME_WEEKDAY            4
+#define BCD_TIME_MONTH              5
+#define BCD_TIME_YEAR               6
+#define BCD_TIME_REGS               7
+
+// Years register counts from 2000, the range the RTC can hold
+#define BCD_TIME_EPOCH_2000         946684800LL     // 2000-01-01T00:00:00Z
+#define BCD_TIME_EPOCH_2100         4102444800LL    // 2100-01-01T00:00:00Z
+
+// "YYYY-MM-DDTHH:MM:SSZ" and its terminator
+#define BCD_TIME_ISO8601_LEN        20
+#define BCD_TIME_ISO8601_SIZE       (BCD_TIME_ISO8601_LEN + 1)
+
+/* 0..99 to packed BCD: every ten adds 6 to skip the A..F codes */
+static inline uint8_t bcd_encode(uint8_t bin)
+{
+	return bin + (uint8_t)(((bin * 103U) >> 10) * 6U);
+}
+
+/* Packed BCD to 0..99 */
+static inline uint8_t bcd_decode(uint8_t bcd)
+{
+	return bcd - (uint8_t)((bcd >> 4) * 6U);
+}
+
+/* Both nibbles 0..9 */
+static inline int bcd_valid(uint8_t bcd)
+{
+	return ((bcd & 0x0F) < 10) && (bcd < 0xA0);
+}
+
+int bcd_time_from_epoch(int64_t ts, uint8_t regs[BCD_TIME_REGS]);
+int bcd_time_to_epoch(const uint8_t regs[BCD_TIME_REGS], int64_t *ts);
+int bcd_time_to_tm(const uint8_t regs[BCD_TIME_REGS], struct tm *time);
+int bcd_time_format_regs(const uint8_t regs[BCD_TIME_REGS], char *buf, size_t len);
+int bcd_time_format(int64_t ts, char *buf, size_t len);
+
+#endif /* BCD_TIME_H */
@@ -0,0 +1,176 @@
+#include "bridge.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(bridge, LOG_LEVEL_INF);
+
+#define BRIDGE_STACK_SIZE	1024
+#define BRIDGE_PRIORITY		4
+
+static struct uart_port *m_host;
+static struct uart_port *m_dut;
+static atomic_t m_running;
+static struct bridge_stats m_stats;
+/* Port drop counters when the bridge started, the stats only count the bridge's own */
+static uint32_t m_host_rx_dropped;
+static uint32_t m_dut_rx_dropped;
+static uint32_t m_tx_dropped;
+static K_SEM_DEFINE(bridge_start_sem, 0, 1);
+
+/* Applies the baud rate the host set on the CDC ACM port to the DUT UART */
+static void bridge_follow_baudrate(void)
+{
+	struct uart_config cfg;
+	uint32_t baudrate;
+
+	if (uart_line_ctrl_get(m_host->dev, UART_LINE_CTRL_BAUD_RATE, &baudrate) != 0) {
+		return;
+	}
+
+	if ((baudrate == 0) || (baudrate == m_stats.baudrate)) {
+		return;
+	}
+
+	if ((uart_config_get(m_dut->dev, &cfg) != 0)) {
+		return;
+	}
+
+	cfg.baudrate = baudrate;
+	if (uart_configure(m_dut->dev, &cfg) != 0) {
+		LOG_WRN("DUT UART does not support %u baud", baudrate);
+		/* Do not retry the same rate on every poll */
+		m_stats.baudrate = baudrate;
+		return;
+	}
+
+	LOG_INF("Bridge baud rate %u", baudrate);
+	m_stats.baudrate = baudrate;
+}
+
+/* The host closing the port ends the bridge, USB data goes back to the command protocol */
+static void bridge_check_dtr(void)
+{
+	uint32_t dtr;
+
+	if ((uart_line_ctrl_get(m_host->dev, UART_LINE_CTRL_DTR, &dtr) == 0) && (dtr == 0)) {
+		LOG_INF("DTR dropped, bridge stopped");
+		atomic_clear(&m_running);
+	}
+}
+
+/*
+ * The ISRs only move bytes between FIFOs and rings, all the back-pressure
+ * handling is done here: data only leaves an RX ring when the other TX ring
+ * has room for it, and the USB side is held off by flow control meanwhile.
+ */
+static void bridge_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&bridge_start_sem, K_FOREVER);
+
+		struct k_poll_event events[] = {
+			K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE,
+						 K_POLL_MODE_NOTIFY_ONLY, &m_host->rx_sem),
+			K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE,
+						 K_POLL_MODE_NOTIFY_ONLY, &m_dut->rx_sem),
+		};
+		int64_t next_baud_check = 0;
+
+		while (atomic_get(&m_running)) {
+			(void)k_poll(events, ARRAY_SIZE(events), K_MSEC(BRIDGE_BAUD_POLL_MS));
+			(void)k_sem_take(&m_host->rx_sem, K_NO_WAIT);
+			(void)k_sem_take(&m_dut->rx_sem, K_NO_WAIT);
+			events[0].state = K_POLL_STATE_NOT_READY;
+			events[1].state = K_POLL_STATE_NOT_READY;
+
+			m_stats.bytes_to_dut += uart_port_forward(m_host, m_dut);
+			m_stats.bytes_to_host += uart_port_forward(m_dut, m_host);
+
+			m_stats.host_rx_dropped = m_host->rx_dropped - m_host_rx_dropped;
+			m_stats.dut_rx_dropped = m_dut->rx_dropped - m_dut_rx_dropped;
+			m_stats.tx_dropped = m_host->tx_dropped + m_dut->tx_dropped - m_tx_dropped;
+
+			if (k_uptime_get() >= next_baud_check) {
+				bridge_check_dtr();
+				bridge_follow_baudrate();
+				next_baud_check = k_uptime_get() + BRIDGE_BAUD_POLL_MS;
+			}
+		}
+
+		uart_port_set_flow_control(m_host, false);
+		uart_port_release(m_dut);
+		LOG_INF("Bridge: %u bytes to the DUT, %u to the host, dropped %u USB RX, %u DUT RX, %u TX",
+			m_stats.bytes_to_dut, m_stats.bytes_to_host, m_stats.host_rx_dropped,
+			m_stats.dut_rx_dropped, m_stats.tx_dropped);
+	}
+}
+
+K_THREAD_DEFINE(bridge_tid, BRIDGE_STACK_SIZE, bridge_thread,
+		NULL, NULL, NULL, BRIDGE_PRIORITY, 0, 0);
+
+/*!
+* @brief Starts piping all the traffic between the host and the DUT ports
+*
+* While the bridge runs nothing else should read the RX rings of the ports.
+*
+* @param host USB CDC ACM port
+* @param dut DUT UART port
+*
+* @return 0 if successful
+* @return -EALREADY if the bridge is already running
+* @return -EBUSY if the DUT port is in use
+*
+*/
+int bridge_start(struct uart_port *host, struct uart_port *dut)
+{
+	struct uart_config cfg;
+
+	if (!atomic_cas(&m_running, 0, 1)) {
+		return -EALREADY;
+	}
+	if (uart_port_claim(dut) != 0) {
+		atomic_clear(&m_running);
+		return -EBUSY;
+	}
+
+	m_host = host;
+	m_dut = dut;
+	m_stats = (struct bridge_stats){0};
+	m_host_rx_dropped = host->rx_dropped;
+	m_dut_rx_dropped = dut->rx_dropped;
+	m_tx_dropped = host->tx_dropped + dut->tx_dropped;
+	if (uart_config_get(dut->dev, &cfg) == 0) {
+		m_stats.baudrate = cfg.baudrate;
+	}
+
+	/* The USB host is held off when the bridge can not keep up */
+	uart_port_set_flow_control(host, true);
+
+	k_sem_give(&bridge_start_sem);
+
+	return 0;
+}
+
+void bridge_stop(void)
+{
+	atomic_clear(&m_running);
+}
+
+bool bridge_is_running(void)
+{
+	return atomic_get(&m_running) != 0;
+}
+
+/*!
+* @brief Gets the counters of the running or last bridge session
+*/
+void bridge_get_stats(struct bridge_stats *stats)
+{
+	*stats = m_stats;
+}
@@ -0,0 +1,24 @@
+#ifndef BRIDGE_H
+#define BRIDGE_H
+
+#include "uart_port.h"
+
+/* How often the host baud rate is checked for changes */
+#define BRIDGE_BAUD_POLL_MS	100
+
+/* Counted from bridge_start(), sent to the host as is */
+struct bridge_stats {
+	uint32_t baudrate;		/* baud rate currently applied to the DUT UART */
+	uint32_t bytes_to_dut;
+	uint32_t bytes_to_host;
+	uint32_t host_rx_dropped;	/* lost in the USB RX ring */
+	uint32_t dut_rx_dropped;	/* lost in the DUT UART RX ring */
+	uint32_t tx_dropped;		/* not queued in either TX ring */
+};
+
+int bridge_start(struct uart_port *host, struct uart_port *dut);
+void bridge_stop(void);
+bool bridge_is_running(void);
+void bridge_get_stats(struct bridge_stats *stats);
+
+#endif /* BRIDGE_H */
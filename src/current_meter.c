@@ -0,0 +1,117 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(current_meter, LOG_LEVEL_INF);
+
+#include "current_meter.h"
+
+static const struct adc_dt_spec *m_adc_spec;
+static const struct gpio_dt_spec *m_shunt_en;
+static const struct gpio_dt_spec *m_shunt_bypass;
+
+/*!
+* @brief Initializes the current meter and selects the uA range
+*
+* @param adc_spec Current channel
+* @param shunt_en Pin enabling the sense shunt path
+* @param shunt_bypass Pin enabling the shunt bypass path
+*
+* @return 0 if successful
+* @return -1 if the range could not be set
+*
+*/
+int32_t current_meter_init(const struct adc_dt_spec *adc_spec, const struct gpio_dt_spec *shunt_en,
+                           const struct gpio_dt_spec *shunt_bypass){
+    m_adc_spec = adc_spec;
+    m_shunt_en = shunt_en;
+    m_shunt_bypass = shunt_bypass;
+
+    return current_meter_set_range(ADC_CURRENT_RANGE_UA);
+}
+
+/*!
+* @brief Switches the DUT current path to the given range
+*
+* The new path is enabled before the old one is opened so the DUT supply
+* is never interrupted, then the function waits for the path to settle.
+*
+* @param range Range to switch to
+*
+* @return 0 if successful
+* @return -1 if the pins could not be set
+*
+*/
+int32_t current_meter_set_range(enum adc_current_range range){
+    int err;
+
+    if (range == ADC_CURRENT_RANGE_MA) {
+        err = gpio_pin_set_raw(m_shunt_bypass->port, m_shunt_bypass->pin, 1);
+        err |= gpio_pin_set_raw(m_shunt_en->port, m_shunt_en->pin, 0);
+    } else {
+        err = gpio_pin_set_raw(m_shunt_en->port, m_shunt_en->pin, 1);
+        err |= gpio_pin_set_raw(m_shunt_bypass->port, m_shunt_bypass->pin, 0);
+    }
+
+    if (err) {
+        LOG_ERR("Could not switch current range");
+        return -1;
+    }
+
+    adc_set_current_range(range);
+    k_busy_wait(CURRENT_METER_SETTLE_US);
+
+    return 0;
+}
+
+/*!
+* @brief Reads the DUT current, switching range when the reading is out of the window
+*
+* After CURRENT_METER_MAX_SWITCHES switches the last sample is kept, converted
+* with the range it was taken in even if it is out of the window.
+*
+* @param reading Where the current, raw value and range used are stored
+*
+* @return 0 if successful
+* @return -1 if the ADC read or the range switch failed
+*
+*/
+int32_t current_meter_read(struct current_reading *reading){
+    enum adc_current_range range = adc_get_current_range();
+    enum adc_current_range next;
+    int32_t raw;
+
+    for (int switches = 0; ; switches++) {
+        raw = adc_read_chn_raw(m_adc_spec);
+        if (raw < 0) {
+            return -1;
+        }
+
+        if ((range == ADC_CURRENT_RANGE_UA) && (raw > CURRENT_METER_UP_RAW)) {
+            next = ADC_CURRENT_RANGE_MA;
+        } else if ((range == ADC_CURRENT_RANGE_MA) && (raw < CURRENT_METER_DOWN_RAW)) {
+            next = ADC_CURRENT_RANGE_UA;
+        } else {
+            break;
+        }
+
+        /* Out of switches, the sample stays with the range it was taken in */
+        if (switches == CURRENT_METER_MAX_SWITCHES) {
+            break;
+        }
+
+        /* Sample taken before the switch is discarded */
+        if (current_meter_set_range(next) < 0) {
+            return -1;
+        }
+        range = next;
+    }
+
+    reading->raw = raw;
+    reading->range = range;
+    reading->current_uA = adc_raw_to_current_uA(raw, range);
+
+    return 0;
+}
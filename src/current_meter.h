@@ -0,0 +1,30 @@
+#ifndef CURRENT_METER_H
+#define CURRENT_METER_H
+
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/gpio.h>
+
+#include "analog.h"
+
+/* Autoranging thresholds in raw counts (12 bit), hysteresis between them */
+#define CURRENT_METER_UP_RAW        3700    /* uA range close to full scale, go to mA */
+#define CURRENT_METER_DOWN_RAW      30      /* mA range reading fits in the uA range, go to uA */
+
+/* Time for the current path to settle after a range switch */
+#define CURRENT_METER_SETTLE_US     500
+
+/* Range switches allowed in a single reading */
+#define CURRENT_METER_MAX_SWITCHES  2
+
+struct current_reading {
+    int32_t current_uA;
+    int16_t raw;
+    enum adc_current_range range;
+};
+
+int32_t current_meter_init(const struct adc_dt_spec *adc_spec, const struct gpio_dt_spec *shunt_en,
+                           const struct gpio_dt_spec *shunt_bypass);
+int32_t current_meter_set_range(enum adc_current_range range);
+int32_t current_meter_read(struct current_reading *reading);
+
+#endif /* CURRENT_METER_H */
@@ -0,0 +1,154 @@
+#include <zephyr/kernel.h>
+
+#include "dut_emul.h"
+
+#ifdef CONFIG_UART_EMUL
+
+#include <zephyr/drivers/serial/uart_emul.h>
+
+/* The loopback copies the data to RX but keeps it in the TX FIFO too, empty it as the line would */
+void dut_emul_uart_drain(const struct device *dev, size_t size, void *user_data)
+{
+	uint8_t buf[32];
+
+	ARG_UNUSED(size);
+	ARG_UNUSED(user_data);
+
+	while (uart_emul_get_tx_data(dev, buf, sizeof(buf)) > 0) {
+	}
+}
+
+#endif /* CONFIG_UART_EMUL */
+
+#ifdef CONFIG_DUT_EMUL
+
+#include "analog.h"
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/adc/adc_emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Off-target model of the DUT and of the board analog front end, so the test
+ * sequence runs on native_sim against the emulated ADC and GPIO. The 3.45V
+ * buck is always in regulation; the 3.6V rail and the DUT current follow the
+ * AP22 enable: a soft start ramp charging the DUT capacitors, the DUT running
+ * after boot, then asleep. The current reads through whichever range the
+ * shunt pins select, with the active calibration inverted.
+ */
+
+#define DUT_EMUL_3V45_MV            3450
+#define DUT_EMUL_3V6_MV             3600
+#define DUT_EMUL_RISE_US            800         /* AP22 soft start */
+#define DUT_EMUL_INRUSH_UA          150000      /* DUT capacitors charging during the rise */
+#define DUT_EMUL_ACTIVE_UA          8000
+#define DUT_EMUL_ACTIVE_MS          500         /* DUT awake after power up, then asleep */
+#define DUT_EMUL_SLEEP_UA           120
+
+/* Rails reach the ADC through a 1/2 divider */
+#define DUT_EMUL_RAIL_DIVIDER       2
+/* Input range of the channels: 600mV reference, 1/6 gain */
+#define DUT_EMUL_FULL_SCALE_MV      3600
+#define DUT_EMUL_RESOLUTION         12
+
+#define ZEPHYR_USER DT_PATH(zephyr_user)
+#define DUT_EMUL_UART_LOOPBACK DT_NODE_HAS_COMPAT(DT_NODELABEL(uart1), zephyr_uart_emul)
+
+static const struct device *const m_adc = DEVICE_DT_GET(DT_IO_CHANNELS_CTLR_BY_IDX(ZEPHYR_USER, 0));
+static const struct gpio_dt_spec m_en = GPIO_DT_SPEC_GET(DT_NODELABEL(ap22_en_pin), gpios);
+static const struct gpio_dt_spec m_bypass = GPIO_DT_SPEC_GET(DT_NODELABEL(shunt_bypass_pin), gpios);
+
+static bool m_powered;
+static int64_t m_power_on_us;
+
+/* Time the DUT has been powered, -1 while the AP22 is off. Only ever called from the ADC emulator thread */
+static int64_t dut_emul_on_us(void)
+{
+	int64_t now = k_ticks_to_us_floor64(k_uptime_ticks());
+
+	if (gpio_emul_output_get(m_en.port, m_en.pin) != 1) {
+		m_powered = false;
+		return -1;
+	}
+	if (!m_powered) {
+		m_powered = true;
+		m_power_on_us = now;
+	}
+
+	return now - m_power_on_us;
+}
+
+static int dut_emul_rail_3v6(const struct device *dev, unsigned int chan, void *data, uint32_t *result)
+{
+	int64_t on_us = dut_emul_on_us();
+	int64_t mv = 0;
+
+	if (on_us >= 0) {
+		mv = (DUT_EMUL_3V6_MV * MIN(on_us, DUT_EMUL_RISE_US)) / DUT_EMUL_RISE_US;
+	}
+	*result = mv / DUT_EMUL_RAIL_DIVIDER;
+
+	return 0;
+}
+
+static int dut_emul_current(const struct device *dev, unsigned int chan, void *data, uint32_t *result)
+{
+	int64_t on_us = dut_emul_on_us();
+	enum adc_current_range range = (gpio_emul_output_get(m_bypass.port, m_bypass.pin) == 1) ?
+				       ADC_CURRENT_RANGE_MA : ADC_CURRENT_RANGE_UA;
+	const struct adc_cal *cal = adc_cal_get_current(range);
+	int64_t ua = 0;
+	int64_t raw;
+
+	if (on_us >= 0) {
+		if (on_us < DUT_EMUL_RISE_US) {
+			ua = DUT_EMUL_INRUSH_UA;
+		} else if (on_us < DUT_EMUL_ACTIVE_MS * USEC_PER_MSEC) {
+			ua = DUT_EMUL_ACTIVE_UA;
+		} else {
+			ua = DUT_EMUL_SLEEP_UA;
+		}
+	}
+
+	// Counts the calibration turns back into this current, clipped like the SAADC
+	raw = ((ua - cal->offset) << ADC_CAL_Q) / cal->gain_q16;
+	raw = CLAMP(raw, 0, BIT(DUT_EMUL_RESOLUTION) - 1);
+	*result = (raw * DUT_EMUL_FULL_SCALE_MV) >> DUT_EMUL_RESOLUTION;
+
+	return 0;
+}
+
+static int dut_emul_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(m_adc)) {
+		return -ENODEV;
+	}
+
+	ret = adc_emul_const_value_set(m_adc, DT_IO_CHANNELS_INPUT_BY_IDX(ZEPHYR_USER, ADC_3v45_CHN),
+				       DUT_EMUL_3V45_MV / DUT_EMUL_RAIL_DIVIDER);
+	if (ret == 0) {
+		ret = adc_emul_value_func_set(m_adc, DT_IO_CHANNELS_INPUT_BY_IDX(ZEPHYR_USER, ADC_3v6_CHN),
+					      dut_emul_rail_3v6, NULL);
+	}
+	if (ret == 0) {
+		ret = adc_emul_value_func_set(m_adc, DT_IO_CHANNELS_INPUT_BY_IDX(ZEPHYR_USER, ADC_CURRENT_CHN),
+					      dut_emul_current, NULL);
+	}
+
+#if DUT_EMUL_UART_LOOPBACK
+	uart_emul_callback_tx_data_ready_set(DEVICE_DT_GET(DT_NODELABEL(uart1)), dut_emul_uart_drain, NULL);
+#endif
+
+	return ret;
+}
+
+SYS_INIT(dut_emul_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* CONFIG_DUT_EMUL */
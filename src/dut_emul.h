@@ -0,0 +1,10 @@
+#ifndef DUT_EMUL_H
+#define DUT_EMUL_H
+
+#include <zephyr/device.h>
+#include <stddef.h>
+
+/* TX data ready callback of a looped back uart_emul, see uart_emul_callback_tx_data_ready_set() */
+void dut_emul_uart_drain(const struct device *dev, size_t size, void *user_data);
+
+#endif /* DUT_EMUL_H */
@@ -0,0 +1,597 @@
+#include "dut_flash.h"
+#include "rs232_bench.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(dut_flash, LOG_LEVEL_INF);
+
+#define DUT_FLASH_STACK_SIZE	1536
+#define DUT_FLASH_PRIORITY	5
+
+/* Write payload: offset then data */
+#define DUT_FLASH_WRITE_SIZE	(4 + DUT_FLASH_BLOCK_SIZE)
+/* Largest frame sent is a write, answers are much shorter */
+#define DUT_FLASH_FRAME_SIZE	(DUT_BL_HEADER_SIZE + DUT_FLASH_WRITE_SIZE + DUT_BL_CRC_SIZE)
+#define DUT_FLASH_MAX_ANSWER	16
+
+K_PIPE_DEFINE(dut_flash_pipe, DUT_FLASH_BUFFER_SIZE, 4);
+static K_SEM_DEFINE(dut_flash_start_sem, 0, 1);
+static atomic_t m_running;
+/* Raised by dut_flash_abort(), every wait of the thread polls it too */
+static struct k_poll_signal m_abort = K_POLL_SIGNAL_INITIALIZER(m_abort);
+
+static const struct dut_flash_config *m_cfg;
+/* Updated by the thread, copied by the host at any time */
+static struct dut_flash_status m_status;
+static struct k_spinlock m_status_lock;
+static uint32_t m_crc32;		/* of the image, as given by the host */
+static uint32_t m_max_baud;
+static uint16_t m_seq;
+static uint8_t m_frame[DUT_FLASH_FRAME_SIZE];
+
+struct dut_flash_block {
+	uint8_t payload[DUT_FLASH_WRITE_SIZE];
+	uint16_t len;
+	uint16_t seq;			/* of the last transmission */
+};
+
+/* Blocks from the oldest unanswered one on, kept until their ACK to be sent again */
+static struct dut_flash_block m_blocks[DUT_FLASH_WINDOW];
+
+/* Answer being assembled from the RX ring */
+static uint8_t m_rx[DUT_BL_HEADER_SIZE + DUT_FLASH_MAX_ANSWER + DUT_BL_CRC_SIZE];
+static size_t m_rx_len;
+
+struct dut_flash_answer {
+	uint8_t cmd;
+	uint16_t seq;
+	uint16_t len;
+	uint8_t payload[DUT_FLASH_MAX_ANSWER];
+};
+
+static bool dut_flash_aborted(void)
+{
+	unsigned int signaled;
+	int result;
+
+	k_poll_signal_check(&m_abort, &signaled, &result);
+
+	return signaled != 0;
+}
+
+static void dut_flash_set_state(enum dut_flash_state state)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+	m_status.state = state;
+	k_spin_unlock(&m_status_lock, key);
+}
+
+/* Queues a whole frame, returns its seq */
+static uint16_t dut_flash_send(uint8_t cmd, const uint8_t *payload, uint16_t len)
+{
+	size_t frame_len = DUT_BL_HEADER_SIZE + len + DUT_BL_CRC_SIZE;
+	uint16_t seq = m_seq++;
+	uint16_t crc;
+
+	m_frame[0] = DUT_BL_SYNC;
+	m_frame[1] = cmd;
+	sys_put_le16(seq, &m_frame[2]);
+	sys_put_le16(len, &m_frame[4]);
+	if (len) {
+		memcpy(&m_frame[DUT_BL_HEADER_SIZE], payload, len);
+	}
+	crc = crc16_ccitt(0xFFFF, &m_frame[1], DUT_BL_HEADER_SIZE - 1 + len);
+	sys_put_le16(crc, &m_frame[DUT_BL_HEADER_SIZE + len]);
+
+	// The TX ring drains at the line rate, the window keeps it from filling up for long
+	while (!uart_port_write_all(m_cfg->port, m_frame, frame_len)) {
+		k_sleep(K_MSEC(1));
+	}
+
+	return seq;
+}
+
+/* Takes bytes from the RX ring until an answer is complete, false if the ring runs dry first */
+static bool dut_flash_parse(struct dut_flash_answer *ans)
+{
+	uint8_t byte;
+
+	while (uart_port_read(m_cfg->port, &byte, 1) == 1) {
+		uint16_t len;
+
+		if ((m_rx_len == 0) && (byte != DUT_BL_SYNC)) {
+			continue;
+		}
+		m_rx[m_rx_len++] = byte;
+		if (m_rx_len < DUT_BL_HEADER_SIZE) {
+			continue;
+		}
+
+		len = sys_get_le16(&m_rx[4]);
+		if (len > DUT_FLASH_MAX_ANSWER) {
+			// Not an answer, resynchronize on the next sync byte
+			m_rx_len = 0;
+			continue;
+		}
+		if (m_rx_len < (DUT_BL_HEADER_SIZE + len + DUT_BL_CRC_SIZE)) {
+			continue;
+		}
+		m_rx_len = 0;
+
+		if (sys_get_le16(&m_rx[DUT_BL_HEADER_SIZE + len]) !=
+		    crc16_ccitt(0xFFFF, &m_rx[1], DUT_BL_HEADER_SIZE - 1 + len)) {
+			k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+			m_status.crc_errors++;
+			k_spin_unlock(&m_status_lock, key);
+			continue;
+		}
+
+		ans->cmd = m_rx[1];
+		ans->seq = sys_get_le16(&m_rx[2]);
+		ans->len = len;
+		memcpy(ans->payload, &m_rx[DUT_BL_HEADER_SIZE], len);
+		return true;
+	}
+
+	return false;
+}
+
+/* Waits for the next answer until the deadline, in uptime ms */
+static int dut_flash_receive(struct dut_flash_answer *ans, int64_t end)
+{
+	while (!dut_flash_parse(ans)) {
+		struct k_poll_event events[] = {
+			K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &m_abort),
+			K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SEM_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+						 &m_cfg->port->rx_sem),
+		};
+		int64_t left = end - k_uptime_get();
+
+		if (dut_flash_aborted()) {
+			return -ECANCELED;
+		}
+		if (left <= 0) {
+			return -ETIMEDOUT;
+		}
+		(void)k_poll(events, ARRAY_SIZE(events), K_MSEC(left));
+		(void)k_sem_take(&m_cfg->port->rx_sem, K_NO_WAIT);
+	}
+
+	return 0;
+}
+
+/* Starts from an empty line, after a power up or a baud rate change */
+static void dut_flash_rx_reset(void)
+{
+	// Emptied from the reading side, the ISR may be filling the ring meanwhile
+	(void)uart_port_rx_discard(m_cfg->port);
+	m_rx_len = 0;
+	(void)uart_err_check(m_cfg->port->dev);
+}
+
+/*!
+* @brief Sends a command and waits for its answer, sending it again on a timeout
+*
+* @return 0 if the command was ACKed, the answer is in ans
+* @return -EIO if it was NAKed
+* @return -ETIMEDOUT if it was not answered
+* @return -ECANCELED if the flashing was aborted
+*/
+static int dut_flash_transact(uint8_t cmd, const uint8_t *payload, uint16_t len, uint32_t timeout_ms,
+			      struct dut_flash_answer *ans)
+{
+	int ret = -ETIMEDOUT;
+
+	for (int attempt = 0; attempt <= DUT_FLASH_MAX_RETRIES; attempt++) {
+		uint16_t seq = dut_flash_send(cmd, payload, len);
+		int64_t end = k_uptime_get() + timeout_ms;
+
+		while ((ret = dut_flash_receive(ans, end)) == 0) {
+			if ((ans->cmd == (cmd | DUT_BL_ANSWER)) && (ans->seq == seq) && (ans->len >= 1)) {
+				return (ans->payload[0] == 0) ? 0 : -EIO;
+			}
+		}
+		if (ret == -ECANCELED) {
+			return ret;
+		}
+	}
+
+	return ret;
+}
+
+/* Powers the DUT into its bootloader and pings it until it answers */
+static int dut_flash_sync(uint32_t *dut_max_baud)
+{
+	struct dut_flash_answer ans;
+	int64_t end;
+	int ret;
+
+	(void)m_cfg->power(false);
+	k_msleep(DUT_FLASH_POWER_OFF_MS);
+	dut_flash_rx_reset();
+
+	ret = m_cfg->power(true);
+	if (ret != 0) {
+		return ret;
+	}
+
+	end = k_uptime_get() + DUT_FLASH_SYNC_MS;
+	do {
+		ret = dut_flash_transact(DUT_BL_CMD_PING, NULL, 0, DUT_FLASH_ANSWER_MS, &ans);
+		if ((ret == 0) && (ans.len >= 6)) {
+			*dut_max_baud = sys_get_le32(&ans.payload[2]);
+			LOG_INF("Bootloader version %u, up to %u baud", ans.payload[1], *dut_max_baud);
+			return 0;
+		}
+	} while ((ret != -ECANCELED) && (k_uptime_get() < end));
+
+	return (ret == -ECANCELED) ? ret : -ETIMEDOUT;
+}
+
+/* Raises the line to the fastest rate both ends take, from the top down; stays put if none works */
+static void dut_flash_raise_baud(const struct uart_config *orig, uint32_t dut_max_baud)
+{
+	static const uint32_t bauds[] = { RS232_BENCH_DEFAULT_BAUDS };
+	struct dut_flash_answer ans;
+	struct uart_config cfg = *orig;
+	uint8_t payload[4];
+
+	for (int i = ARRAY_SIZE(bauds) - 1; (i >= 0) && (bauds[i] > orig->baudrate); i--) {
+		if ((bauds[i] > dut_max_baud) || (m_max_baud && (bauds[i] > m_max_baud))) {
+			continue;
+		}
+
+		sys_put_le32(bauds[i], payload);
+		if (dut_flash_transact(DUT_BL_CMD_BAUD, payload, sizeof(payload), DUT_FLASH_ANSWER_MS, &ans) != 0) {
+			continue;
+		}
+
+		// ACKed at the old rate, the next frame goes at the new one
+		cfg.baudrate = bauds[i];
+		if ((uart_configure(m_cfg->port->dev, &cfg) == 0) &&
+		    (dut_flash_transact(DUT_BL_CMD_PING, NULL, 0, DUT_FLASH_ANSWER_MS, &ans) == 0)) {
+			k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+			m_status.baudrate = bauds[i];
+			k_spin_unlock(&m_status_lock, key);
+			return;
+		}
+
+		// The bootloader falls back on its own after the grace time
+		(void)uart_configure(m_cfg->port->dev, orig);
+		k_msleep(DUT_FLASH_BAUD_GRACE_MS);
+		dut_flash_rx_reset();
+	}
+}
+
+/* True if seq is the last transmission of a block of the current round, not an older one */
+static bool dut_flash_in_round(uint16_t seq, uint32_t base, uint32_t next)
+{
+	for (uint32_t b = base; b < next; b++) {
+		if (m_blocks[b % DUT_FLASH_WINDOW].seq == seq) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Takes the next len image bytes from the host, waiting for them up to DUT_FLASH_HOST_MS */
+static int dut_flash_get_image(uint8_t *data, size_t len)
+{
+	int64_t end = k_uptime_get() + DUT_FLASH_HOST_MS;
+	size_t got = 0;
+
+	while (1) {
+		// Not blocked in k_pipe_get(), an abort would only be seen once the host timeout ran out
+		struct k_poll_event events[] = {
+			K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY, &m_abort),
+			K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_PIPE_DATA_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY,
+						 &dut_flash_pipe),
+		};
+		size_t n = 0;
+		int64_t left;
+
+		(void)k_pipe_get(&dut_flash_pipe, &data[got], len - got, &n, 0, K_NO_WAIT);
+		got += n;
+		if (got == len) {
+			return 0;
+		}
+
+		left = end - k_uptime_get();
+		if (dut_flash_aborted()) {
+			return -ECANCELED;
+		}
+		if (left <= 0) {
+			return -ETIMEDOUT;
+		}
+		(void)k_poll(events, ARRAY_SIZE(events), K_MSEC(left));
+	}
+}
+
+/*
+ * Go-back-N: up to DUT_FLASH_WINDOW blocks wait for their answer. The ACK of
+ * the oldest one moves the window; a NAK from the current round or no answer
+ * in time sends everything again from the oldest one on.
+ */
+static int dut_flash_write_image(uint32_t *crc)
+{
+	struct dut_flash_answer ans;
+	uint32_t blocks = DIV_ROUND_UP(m_status.size, DUT_FLASH_BLOCK_SIZE);
+	uint32_t base = 0;		/* oldest block without an ACK */
+	uint32_t next = 0;		/* next block to send */
+	uint32_t filled = 0;		/* blocks taken from the host */
+	uint32_t retries = 0;
+	int ret;
+
+	*crc = 0;
+	while (base < blocks) {
+		while ((next < blocks) && ((next - base) < DUT_FLASH_WINDOW)) {
+			uint32_t offset = next * DUT_FLASH_BLOCK_SIZE;
+			size_t len = MIN(DUT_FLASH_BLOCK_SIZE, m_status.size - offset);
+			struct dut_flash_block *block = &m_blocks[next % DUT_FLASH_WINDOW];
+
+			if (next == filled) {
+				ret = dut_flash_get_image(&block->payload[4], len);
+				if (ret != 0) {
+					return ret;
+				}
+				sys_put_le32(offset, block->payload);
+				block->len = 4 + len;
+				*crc = crc32_ieee_update(*crc, &block->payload[4], len);
+				filled++;
+			}
+
+			block->seq = dut_flash_send(DUT_BL_CMD_WRITE, block->payload, block->len);
+			next++;
+		}
+
+		ret = dut_flash_receive(&ans, k_uptime_get() + DUT_FLASH_ANSWER_MS);
+		if (ret == -ECANCELED) {
+			return ret;
+		}
+		if (ret == 0) {
+			bool acked = (ans.len >= 1) && (ans.payload[0] == 0);
+
+			if ((ans.cmd != (DUT_BL_CMD_WRITE | DUT_BL_ANSWER)) || !dut_flash_in_round(ans.seq, base, next)) {
+				continue;
+			}
+			if (acked && (ans.seq == m_blocks[base % DUT_FLASH_WINDOW].seq)) {
+				k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+				m_status.acked += m_blocks[base % DUT_FLASH_WINDOW].len - 4;
+				k_spin_unlock(&m_status_lock, key);
+				base++;
+				retries = 0;
+				continue;
+			}
+			if (acked) {
+				// Answers come in order, an ACK past the oldest block means its own got lost
+				continue;
+			}
+		}
+
+		if (++retries > DUT_FLASH_MAX_RETRIES) {
+			return (ret == 0) ? -EIO : -ETIMEDOUT;
+		}
+		k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+		m_status.retransmits += next - base;
+		k_spin_unlock(&m_status_lock, key);
+		next = base;
+	}
+
+	return 0;
+}
+
+static int dut_flash_run(void)
+{
+	struct dut_flash_answer ans;
+	struct uart_config orig;
+	uint32_t dut_max_baud = 0;
+	uint8_t payload[8];
+	uint32_t crc;
+	int ret;
+
+	if (uart_config_get(m_cfg->port->dev, &orig) != 0) {
+		return -ENOTSUP;
+	}
+	k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+	m_status.baudrate = orig.baudrate;
+	k_spin_unlock(&m_status_lock, key);
+
+	ret = dut_flash_sync(&dut_max_baud);
+	if (ret == 0) {
+		dut_flash_raise_baud(&orig, dut_max_baud);
+
+		dut_flash_set_state(DUT_FLASH_ERASING);
+		sys_put_le32(m_status.size, payload);
+		ret = dut_flash_transact(DUT_BL_CMD_ERASE, payload, 4, DUT_FLASH_ERASE_MS, &ans);
+	}
+
+	if (ret == 0) {
+		dut_flash_set_state(DUT_FLASH_WRITING);
+		ret = dut_flash_write_image(&crc);
+	}
+
+	if (ret == 0) {
+		dut_flash_set_state(DUT_FLASH_VERIFYING);
+		// A mismatch here is the host link, the DUT got what the fixture was given
+		if (crc != m_crc32) {
+			ret = -EBADMSG;
+		} else {
+			sys_put_le32(m_status.size, &payload[0]);
+			sys_put_le32(crc, &payload[4]);
+			ret = dut_flash_transact(DUT_BL_CMD_VERIFY, payload, 8, DUT_FLASH_ERASE_MS, &ans);
+			if (ret == -EIO) {
+				ret = -EBADMSG;
+			}
+		}
+	}
+
+	if (ret == 0) {
+		// The bootloader may jump before answering, the wait only lets the frame leave
+		(void)dut_flash_send(DUT_BL_CMD_RUN, NULL, 0);
+		(void)dut_flash_receive(&ans, k_uptime_get() + DUT_FLASH_ANSWER_MS);
+	}
+
+	(void)uart_configure(m_cfg->port->dev, &orig);
+
+	return ret;
+}
+
+static void dut_flash_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_spinlock_key_t key;
+		int64_t start;
+		int ret;
+
+		k_sem_take(&dut_flash_start_sem, K_FOREVER);
+
+		start = k_uptime_get();
+		ret = dut_flash_run();
+		if (ret != 0) {
+			(void)m_cfg->power(false);
+		}
+
+		key = k_spin_lock(&m_status_lock);
+		m_status.elapsed_ms = k_uptime_get() - start;
+		m_status.err = ret;
+		m_status.state = (ret != 0) ? DUT_FLASH_FAILED : DUT_FLASH_DONE;
+		k_spin_unlock(&m_status_lock, key);
+
+		if (ret != 0) {
+			LOG_ERR("DUT flashing failed (%d) after %u of %u bytes", ret, m_status.acked, m_status.size);
+		} else {
+			LOG_INF("DUT flashed: %u bytes at %u baud in %u ms, %u blocks sent again", m_status.size,
+				m_status.baudrate, m_status.elapsed_ms, m_status.retransmits);
+		}
+
+		// Whatever the host sent past the end or after a failure
+		k_pipe_flush(&dut_flash_pipe);
+		uart_port_release(m_cfg->port);
+		atomic_clear(&m_running);
+	}
+}
+
+K_THREAD_DEFINE(dut_flash_tid, DUT_FLASH_STACK_SIZE, dut_flash_thread,
+		NULL, NULL, NULL, DUT_FLASH_PRIORITY, 0, 0);
+
+/*!
+* @brief Starts programming the DUT, the image is then given with dut_flash_write()
+*
+* The DUT is power cycled into its bootloader. The DUT UART is left at its
+* original rate at the end, the DUT powered and running the new image if it
+* went well, off otherwise.
+*
+* @param config DUT port and supply, must stay valid
+* @param size Image size in bytes
+* @param crc32 CRC-32/IEEE of the image, checked before the DUT is asked to verify
+* @param max_baud Highest baud rate to use, 0 for whatever the DUT takes
+*
+* @return 0 if successful
+* @return -EINVAL if the image is empty
+* @return -EBUSY if the DUT is already being programmed or its port is in use
+*/
+int dut_flash_start(const struct dut_flash_config *config, uint32_t size, uint32_t crc32, uint32_t max_baud)
+{
+	if (size == 0) {
+		return -EINVAL;
+	}
+	if (!atomic_cas(&m_running, 0, 1)) {
+		return -EBUSY;
+	}
+	if (uart_port_claim(config->port) != 0) {
+		atomic_clear(&m_running);
+		return -EBUSY;
+	}
+
+	m_cfg = config;
+	m_crc32 = crc32;
+	m_max_baud = max_baud;
+	k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+	m_status = (struct dut_flash_status){ .state = DUT_FLASH_SYNCING, .size = size };
+	k_spin_unlock(&m_status_lock, key);
+	k_poll_signal_reset(&m_abort);
+	k_pipe_flush(&dut_flash_pipe);
+
+	k_sem_give(&dut_flash_start_sem);
+
+	return 0;
+}
+
+/*!
+* @brief Queues the next part of the image, all of it or nothing
+*
+* With K_NO_WAIT nothing is queued when the buffer is full and the same data
+* can be given again later. A write that times out part way leaves a gap in
+* the image, the programming is aborted.
+*
+* @param data Image bytes, following the previous ones
+* @param len Number of bytes
+* @param timeout Time to wait for room in the buffer
+*
+* @return 0 if successful
+* @return -ECANCELED if no programming is running
+* @return -EAGAIN if there was no room, nothing was queued
+* @return -EIO if only part of the data was queued
+*/
+int dut_flash_write(const uint8_t *data, size_t len, k_timeout_t timeout)
+{
+	size_t written = 0;
+
+	if (!atomic_get(&m_running)) {
+		return -ECANCELED;
+	}
+	if (len == 0) {
+		return 0;
+	}
+
+	if (k_pipe_put(&dut_flash_pipe, (void *)data, len, &written, len, timeout) != 0) {
+		if (written != 0) {
+			dut_flash_abort();
+			return -EIO;
+		}
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Stops a programming in progress, it ends as failed with -ECANCELED
+*
+* Wakes the thread up from whatever it waits for, the host data or an answer.
+*/
+void dut_flash_abort(void)
+{
+	k_poll_signal_raise(&m_abort, -ECANCELED);
+}
+
+bool dut_flash_is_running(void)
+{
+	return atomic_get(&m_running) != 0;
+}
+
+void dut_flash_get_status(struct dut_flash_status *status)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_status_lock);
+
+	*status = m_status;
+	k_spin_unlock(&m_status_lock, key);
+}
@@ -0,0 +1,88 @@
+#ifndef DUT_FLASH_H
+#define DUT_FLASH_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "uart_port.h"
+
+/*
+ * DUT programming through its serial bootloader on the DUT UART. The host
+ * streams the image with dut_flash_write() while a thread forwards it in
+ * blocks, up to DUT_FLASH_WINDOW of them waiting for their answer. A NAK or
+ * a missing answer sends the blocks again from the oldest unanswered one on
+ * (go-back-N). Before the transfer the line is raised to the fastest rate
+ * both ends take.
+ *
+ * Bootloader frame, both ways:
+ *   sync | cmd (1) | seq (2, LE) | length (2, LE) | payload (length) | crc (2, LE)
+ * The CRC-16/CCITT (init 0xFFFF) covers cmd to payload. Answers carry
+ * cmd | DUT_BL_ANSWER and the seq of the frame, their payload starts with a
+ * status byte, 0 for an ACK. Writes are answered in order; the bootloader
+ * NAKs a block past the next expected offset and ACKs again one it already
+ * wrote. After an ACKed baud rate change it goes back to the old rate if no
+ * valid frame comes within DUT_FLASH_BAUD_GRACE_MS. tests/src/dut_bl_emul.c
+ * models that side for the ztests.
+ */
+#define DUT_BL_SYNC                 0x5A
+#define DUT_BL_HEADER_SIZE          6
+#define DUT_BL_CRC_SIZE             2
+#define DUT_BL_ANSWER               0x80
+
+#define DUT_BL_CMD_PING             0x01    /* -> status, version (1), max baud rate (4) */
+#define DUT_BL_CMD_BAUD             0x02    /* baud rate (4) */
+#define DUT_BL_CMD_ERASE            0x03    /* image size (4) */
+#define DUT_BL_CMD_WRITE            0x04    /* offset (4), data */
+#define DUT_BL_CMD_VERIFY           0x05    /* image size (4), CRC-32/IEEE of the image (4) */
+#define DUT_BL_CMD_RUN              0x06    /* leaves the bootloader */
+
+/* Image bytes per write, blocks waiting for their answer */
+#define DUT_FLASH_BLOCK_SIZE        256
+#define DUT_FLASH_WINDOW            8
+/* Image bytes buffered between the host and the DUT */
+#define DUT_FLASH_BUFFER_SIZE       4096
+
+#define DUT_FLASH_POWER_OFF_MS      100     /* DUT off before it is powered into the bootloader */
+#define DUT_FLASH_SYNC_MS           2000    /* time given to the bootloader to answer a ping */
+#define DUT_FLASH_ANSWER_MS         100     /* per frame, the erase excepted */
+#define DUT_FLASH_ERASE_MS          10000
+#define DUT_FLASH_BAUD_GRACE_MS     100
+#define DUT_FLASH_HOST_MS           5000    /* image data not coming from the host */
+#define DUT_FLASH_MAX_RETRIES       5       /* times in a row the same block is sent again */
+
+enum dut_flash_state {
+	DUT_FLASH_IDLE,
+	DUT_FLASH_SYNCING,		/* powering the DUT up, pinging the bootloader, raising the baud rate */
+	DUT_FLASH_ERASING,
+	DUT_FLASH_WRITING,
+	DUT_FLASH_VERIFYING,
+	DUT_FLASH_DONE,
+	DUT_FLASH_FAILED,
+};
+
+struct dut_flash_config {
+	struct uart_port *port;			/* DUT UART, claimed for the whole programming */
+	int (*power)(bool on);			/* DUT supply, the bootloader starts at power up */
+};
+
+/* Sent to the host as is */
+struct dut_flash_status {
+	uint8_t state;				/* enum dut_flash_state */
+	int32_t err;				/* negative errno once failed */
+	uint32_t baudrate;			/* rate the image is sent at */
+	uint32_t size;
+	uint32_t acked;				/* bytes written by the bootloader */
+	uint32_t retransmits;			/* blocks sent again */
+	uint32_t crc_errors;			/* answers received with a bad CRC */
+	uint32_t elapsed_ms;
+} __packed;
+
+int dut_flash_start(const struct dut_flash_config *config, uint32_t size, uint32_t crc32, uint32_t max_baud);
+int dut_flash_write(const uint8_t *data, size_t len, k_timeout_t timeout);
+void dut_flash_abort(void);
+bool dut_flash_is_running(void);
+void dut_flash_get_status(struct dut_flash_status *status);
+
+#endif /* DUT_FLASH_H */
@@ -0,0 +1,570 @@
+#include "host_proto.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(host_proto, LOG_LEVEL_INF);
+
+#include "analog.h"
+#include "adc_stream.h"
+#include "bridge.h"
+#include "rs232_bench.h"
+#include "result_log.h"
+#include "phase_timing.h"
+#include "msc_export.h"
+
+#define HOST_PROTO_STACK_SIZE	2048
+#define HOST_PROTO_PRIORITY	6
+#define HOST_PROTO_FRAME_SIZE	(HOST_PROTO_HEADER_SIZE + HOST_PROTO_MAX_PAYLOAD + HOST_PROTO_CRC_SIZE)
+
+/* Poll period while ADC blocks are streamed */
+#define HOST_PROTO_STREAM_POLL_MS	2
+
+/* Result records per HOST_EVT_RESULTS frame, and how long a full TX ring is waited for */
+#define HOST_PROTO_RESULTS_PER_FRAME	((HOST_PROTO_MAX_PAYLOAD - 1) / sizeof(struct result_record))
+#define HOST_PROTO_TX_WAIT_MS		500
+/* Phase statistics per HOST_EVT_TIMING frame */
+#define HOST_PROTO_TIMING_ENTRY_SIZE	(1 + sizeof(struct phase_stats))
+#define HOST_PROTO_TIMING_PER_FRAME	((HOST_PROTO_MAX_PAYLOAD - 1) / HOST_PROTO_TIMING_ENTRY_SIZE)
+/* Baud rates in one RS-232 benchmark sweep */
+#define HOST_PROTO_BENCH_MAX_RATES	16
+
+static const struct host_proto_config *m_cfg;
+static K_SEM_DEFINE(host_proto_start_sem, 0, 1);
+static K_MUTEX_DEFINE(host_proto_tx_lock);
+
+/* Frames are built and parsed in place, one buffer each way */
+static uint8_t m_rx_frame[HOST_PROTO_FRAME_SIZE];
+static uint8_t m_tx_frame[HOST_PROTO_FRAME_SIZE];
+static size_t m_rx_len;
+
+static uint8_t m_evt_seq;
+static bool m_streaming;
+
+/*!
+* @brief Sends a frame to the host
+*
+* The whole frame is queued or nothing is, it is never interleaved with
+* other output of the port.
+*
+* @return 0 if successful
+* @return -EMSGSIZE if the payload is too long
+* @return -ENOBUFS if there is no room for the frame in the TX ring
+*
+*/
+int host_proto_send(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len)
+{
+	size_t frame_len = HOST_PROTO_HEADER_SIZE + len + HOST_PROTO_CRC_SIZE;
+	uint16_t crc;
+	bool sent;
+
+	if (len > HOST_PROTO_MAX_PAYLOAD) {
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&host_proto_tx_lock, K_FOREVER);
+
+	m_tx_frame[0] = HOST_PROTO_SYNC_0;
+	m_tx_frame[1] = HOST_PROTO_SYNC_1;
+	sys_put_le16(len, &m_tx_frame[2]);
+	m_tx_frame[4] = type;
+	m_tx_frame[5] = seq;
+	if (len && (payload != &m_tx_frame[HOST_PROTO_HEADER_SIZE])) {
+		memcpy(&m_tx_frame[HOST_PROTO_HEADER_SIZE], payload, len);
+	}
+	crc = crc16_ccitt(0xFFFF, &m_tx_frame[2], HOST_PROTO_HEADER_SIZE - 2 + len);
+	sys_put_le16(crc, &m_tx_frame[HOST_PROTO_HEADER_SIZE + len]);
+
+	sent = uart_port_write_all(m_cfg->host, m_tx_frame, frame_len);
+
+	k_mutex_unlock(&host_proto_tx_lock);
+
+	return sent ? 0 : -ENOBUFS;
+}
+
+static void host_proto_respond(const uint8_t *cmd, int status, const uint8_t *data, uint16_t len)
+{
+	uint8_t payload[1 + sizeof(struct rs232_bench_result)];
+
+	payload[0] = (uint8_t)(status < 0 ? -status : status);
+	len = MIN(len, sizeof(payload) - 1);
+	if (len) {
+		memcpy(&payload[1], data, len);
+	}
+
+	(void)host_proto_send(cmd[4] | HOST_PROTO_RESPONSE, cmd[5], payload, 1 + len);
+}
+
+static void host_proto_send_adc_block(void)
+{
+	struct adc_stream_block *block;
+	uint8_t *payload = &m_tx_frame[HOST_PROTO_HEADER_SIZE];
+	uint16_t len;
+
+	while (adc_stream_get(&block, K_NO_WAIT) == 0) {
+		k_mutex_lock(&host_proto_tx_lock, K_FOREVER);
+		len = block->channels * block->samplings * sizeof(block->samples[0]);
+		sys_put_le32(block->seq, &payload[0]);
+		sys_put_le32(block->timestamp, &payload[4]);
+		sys_put_le16(block->channels, &payload[8]);
+		sys_put_le16(block->samplings, &payload[10]);
+		memcpy(&payload[12], block->samples, len);
+		adc_stream_release(block);
+
+		/* A block that does not fit is dropped, the host sees the gap in seq */
+		(void)host_proto_send(HOST_EVT_ADC_BLOCK, m_evt_seq++, payload, 12 + len);
+		k_mutex_unlock(&host_proto_tx_lock);
+	}
+}
+
+/* Result records are batched into the TX frame, which stays locked until the walk ends */
+struct host_proto_results {
+	uint8_t *payload;
+	uint32_t batched;
+	uint32_t sent;
+	uint32_t max;
+	int err;
+};
+
+/* Bulk data outruns the USB link, waits for the TX ring to drain */
+static int host_proto_send_event_wait(uint8_t type, const uint8_t *payload, uint16_t len)
+{
+	int64_t deadline = k_uptime_get() + HOST_PROTO_TX_WAIT_MS;
+	int err;
+
+	while ((err = host_proto_send(type, m_evt_seq, payload, len)) == -ENOBUFS) {
+		if (k_uptime_get() > deadline) {
+			break;
+		}
+		k_msleep(HOST_PROTO_STREAM_POLL_MS);
+	}
+	m_evt_seq++;
+
+	return err;
+}
+
+static void host_proto_flush_results(struct host_proto_results *ctx)
+{
+	int err;
+
+	if (ctx->batched == 0) {
+		return;
+	}
+
+	ctx->payload[0] = ctx->batched;
+	err = host_proto_send_event_wait(HOST_EVT_RESULTS, ctx->payload,
+					 1 + ctx->batched * sizeof(struct result_record));
+
+	if (err) {
+		ctx->err = err;
+	} else {
+		ctx->sent += ctx->batched;
+	}
+	ctx->batched = 0;
+}
+
+static bool host_proto_result_cb(const struct result_record *record, void *user_data)
+{
+	struct host_proto_results *ctx = user_data;
+
+	memcpy(&ctx->payload[1 + ctx->batched * sizeof(*record)], record, sizeof(*record));
+	ctx->batched++;
+
+	if (ctx->batched == HOST_PROTO_RESULTS_PER_FRAME) {
+		host_proto_flush_results(ctx);
+	}
+
+	return (ctx->err == 0) && ((ctx->max == 0) || ((ctx->sent + ctx->batched) < ctx->max));
+}
+
+/* Sends the statistics of every phase timed at least once, returns how many or a negative errno */
+static int host_proto_send_timing(bool reset)
+{
+	uint8_t *payload = &m_tx_frame[HOST_PROTO_HEADER_SIZE];
+	struct phase_stats stats;
+	uint32_t batched = 0;
+	int sent = 0;
+	int err = 0;
+
+	k_mutex_lock(&host_proto_tx_lock, K_FOREVER);
+	for (int id = 0; (id < PHASE_COUNT) && (err == 0); id++) {
+		if ((phase_timing_get(id, &stats) != 0) || (stats.count == 0)) {
+			continue;
+		}
+
+		/* Little-endian target, the stats struct is sent as is */
+		payload[1 + batched * HOST_PROTO_TIMING_ENTRY_SIZE] = id;
+		memcpy(&payload[2 + batched * HOST_PROTO_TIMING_ENTRY_SIZE], &stats, sizeof(stats));
+		batched++;
+
+		if (batched == HOST_PROTO_TIMING_PER_FRAME) {
+			payload[0] = batched;
+			err = host_proto_send_event_wait(HOST_EVT_TIMING, payload,
+							 1 + batched * HOST_PROTO_TIMING_ENTRY_SIZE);
+			sent += batched;
+			batched = 0;
+		}
+	}
+	if ((batched != 0) && (err == 0)) {
+		payload[0] = batched;
+		err = host_proto_send_event_wait(HOST_EVT_TIMING, payload,
+						 1 + batched * HOST_PROTO_TIMING_ENTRY_SIZE);
+		sent += batched;
+	}
+	k_mutex_unlock(&host_proto_tx_lock);
+
+	if (err) {
+		return err;
+	}
+	if (reset) {
+		phase_timing_reset();
+	}
+
+	return sent;
+}
+
+/*
+ * Runs the benchmark at every requested rate, one HOST_EVT_BENCH per rate.
+ * args: count, then count baud rates (4 each); a count of 0 sweeps the
+ * default rates. Returns the number of results sent or a negative errno.
+ */
+static int host_proto_bench_sweep(const struct rs232_bench_config *cfg, const uint8_t *args, uint16_t len)
+{
+	static struct rs232_bench_result res[HOST_PROTO_BENCH_MAX_RATES];
+	uint32_t bauds[HOST_PROTO_BENCH_MAX_RATES];
+	size_t count = args[0];
+	int ret;
+
+	if ((count > HOST_PROTO_BENCH_MAX_RATES) || (len < (1 + count * 4))) {
+		return -EINVAL;
+	}
+	for (size_t i = 0; i < count; i++) {
+		bauds[i] = sys_get_le32(&args[1 + i * 4]);
+	}
+
+	ret = rs232_bench_sweep(m_cfg->dut, cfg, (count == 0) ? NULL : bauds,
+				(count == 0) ? HOST_PROTO_BENCH_MAX_RATES : count, res);
+	for (int i = 0; i < ret; i++) {
+		/* Little-endian target, the result struct is sent as is */
+		int err = host_proto_send_event_wait(HOST_EVT_BENCH, (const uint8_t *)&res[i], sizeof(res[i]));
+
+		if (err) {
+			return err;
+		}
+	}
+
+	return ret;
+}
+
+static void host_proto_handle(const uint8_t *frame, uint16_t len)
+{
+	const uint8_t *payload = &frame[HOST_PROTO_HEADER_SIZE];
+	uint8_t data[4 + 1 + ADC_SCAN_MAX_CHN * 4];
+	int status = 0;
+
+	switch (frame[4]) {
+	case HOST_CMD_PING:
+		data[0] = HOST_PROTO_VERSION;
+		host_proto_respond(frame, 0, data, 1);
+		break;
+
+	case HOST_CMD_RUN_TEST: {
+		uint32_t duration_ms = 0;
+
+		if (len < 1) {
+			host_proto_respond(frame, EINVAL, NULL, 0);
+			break;
+		}
+		/* The programming power cycles the DUT and owns its UART */
+		if (dut_flash_is_running()) {
+			host_proto_respond(frame, EBUSY, NULL, 0);
+			break;
+		}
+		status = m_cfg->run_test(payload[0], &duration_ms);
+		if (status < 0) {
+			host_proto_respond(frame, status, NULL, 0);
+			break;
+		}
+		data[0] = status;
+		sys_put_le32(duration_ms, &data[1]);
+		host_proto_respond(frame, 0, data, 5);
+		break;
+	}
+
+	case HOST_CMD_READ_RAILS: {
+		struct adc_scan_result scan;
+
+		if (adc_scan_chn(m_cfg->adc_specs, m_cfg->adc_count, &scan) != 0) {
+			host_proto_respond(frame, EIO, NULL, 0);
+			break;
+		}
+		sys_put_le32(scan.timestamp, &data[0]);
+		data[4] = m_cfg->adc_count;
+		for (size_t i = 0; i < m_cfg->adc_count; i++) {
+			sys_put_le32(scan.value[i], &data[5 + i * 4]);
+		}
+		host_proto_respond(frame, 0, data, 5 + m_cfg->adc_count * 4);
+		break;
+	}
+
+	case HOST_CMD_SET_GPIO:
+		if (len < 2) {
+			status = -EINVAL;
+		} else {
+			status = m_cfg->set_gpio(payload[0], payload[1]);
+		}
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_ADC_STREAM:
+		if (len < 5) {
+			status = -EINVAL;
+		} else if (payload[0]) {
+			status = adc_stream_start(m_cfg->adc_specs, m_cfg->adc_count,
+						  sys_get_le32(&payload[1])) == 0 ? 0 : -EBUSY;
+			m_streaming = (status == 0);
+		} else {
+			struct adc_stream_stats stats;
+
+			adc_stream_stop();
+			m_streaming = false;
+			/* Little-endian target, the stats struct is sent as is */
+			adc_stream_get_stats(&stats);
+			host_proto_respond(frame, 0, (const uint8_t *)&stats, sizeof(stats));
+			break;
+		}
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_LOAD_CAL:
+		status = adc_cal_load(payload, len) == 0 ? 0 : -EINVAL;
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_RS232_BENCH: {
+		struct rs232_bench_config cfg;
+		struct rs232_bench_result res = {0};
+
+		if (len < 5) {
+			host_proto_respond(frame, EINVAL, NULL, 0);
+			break;
+		}
+		if (uart_port_claim(m_cfg->dut) != 0) {
+			host_proto_respond(frame, EBUSY, NULL, 0);
+			break;
+		}
+		cfg.duration_ms = sys_get_le32(&payload[0]);
+		cfg.window = payload[4];
+		cfg.seed = k_cycle_get_32() | 1;
+		if (len > 5) {
+			status = host_proto_bench_sweep(&cfg, &payload[5], len - 5);
+			uart_port_release(m_cfg->dut);
+			if (status < 0) {
+				host_proto_respond(frame, status, NULL, 0);
+				break;
+			}
+			data[0] = status;
+			host_proto_respond(frame, 0, data, 1);
+			break;
+		}
+		status = rs232_bench_run(m_cfg->dut, &cfg, &res);
+		uart_port_release(m_cfg->dut);
+		if (status < 0) {
+			host_proto_respond(frame, status, NULL, 0);
+			break;
+		}
+		/* Little-endian target, the result struct is sent as is */
+		host_proto_respond(frame, 0, (const uint8_t *)&res, sizeof(res));
+		break;
+	}
+
+	case HOST_CMD_BRIDGE:
+		status = bridge_start(m_cfg->host, m_cfg->dut);
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_BRIDGE_STATS: {
+		struct bridge_stats stats;
+
+		/* Little-endian target, the stats struct is sent as is */
+		bridge_get_stats(&stats);
+		host_proto_respond(frame, 0, (const uint8_t *)&stats, sizeof(stats));
+		break;
+	}
+
+	case HOST_CMD_GET_RESULTS: {
+		struct host_proto_results ctx = {0};
+
+		if (len < 6) {
+			host_proto_respond(frame, EINVAL, NULL, 0);
+			break;
+		}
+		ctx.max = sys_get_le16(&payload[4]);
+
+		k_mutex_lock(&host_proto_tx_lock, K_FOREVER);
+		ctx.payload = &m_tx_frame[HOST_PROTO_HEADER_SIZE];
+		status = result_log_read(sys_get_le32(&payload[0]), host_proto_result_cb, &ctx);
+		host_proto_flush_results(&ctx);
+		k_mutex_unlock(&host_proto_tx_lock);
+
+		if (status >= 0) {
+			status = ctx.err;
+		}
+		sys_put_le32(ctx.sent, &data[0]);
+		sys_put_le32(result_log_next_seq(), &data[4]);
+		host_proto_respond(frame, status, data, 8);
+		break;
+	}
+
+	case HOST_CMD_SET_UNIT_ID:
+		if (len < 8) {
+			status = -EINVAL;
+		} else {
+			result_log_set_unit_id(sys_get_le64(payload));
+		}
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_GET_TIMING:
+		status = host_proto_send_timing((len >= 1) && payload[0]);
+		if (status < 0) {
+			host_proto_respond(frame, status, NULL, 0);
+			break;
+		}
+		data[0] = status;
+		host_proto_respond(frame, 0, data, 1);
+		break;
+
+	case HOST_CMD_EXPORT:
+		status = msc_export_write();
+		if (status < 0) {
+			host_proto_respond(frame, status, NULL, 0);
+			break;
+		}
+		data[0] = status;
+		host_proto_respond(frame, 0, data, 1);
+		break;
+
+	case HOST_CMD_FLASH_START:
+		if (len < 12) {
+			status = -EINVAL;
+		} else if (m_cfg->flash == NULL) {
+			status = -ENOTSUP;
+		} else {
+			status = dut_flash_start(m_cfg->flash, sys_get_le32(&payload[0]), sys_get_le32(&payload[4]),
+						 sys_get_le32(&payload[8]));
+		}
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_FLASH_DATA:
+		/* Never waits for the DUT side, the host sends the data again on EAGAIN */
+		status = dut_flash_write(payload, len, K_NO_WAIT);
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_FLASH_ABORT:
+		status = dut_flash_is_running() ? 0 : -EALREADY;
+		dut_flash_abort();
+		host_proto_respond(frame, status, NULL, 0);
+		break;
+
+	case HOST_CMD_FLASH_STATUS: {
+		struct dut_flash_status st;
+
+		dut_flash_get_status(&st);
+		host_proto_respond(frame, 0, (const uint8_t *)&st, sizeof(st));
+		break;
+	}
+
+	default:
+		host_proto_respond(frame, ENOTSUP, NULL, 0);
+		break;
+	}
+}
+
+/* Frame parser, resynchronizes on the sync bytes after any error */
+static void host_proto_parse(const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		m_rx_frame[m_rx_len++] = data[i];
+
+		if ((m_rx_len == 1) && (m_rx_frame[0] != HOST_PROTO_SYNC_0)) {
+			m_rx_len = 0;
+		} else if ((m_rx_len == 2) && (m_rx_frame[1] != HOST_PROTO_SYNC_1)) {
+			m_rx_len = (m_rx_frame[1] == HOST_PROTO_SYNC_0) ? 1 : 0;
+			m_rx_frame[0] = m_rx_frame[1];
+		} else if ((m_rx_len == 4) && (sys_get_le16(&m_rx_frame[2]) > HOST_PROTO_MAX_PAYLOAD)) {
+			m_rx_len = 0;
+		} else if (m_rx_len >= HOST_PROTO_HEADER_SIZE + HOST_PROTO_CRC_SIZE) {
+			uint16_t payload_len = sys_get_le16(&m_rx_frame[2]);
+
+			if (m_rx_len < HOST_PROTO_HEADER_SIZE + payload_len + HOST_PROTO_CRC_SIZE) {
+				continue;
+			}
+
+			if (sys_get_le16(&m_rx_frame[HOST_PROTO_HEADER_SIZE + payload_len]) ==
+			    crc16_ccitt(0xFFFF, &m_rx_frame[2], HOST_PROTO_HEADER_SIZE - 2 + payload_len)) {
+				host_proto_handle(m_rx_frame, payload_len);
+			} else {
+				LOG_WRN("Frame CRC error");
+			}
+			m_rx_len = 0;
+		}
+	}
+}
+
+static void host_proto_thread(void *p1, void *p2, void *p3)
+{
+	uint8_t buffer[64];
+	uint32_t len;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	k_sem_take(&host_proto_start_sem, K_FOREVER);
+
+	while (1) {
+		k_timeout_t timeout = m_streaming ? K_MSEC(HOST_PROTO_STREAM_POLL_MS) : K_FOREVER;
+
+		(void)k_sem_take(&m_cfg->host->rx_sem, timeout);
+
+		/* The bridge owns the USB RX data while it runs */
+		while (bridge_is_running()) {
+			k_msleep(BRIDGE_BAUD_POLL_MS);
+			m_rx_len = 0;
+		}
+
+		while ((len = uart_port_read(m_cfg->host, buffer, sizeof(buffer))) > 0) {
+			host_proto_parse(buffer, len);
+		}
+
+		if (m_streaming) {
+			host_proto_send_adc_block();
+			m_streaming = adc_stream_is_running();
+		}
+	}
+}
+
+K_THREAD_DEFINE(host_proto_tid, HOST_PROTO_STACK_SIZE, host_proto_thread,
+		NULL, NULL, NULL, HOST_PROTO_PRIORITY, 0, 0);
+
+/*!
+* @brief Starts serving host commands on the USB port
+*
+* @param config Ports, ADC channels and application callbacks, must stay valid
+*
+* @return 0 if successful
+*
+*/
+int host_proto_start(const struct host_proto_config *config)
+{
+	m_cfg = config;
+	k_sem_give(&host_proto_start_sem);
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef HOST_PROTO_H
+#define HOST_PROTO_H
+
+#include <zephyr/drivers/adc.h>
+
+#include "uart_port.h"
+#include "dut_flash.h"
+
+/*
+ * Frame: sync (2) | length (2, LE) | type (1) | seq (1) | payload (length) | crc (2, LE)
+ * The CRC-16/CCITT (init 0xFFFF) covers length, type, seq and payload.
+ * Responses use the command type | HOST_PROTO_RESPONSE and the same seq, and
+ * start their payload with a status byte (0 or a positive errno).
+ */
+#define HOST_PROTO_SYNC_0		0xA5
+#define HOST_PROTO_SYNC_1		0x5A
+#define HOST_PROTO_HEADER_SIZE		6
+#define HOST_PROTO_CRC_SIZE		2
+#define HOST_PROTO_MAX_PAYLOAD		1100
+#define HOST_PROTO_VERSION		1
+
+#define HOST_PROTO_RESPONSE		0x80
+
+/* Commands */
+#define HOST_CMD_PING			0x01	/* -> version */
+#define HOST_CMD_RUN_TEST		0x02	/* test id -> result, duration ms (4) */
+#define HOST_CMD_READ_RAILS		0x03	/* -> timestamp (4), count, value (4) per channel */
+#define HOST_CMD_SET_GPIO		0x04	/* gpio id, value */
+#define HOST_CMD_ADC_STREAM		0x05	/* enable, interval us (4) -> on disable, struct adc_stream_stats */
+#define HOST_CMD_LOAD_CAL		0x06	/* struct adc_cal_table */
+#define HOST_CMD_RS232_BENCH		0x07	/* duration ms (4), window -> struct rs232_bench_result,
+						 * or to sweep: ..., count, baud rate (4) per count (0 count
+						 * for the default rates) -> rates run (1) */
+#define HOST_CMD_BRIDGE			0x08	/* starts the bridge, commands resume when DTR drops */
+#define HOST_CMD_GET_RESULTS		0x09	/* first seq (4), max count (2, 0 all) -> count (4), next seq (4) */
+#define HOST_CMD_SET_UNIT_ID		0x0A	/* DUT serial (8) for the next result records */
+#define HOST_CMD_GET_TIMING		0x0B	/* reset after reading (1) -> phases sent (1) */
+#define HOST_CMD_EXPORT			0x0C	/* -> captures written to the USB drive (1) */
+#define HOST_CMD_FLASH_START		0x0D	/* image size (4), CRC-32 (4), max baud rate (4, 0 any) */
+#define HOST_CMD_FLASH_DATA		0x0E	/* next image bytes, EAGAIN while the buffer is full:
+						 * send them again, one frame in flight at a time */
+#define HOST_CMD_FLASH_STATUS		0x0F	/* -> struct dut_flash_status */
+#define HOST_CMD_BRIDGE_STATS		0x10	/* -> struct bridge_stats of the last bridge session */
+#define HOST_CMD_FLASH_ABORT		0x11	/* stops the DUT programming, it ends as failed */
+
+/* Unsolicited events */
+#define HOST_EVT_ADC_BLOCK		0xC0	/* seq (4), timestamp (4), channels (2), samplings (2), samples */
+#define HOST_EVT_RESULTS		0xC1	/* count (1), struct result_record per record, before the response */
+#define HOST_EVT_TIMING			0xC2	/* count (1), phase id (1) + struct phase_stats per phase */
+#define HOST_EVT_BENCH			0xC3	/* struct rs232_bench_result per swept rate, before the response */
+
+struct host_proto_config {
+	struct uart_port *host;			/* USB CDC ACM port */
+	struct uart_port *dut;			/* DUT UART port, for the benchmark and the bridge */
+	const struct adc_dt_spec *adc_specs;
+	size_t adc_count;
+	int (*run_test)(uint8_t id, uint32_t *duration_ms);	/* returns enum seq_result, -EBUSY while a sequence runs */
+	int (*set_gpio)(uint8_t id, uint8_t value);
+	const struct dut_flash_config *flash;	/* DUT programming, NULL if not available */
+};
+
+int host_proto_start(const struct host_proto_config *config);
+int host_proto_send(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len);
+
+#endif /* HOST_PROTO_H */
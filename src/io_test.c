@@ -0,0 +1,99 @@
+#include "io_test.h"
+
+#include <zephyr/kernel.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(io_test, LOG_LEVEL_INF);
+
+/* One pass: idle level from the pulls, every line in turn driven to the other level */
+static int io_test_walk(const struct pin_group *grp, const uint32_t *loops, bool ones,
+			struct io_test_result *result)
+{
+	uint32_t all = pin_group_all(grp);
+	uint32_t idle_active;
+	uint32_t levels;
+	int ret;
+
+	ret = pin_group_configure(grp, GPIO_INPUT | (ones ? GPIO_PULL_DOWN : GPIO_PULL_UP));
+	if (ret != 0) {
+		return ret;
+	}
+
+	k_busy_wait(IO_TEST_SETTLE_US);
+	ret = pin_group_get_raw(grp, &levels);
+	if (ret != 0) {
+		return ret;
+	}
+	// Lines already at the active level can not tell anything in this pass
+	idle_active = ones ? levels : (~levels & all);
+	result->stuck |= idle_active;
+
+	for (size_t i = 0; i < grp->count; i++) {
+		const struct gpio_dt_spec *pin = grp->pins[i];
+		uint32_t looped = loops ? (loops[i] & all & ~BIT(i)) : 0;
+		uint32_t active;
+		uint32_t extra;
+
+		// Input kept connected to read the drive back, a bare output reads 0
+		ret = gpio_pin_configure_dt(pin, GPIO_INPUT | (ones ? GPIO_OUTPUT_HIGH : GPIO_OUTPUT_LOW));
+		if (ret != 0) {
+			return ret;
+		}
+		k_busy_wait(IO_TEST_SETTLE_US);
+		ret = pin_group_get_raw(grp, &levels);
+		(void)gpio_pin_configure_dt(pin, GPIO_INPUT | (ones ? GPIO_PULL_DOWN : GPIO_PULL_UP));
+		if (ret != 0) {
+			return ret;
+		}
+
+		active = (ones ? levels : ~levels) & all & ~idle_active;
+		if (!(active & BIT(i))) {
+			result->stuck |= BIT(i);
+		}
+		result->open |= looped & ~active & ~idle_active;
+
+		extra = active & ~looped & ~BIT(i);
+		if (extra) {
+			result->shorted |= extra | BIT(i);
+		}
+
+		// Pulls are weak, give the line time to go back before the next one
+		k_busy_wait(IO_TEST_SETTLE_US);
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Checks the lines of a pin group for stuck, shorted and open lines
+*
+* Walking ones over pulled down inputs, then walking zeros over pulled up
+* inputs. The lines are left as outputs driving low, their idle state on this
+* board.
+*
+* @param grp Lines to test
+* @param loops Lines looped to each line on the DUT side, bitmaps in group
+*              order indexed like the group; NULL if there are none
+* @param result Where the faulty lines are stored
+*
+* @return 0 if the test ran, the lines are judged by result
+* @return negative errno from the GPIO driver
+*/
+int io_test_run(const struct pin_group *grp, const uint32_t *loops, struct io_test_result *result)
+{
+	uint32_t start = k_cycle_get_32();
+	int ret;
+
+	*result = (struct io_test_result){0};
+
+	ret = io_test_walk(grp, loops, true, result);
+	if (ret == 0) {
+		ret = io_test_walk(grp, loops, false, result);
+	}
+
+	(void)pin_group_set_raw(grp, 0);
+	(void)pin_group_configure(grp, GPIO_OUTPUT);
+
+	LOG_DBG("%u lines tested in %u us", grp->count, k_cyc_to_us_near32(k_cycle_get_32() - start));
+	return ret;
+}
@@ -0,0 +1,34 @@
+#ifndef IO_TEST_H
+#define IO_TEST_H
+
+#include "pin_group.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Connector line test with walking ones and zeros. All the lines are inputs
+ * pulled to the idle level and one at a time is driven to the other level:
+ * it must read back, lines looped to it on the DUT side must follow, and no
+ * other line may. Opens are only found on looped lines, a line that ends
+ * at a high impedance DUT input reads the same connected or not.
+ */
+
+/* Time for a line to settle through the internal pulls and the level shifters */
+#define IO_TEST_SETTLE_US           10
+
+/* Lines as bitmaps in pin group order */
+struct io_test_result {
+	uint32_t stuck;			/* at the wrong level when idle or not following its own drive */
+	uint32_t shorted;		/* following a line they are not looped to */
+	uint32_t open;			/* not following a line they are looped to */
+};
+
+int io_test_run(const struct pin_group *grp, const uint32_t *loops, struct io_test_result *result);
+
+static inline bool io_test_ok(const struct io_test_result *result)
+{
+	return (result->stuck | result->shorted | result->open) == 0;
+}
+
+#endif /* IO_TEST_H */
@@ -13,13 +13,11 @@
  */
 
 
-#include <stdio.h>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/uart.h>
 #include <zephyr/drivers/gpio.h>
-#include <zephyr/sys/ring_buffer.h>
 #include <string.h>
 
 #include <zephyr/drivers/i2c.h>
@@ -29,7 +27,21 @@
 LOG_MODULE_REGISTER(cdc_acm_echo, LOG_LEVEL_INF);
 
 #include "analog.h"
+#include "current_meter.h"
+#include "uart_port.h"
+#include "sequencer.h"
+#include "host_proto.h"
 #include "pcf8523.h"
+#include "rtc_drift.h"
+#include "bcd_time.h"
+#include "result_log.h"
+#include "rail_monitor.h"
+#include "power_seq.h"
+#include "pin_group.h"
+#include "io_test.h"
+#include "phase_timing.h"
+#include "msc_export.h"
+#include "dut_flash.h"
 
 /* ADC RELATED */
 #if !DT_NODE_EXISTS(DT_PATH(zephyr_user)) || !DT_NODE_HAS_PROP(DT_PATH(zephyr_user), io_channels)
@@ -44,13 +56,9 @@ static const struct adc_dt_spec adc_channels[] = {
 };
 
 
-/* UART RING BUFFER DEFINES */
-#define RING_BUF_SIZE 1024
-uint8_t ring_buffer[RING_BUF_SIZE];
-struct ring_buf usb_tx_ringbuf;
-struct ring_buf usb_rx_ringbuf;
-struct ring_buf uart1_tx_ringbuf;
-struct ring_buf uart1_rx_ringbuf;
+/* UART PORTS, each one with its own RX/TX ring buffers */
+UART_PORT_DEFINE(usb_port, DEVICE_DT_GET_ONE(zephyr_cdc_acm_uart), USB_PORT_RX_SIZE, USB_PORT_TX_SIZE);
+UART_PORT_DEFINE(uart1_port, DEVICE_DT_GET(DT_NODELABEL(uart1)), UART1_PORT_RX_SIZE, UART1_PORT_TX_SIZE);
 
 
 /* Get all the pins specs from the board .dts file */
@@ -80,362 +88,554 @@ const struct gpio_dt_spec SHUNT_EN_PIN = GPIO_DT_SPEC_GET(DT_NODELABEL(shunt_en_
 const struct gpio_dt_spec LS_OE = GPIO_DT_SPEC_GET(DT_NODELABEL(level_shift_oe), gpios);
 
 
+/* Fixture outputs, in the order of the BOARD_OUT_DEFAULT bits */
+static const struct gpio_dt_spec *const board_out_pins[] = {
+	&LED1, &LED2, &LS_OE, &AP22_EN_PIN, &SHUNT_BYPASS_PIN, &SHUNT_EN_PIN,
+};
+static struct pin_group board_out = PIN_GROUP_INIT(board_out_pins);
+/* Level shifters enabled; LEDs, AP22 power switch and both shunt paths off */
+#define BOARD_OUT_DEFAULT		BIT(2)
+
+/* DUT connector lines, outputs driving low when not under test. SCL/SDA unused, TX/RX_CON are uart1 */
+static const struct gpio_dt_spec *const dut_io_pins[] = {
+	&COMM_PIN, &STS_LED_PIN, &SPARE_0_PIN, &SPARE_1_PIN, &SPARE_2_PIN, &SPARE_3_PIN, &SPARE_4_PIN,
+	&DIR_PIN, &PLS_PIN, &TAMPER_PIN, &EXTRA_1_PIN, &EXTRA_2_PIN,
+};
+static struct pin_group dut_io = PIN_GROUP_INIT(dut_io_pins);
+
+
 const struct device *dev_UART1 = DEVICE_DT_GET(DT_NODELABEL(uart1));
 const struct device *dev_GPIO0 = DEVICE_DT_GET(DT_NODELABEL(gpio0));
 const struct device *dev_GPIO1 = DEVICE_DT_GET(DT_NODELABEL(gpio1));
 const struct device *dev_USB   = DEVICE_DT_GET_ONE(zephyr_cdc_acm_uart);
-const struct device *dev_I2C0 = DEVICE_DT_GET(DT_NODELABEL(i2c0));
+const struct device *dev_RTC   = DEVICE_DT_GET(DT_NODELABEL(pcf8523));
 
 /* timeout in milliseconds for led blinking */
 #define LED_BLINK_TIME_OUT_MS	100	/* milliseconds */
-#define LED_BLINK_TO			LED_BLINK_TIME_OUT_MS * (CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC)/1000
-/* timeout in milliseconds for adc sampling */
-#define ADC_TIME_OUT_MS			1000	/* milliseconds */
-#define ADC_TO					ADC_TIME_OUT_MS * (CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC)/1000
 
+/* Number of times the RS-232 loop test is tried before failing */
+#define RS232_TEST_ATTEMPTS		5
+#define RS232_ANSWER_MS			500	/* time given to the loop to answer */
+#define RS232_RETRY_MS			2000	/* time between attempts */
+/* 3.45V rail regulation */
+#define RAIL_TIMEOUT_MS			10000
+/* DUT held off before it is powered up, discharges its rails */
+#define DUT_POWER_OFF_MS		100
+/* Time given to the DUT to fall asleep before its sleep current is measured */
+#define DUT_SLEEP_SETTLE_MS		1000
+/* RTC step deadline past the measurement: first second edge, I2C reads and work queue latency */
+#define RTC_STEP_MARGIN_MS		5000
+/* Deadline for the whole test sequence */
+#define SEQ_TIMEOUT_MS			30000
+
+/* Test steps, run by the sequencer */
 enum states{
 			st_output_voltage,
+			st_dut_current,
 			st_read_rtc,
 			st_test_rs232,
-			st_results
+			st_power_on,
+			st_dut_io,
+			st_results		/* number of steps */
 };
 
 
 void configure_and_set_io_pins();
 
-static void usb_uart_interrupt_handler(const struct device *dev, void *user_data)
+void setup_usb(const struct device *dev)
 {
-	ARG_UNUSED(user_data);
-
-	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
-
-		/* Interrupt triggered by RX pin */
-		if (uart_irq_rx_ready(dev)) {
-			int recv_len, rb_len;
-			uint8_t buffer[64];
-			size_t len = MIN(ring_buf_space_get(&usb_rx_ringbuf),
-					 sizeof(buffer));
-
-			recv_len = uart_fifo_read(dev, buffer, len);
-			if (recv_len < 0) {
-				LOG_ERR("Failed to read UART FIFO");
-				recv_len = 0;
-			};
-
-			rb_len = ring_buf_put(&usb_rx_ringbuf, buffer, recv_len);
-			if (rb_len < recv_len) {
-				LOG_ERR("Drop %u bytes", recv_len - rb_len);
-			}
-		}
+	int ret;
+	uint32_t baudrate = 0U;
+	
+	
+	ret = uart_line_ctrl_get(dev, UART_LINE_CTRL_BAUD_RATE, &baudrate);
+	if (ret) {
+		LOG_WRN("Failed to get baudrate, ret code %d", ret);
+	} else {
+		LOG_INF("Baudrate detected: %d", baudrate);
+	}
+}
+
 
-		/* Interrupt triggered by TX pin */
-		if (uart_irq_tx_ready(dev)) {
-			uint8_t buffer[64];
-			int rb_len, send_len;
+/* Rails supervised by the rail monitor while a sequence runs */
+enum rails{
+			rail_3v45,
+			rail_3v6,
+};
+
+static const struct rail_window rail_windows[] = {
+	[rail_3v45] = { .chn = ADC_3v45_CHN, .min_mV = LOWER_3v45, .max_mV = UPPER_3v45 },
+	/* Only reported, any reading is in the window */
+	[rail_3v6]  = { .chn = ADC_3v6_CHN, .min_mV = INT32_MIN, .max_mV = INT32_MAX },
+};
 
-			rb_len = ring_buf_get(&usb_tx_ringbuf, buffer, sizeof(buffer));
-			if (!rb_len) {
-				LOG_DBG("Ring buffer empty, disable TX IRQ");
-				uart_irq_tx_disable(dev);
-				continue;
-			}
+/* 3.45V rail got into regulation, resumes the output voltage step */
+static void rail_event_cb(uint8_t rail, enum rail_event event, int32_t mv, void *user_data)
+{
+	struct seq_step *step = user_data;
 
-			send_len = uart_fifo_fill(dev, buffer, rb_len);
-			if (send_len < rb_len) {
-				LOG_ERR("Drop %d bytes", rb_len - send_len);
-			}
+	if((rail == rail_3v45) && (event == RAIL_EVT_ENTER)){
+		seq_step_defer(step, 0);
+	}
+}
 
-			LOG_DBG("usb_tx_ringbuf -> tty fifo %d bytes", send_len);
+/*
+ * Waits for the 3.45V buck output to be in regulation. The rail monitor samples
+ * in the background and resumes the step, the step timeout is the deadline.
+ */
+static void step_output_voltage(struct seq_step *step)
+{
+	struct rail_status st_3v45, st_3v6;
+	int ret;
+
+	if(step->phase == 0){
+		ret = rail_monitor_start(adc_channels, ARRAY_SIZE(adc_channels), rail_windows,
+					 ARRAY_SIZE(rail_windows), 0);
+		if((ret != 0) && (ret != -EBUSY)){
+			seq_step_done(step, SEQ_FAILED);
+			return;
+		}
+		step->phase = 1;
+		/* Callback first, an entry between the check and the callback is not lost */
+		rail_monitor_set_callback(rail_event_cb, step);
+		if(rail_monitor_wait(rail_3v45, true, K_NO_WAIT) != 0){
+			return;
 		}
 	}
+
+	rail_monitor_set_callback(NULL, NULL);
+	rail_monitor_get_status(rail_3v45, &st_3v45);
+	rail_monitor_get_status(rail_3v6, &st_3v6);
+
+	LOG_INF("Output voltage: %d mV after %u us, rail %d: %d mV", st_3v45.last_mV,
+		st_3v45.regulation_us, ADC_3v6_CHN, st_3v6.last_mV);
+	gpio_pin_set_raw(LED1.port, LED1.pin, 0);
+	gpio_pin_set_raw(LED2.port, LED2.pin, 0);
+
+	step->value = st_3v45.last_mV;
+	seq_step_done(step, SEQ_PASSED);
 }
 
+/* DUT supply through the AP22 switch. No 1.8V channel is wired, the 3.6V rail is captured */
+static const struct power_seq_config power_config = {
+	.en = &AP22_EN_PIN,
+	.flg = &AP22_FLG_PIN,
+	.adc_specs = adc_channels,
+	.current_chn = ADC_CURRENT_CHN,
+	.rail_chn = ADC_3v6_CHN,
+};
+
+/*
+ * Powers the DUT up through the AP22 switch from a clean off state. Inrush,
+ * rail rise and FLG are captured on the enable edge timeline.
+ */
+static void step_power_on(struct seq_step *step)
+{
+	struct power_seq_result res;
+	int ret;
+
+	if(step->phase == 0){
+		power_seq_off();
+		step->phase = 1;
+		seq_step_defer(step, DUT_POWER_OFF_MS);
+		return;
+	}
+
+	// The burst owns the ADC, a rail scan would delay its start or steal samplings
+	rail_monitor_pause();
+	ret = power_seq_on(&res);
+	rail_monitor_resume();
+	if(ret != 0){
+		seq_step_done(step, SEQ_FAILED);
+		return;
+	}
+
+	if(res.rose){
+		LOG_INF("Inrush: %d uA at %u us, rail %d mV after %u us, rise %u us",
+			res.inrush_peak_uA, res.inrush_peak_us, res.rail_mV, res.rail_delay_us, res.rise_us);
+	}else{
+		LOG_WRN("Inrush: %d uA at %u us, rail %d mV did not rise",
+			res.inrush_peak_uA, res.inrush_peak_us, res.rail_mV);
+	}
+	if(res.faults){
+		LOG_WRN("AP22 fault flag %u times, first at %u us", res.faults, res.fault_us);
+	}
+
+	step->value = res.inrush_peak_uA;
+	seq_step_done(step, ((res.faults == 0) && res.rose) ? SEQ_PASSED : SEQ_FAILED);
+}
 
-static void uart1_interrupt_handler(const struct device *dev, void *user_data)
+/*
+ * Active current in whatever range fits, then the sleep current over a window
+ * in the uA range. The sequencer idles while the DUT falls asleep, the wait is
+ * not timed by the RTC: that needs its INT1 line, the fixture board has none.
+ */
+static void step_dut_current(struct seq_step *step)
 {
-	ARG_UNUSED(user_data);
-
-	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
-
-		/* Interrupt triggered by RX pin */
-		if (uart_irq_rx_ready(dev)) {
-			int recv_len, rb_len;
-			uint8_t buffer[64];
-			size_t len = MIN(ring_buf_space_get(&uart1_rx_ringbuf),
-					 sizeof(buffer));
-
-			recv_len = uart_fifo_read(dev, buffer, len);
-			if (recv_len < 0) {
-				LOG_ERR("Failed to read UART FIFO");
-				recv_len = 0;
-			};
-
-			rb_len = ring_buf_put(&uart1_rx_ringbuf, buffer, recv_len);
-			if (rb_len < recv_len) {
-				LOG_ERR("Drop %u bytes", recv_len - rb_len);
-			}
+	struct current_reading reading;
+	struct adc_current_stats current = {0};
+	int32_t ret;
+
+	if(step->phase == 0){
+		if(current_meter_read(&reading) == 0){
+			LOG_INF("DUT current: %d uA (%s range)", reading.current_uA,
+				(reading.range == ADC_CURRENT_RANGE_MA) ? "mA" : "uA");
 		}
+		current_meter_set_range(ADC_CURRENT_RANGE_UA);
+
+		step->phase = 1;
+		seq_step_defer(step, DUT_SLEEP_SETTLE_MS);
+		return;
+	}
+
+	// The rail scans would share the ADC and add their own noise to the window
+	rail_monitor_pause();
+	ret = adc_measure_dut_current(&adc_channels[ADC_CURRENT_CHN], NULL, &current);
+	rail_monitor_resume();
+	if(ret == 0){
+		LOG_INF("Sleep current: mean %d uA, min %d, max %d, rms %d, p%d %d uA",
+			current.mean_uA, current.min_uA, current.max_uA, current.rms_uA,
+			ADC_CURRENT_PERCENTILE, current.pct_uA);
+	}
+
+	step->value = current.mean_uA;
+	seq_step_done(step, adc_dut_sleep_current_ok(&current) ? SEQ_PASSED : SEQ_FAILED);
+}
 
-		/* Interrupt triggered by TX pin */
-		if (uart_irq_tx_ready(dev)) {
-			uint8_t buffer[64];
-			int rb_len, send_len;
+/* RTC seconds timed or counted, closes the RTC step */
+static void rtc_drift_done(const struct rtc_drift_result *res, void *user_data)
+{
+	struct seq_step *step = user_data;
+
+	if(res->counted){
+		LOG_INF("RTC counted %u s over %u ms, no second interrupt to time them",
+			res->ticks, k_cyc_to_ms_near32((uint32_t)res->cycles));
+	}else{
+		LOG_INF("RTC drift: %d ppb over %u s (period %u..%u us, %u missed)",
+			res->drift_ppb, res->ticks, res->period_min_us, res->period_max_us, res->missed);
+	}
 
-			rb_len = ring_buf_get(&uart1_tx_ringbuf, buffer, sizeof(buffer));
-			if (!rb_len) {
-				LOG_DBG("Ring buffer empty, disable TX IRQ");
-				uart_irq_tx_disable(dev);
-				continue;
-			}
+	step->value = res->drift_ppb;
+	seq_step_done(step, rtc_drift_ok(res) ? SEQ_PASSED : SEQ_FAILED);
+}
 
-			send_len = uart_fifo_fill(dev, buffer, rb_len);
-			if (send_len < rb_len) {
-				LOG_ERR("Drop %d bytes", rb_len - send_len);
-			}
+/*
+ * Sets the RTC if it lost power and measures its drift from the second
+ * interrupt. The fixture board has no INT1 line, there rtc_drift only
+ * counts the RTC seconds against its own (rtc_drift_result.counted).
+ */
+static void step_read_rtc(struct seq_step *step)
+{
+	int64_t time_1 = 0;
+	char time_str[BCD_TIME_ISO8601_SIZE] = "invalid";
 
-			LOG_DBG("usb_tx_ringbuf -> tty fifo %d bytes", send_len);
+	// Check switchover flag status
+	if(pcf8523_switchover_occurred(dev_RTC)){
+		// Switch-over occured
+		LOG_INF("Switch-over flag set");
+	}else{
+		// No switch-over occured
+		LOG_INF("Switch-over flag clear");
+
+		// Set time and date to 1664506805: 03:00:05 30/09/2022
+		int64_t ts = 1664506805;
+		pcf8523_set_time(dev_RTC, &ts);
+	}
+	if(pcf8523_get_time(dev_RTC, &time_1) == 0)
+		bcd_time_format(time_1, time_str, sizeof(time_str));
+
+	LOG_INF("Start time: %s", time_str);
+
+	/* Other steps keep running while the RTC ticks, rtc_drift_done() ends the step */
+	if(rtc_drift_start(dev_RTC, RTC_DRIFT_TICKS, rtc_drift_done, step) != 0){
+		LOG_WRN("RTC drift measurement not started");
+		seq_step_done(step, SEQ_FAILED);
+	}
+}
+
+/* Sends a line through the DUT RS-232 loop and waits for it to come back */
+static void step_test_rs232(struct seq_step *step)
+{
+	uint8_t buffer[64];
+	uint32_t recv_len;
+
+	/* The bridge, the benchmark or the DUT programming has the line */
+	if(uart_port_claim(&uart1_port) != 0){
+		LOG_WRN("UART1 busy");
+		seq_step_done(step, SEQ_FAILED);
+		return;
+	}
+
+	/* Even phases send, odd phases check the answer */
+	if((step->phase % 2) == 0){
+		const char *str = "UART1 Test:\n";
+
+		uart_port_write(&uart1_port, str, strlen(str));
+		uart_port_release(&uart1_port);
+		step->phase++;
+		seq_step_defer(step, RS232_ANSWER_MS);
+		return;
+	}
+
+	recv_len = uart_port_read(&uart1_port, buffer, sizeof(buffer));
+	uart_port_release(&uart1_port);
+	if(recv_len && (memchr(buffer, '\n', recv_len) != NULL)){
+		// Line feed character received
+		LOG_HEXDUMP_INF(buffer, recv_len, "RS-232 answer");
+		step->value = (step->phase / 2) + 1;	// attempts needed
+		seq_step_done(step, SEQ_PASSED);
+		return;
+	}
+
+	step->phase++;
+	if((step->phase / 2) >= RS232_TEST_ATTEMPTS){
+		seq_step_done(step, SEQ_FAILED);
+		return;
+	}
+	seq_step_defer(step, RS232_RETRY_MS);
+}
+
+/*
+ * Walks ones and zeros over the DUT connector lines. The harness has no DUT
+ * side loopbacks, so stuck and shorted lines are found but opens are not.
+ */
+static void step_dut_io(struct seq_step *step)
+{
+	struct io_test_result res;
+
+	if(io_test_run(&dut_io, NULL, &res) != 0){
+		seq_step_done(step, SEQ_FAILED);
+		return;
+	}
+
+	if(!io_test_ok(&res)){
+		LOG_WRN("DUT I/O lines stuck 0x%03x, shorted 0x%03x, open 0x%03x", res.stuck, res.shorted, res.open);
+	}
+
+	step->value = res.stuck | res.shorted | res.open;
+	seq_step_done(step, io_test_ok(&res) ? SEQ_PASSED : SEQ_FAILED);
+}
+
+/*
+ * step->value in the result record: rail mV, sleep current uA, RTC drift ppb,
+ * RS-232 attempts, inrush peak uA, faulty DUT I/O lines (bitmap in dut_io_pins[] order)
+ */
+static struct seq_step test_steps[st_results] = {
+	[st_output_voltage] = SEQ_STEP("Output voltage", step_output_voltage, 0, RAIL_TIMEOUT_MS),
+	[st_dut_current]    = SEQ_STEP("DUT current", step_dut_current,
+				       BIT(st_output_voltage) | BIT(st_power_on), DUT_SLEEP_SETTLE_MS + 2000),
+	/* Up to a second for the reference edge, then RTC_DRIFT_TICKS of them */
+	[st_read_rtc]       = SEQ_STEP("RTC", step_read_rtc, 0,
+				       ((RTC_DRIFT_TICKS + 1) * MSEC_PER_SEC) + RTC_STEP_MARGIN_MS),
+	[st_test_rs232]     = SEQ_STEP("RS-232", step_test_rs232, BIT(st_output_voltage) | BIT(st_power_on),
+				       RS232_TEST_ATTEMPTS * (RS232_ANSWER_MS + RS232_RETRY_MS)),
+	[st_power_on]       = SEQ_STEP("Power on", step_power_on, 0, DUT_POWER_OFF_MS + 1000),
+	/* Driving the DUT inputs would show in its sleep current */
+	[st_dut_io]         = SEQ_STEP("DUT I/O", step_dut_io, BIT(st_power_on) | BIT(st_dut_current), 1000),
+};
+BUILD_ASSERT(st_results <= PHASE_TIMING_MAX_STEPS, "test steps without timing statistics");
+
+/* Pins the host can drive, the index is the gpio id of HOST_CMD_SET_GPIO */
+static const struct gpio_dt_spec *const host_gpios[] = {
+	&COMM_PIN, &STS_LED_PIN, &SPARE_0_PIN, &SPARE_1_PIN, &SPARE_2_PIN, &SPARE_3_PIN, &SPARE_4_PIN,
+	&DIR_PIN, &PLS_PIN, &TAMPER_PIN, &EXTRA_1_PIN, &EXTRA_2_PIN,
+	&AP22_EN_PIN, &SHUNT_BYPASS_PIN, &SHUNT_EN_PIN, &LS_OE, &LED1, &LED2,
+};
+
+/* Steps waiting on the RTC or the rails are left behind when a sequence times out */
+static void cancel_step_events(void)
+{
+	rtc_drift_cancel();
+	rail_monitor_set_callback(NULL, NULL);
+	rail_monitor_stop();
+}
+
+/* Step durations into the phase statistics, steps that never started are left out */
+static void time_steps(const struct seq_step *steps, size_t count, uint8_t first_id)
+{
+	for(size_t i = 0; i < count; i++){
+		if((steps[i].result == SEQ_PENDING) || (steps[i].result == SEQ_SKIPPED)){
+			continue;
 		}
+		phase_timing_add(PHASE_STEP_0 + first_id + i,
+				 (uint32_t)(steps[i].end_ms - steps[i].start_ms) * USEC_PER_MSEC);
 	}
 }
 
-void setup_usb(const struct device *dev)
+/*
+ * Runs a single test step on request of the host, without its dependencies.
+ * Refused while the boot sequence runs, its steps share the fixture hardware.
+ */
+static int host_run_test(uint8_t id, uint32_t *duration_ms)
 {
 	int ret;
-	uint32_t baudrate = 0U;
-	
-	
-	ret = uart_line_ctrl_get(dev, UART_LINE_CTRL_BAUD_RATE, &baudrate);
-	if (ret) {
-		LOG_WRN("Failed to get baudrate, ret code %d", ret);
-	} else {
-		LOG_INF("Baudrate detected: %d", baudrate);
+
+	if(id >= ARRAY_SIZE(test_steps)){
+		return -EINVAL;
+	}
+
+	/* Only the constant fields of the table entry are read, it may be running */
+	struct seq_step step = SEQ_STEP(test_steps[id].name, test_steps[id].handler, 0, test_steps[id].timeout_ms);
+
+	ret = seq_try_run(&step, 1, K_MSEC(SEQ_TIMEOUT_MS));
+	if(ret == -EBUSY){
+		return ret;
 	}
+	/* The step lives on this stack, nothing may complete it once we return */
+	cancel_step_events();
+	time_steps(&step, 1, id);
+	*duration_ms = step.end_ms - step.start_ms;
+
+	return step.result;
 }
 
+static int host_set_gpio(uint8_t id, uint8_t value)
+{
+	if(id >= ARRAY_SIZE(host_gpios)){
+		return -EINVAL;
+	}
+
+	return gpio_pin_set_raw(host_gpios[id]->port, host_gpios[id]->pin, value);
+}
+
+/* DUT supply for programming, the bootloader runs at power up */
+static int dut_flash_power(bool on)
+{
+	struct power_seq_result res;
+	int ret;
+
+	if(!on){
+		power_seq_off();
+		return 0;
+	}
+
+	rail_monitor_pause();
+	ret = power_seq_on(&res);
+	rail_monitor_resume();
+	return (ret == -EALREADY) ? 0 : ret;
+}
+
+static const struct dut_flash_config flash_config = {
+	.port = &uart1_port,
+	.power = dut_flash_power,
+};
+
+static const struct host_proto_config host_config = {
+	.host = &usb_port,
+	.dut = &uart1_port,
+	.adc_specs = adc_channels,
+	.adc_count = ARRAY_SIZE(adc_channels),
+	.run_test = host_run_test,
+	.set_gpio = host_set_gpio,
+	.flash = &flash_config,
+};
+
+
+/* The USB drive is only written while no host has it configured */
+static void usb_status_cb(enum usb_dc_status_code status, const uint8_t *param)
+{
+	msc_export_usb_status(status, param);
+}
 
 /* MAIN ENTRY POINT */
 void main(void)
 {
 	//uint32_t baudrate, dtr = 0U;
 	int ret;
-	int32_t mv_Val=0;
-
-	uint8_t str[100];
-	int64_t ts=0;
-	struct tm time = {0};
-	char time_str[10];
-	char date_str[10];
-	int time_1 = 0;
-	int time_2 = 0;
-	uint32_t recv_len;
-	uint8_t buffer[64];
-	uint8_t *ptr;	
 
 	/* Verify that devices are ready to use */
 	if(!device_is_ready(dev_UART1)){ LOG_ERR("UART1 device not ready"); return;}
 	if(!device_is_ready(dev_GPIO0)){ LOG_ERR("GPIO0 device not ready"); return;}
 	if(!device_is_ready(dev_GPIO1)){ LOG_ERR("GPIO1 device not ready"); return;}
 	if(!device_is_ready(dev_USB))  { LOG_ERR("CDC ACM device not ready"); return;}
+	if(!device_is_ready(dev_RTC))  { LOG_ERR("RTC device not ready"); return;}
 	/* Verify USB is enabled */
-	ret = usb_enable(NULL);
+	ret = usb_enable(usb_status_cb);
 	if (ret != 0){ LOG_ERR("Failed to enable USB"); return; }
 
 	/* Configure direction of IO pins and set the value according to application */
 	configure_and_set_io_pins();
+	if(power_seq_init(&power_config) != 0){ LOG_ERR("AP22 power switch not available"); return;}
 	
 	/* Configure ADC channels individually prior to sampling. */
 	for (size_t i = 0U; i < ARRAY_SIZE(adc_channels); i++) {
 		adc_init_chn(&adc_channels[i]);
 	}
 
-	/* Do USB-specific work not related to UART, waits for the host device to connect */
-	setup_usb(dev_USB);
-
-	// Configure/Initialize i2c controller and RTC module
-	pcf8523_init(dev_I2C0);
-
-	/* Initialize data ring buffers used by the uart module */
-	ring_buf_init(&usb_rx_ringbuf, sizeof(ring_buffer), ring_buffer);
-	ring_buf_init(&usb_tx_ringbuf, sizeof(ring_buffer), ring_buffer);
-	ring_buf_init(&uart1_rx_ringbuf, sizeof(ring_buffer), ring_buffer);
-	ring_buf_init(&uart1_tx_ringbuf, sizeof(ring_buffer), ring_buffer);
-
-	/* Attach interrupt handler to USB UART port */
-	uart_irq_callback_set(dev_USB, usb_uart_interrupt_handler);
-
-	/* Enable usb uart rx interrupts */
-	uart_irq_rx_enable(dev_USB);
-
-	/* Attach interrupt handler to UART1 port */
-	uart_irq_callback_set(dev_UART1, uart1_interrupt_handler);
+	/* Use the fixture calibration when there is one in flash, defaults otherwise */
+	if(adc_cal_load_flash() != 0){
+		LOG_WRN("No calibration in flash, using defaults");
+	}
 
-	/* Enable uart1 rx interrupts */
-	uart_irq_rx_enable(dev_UART1);
+	/* Results of earlier runs stay in flash, numbering continues after them */
+	result_log_init();
 
-	// Wait for 2 seconds
-	k_msleep(2000);
+	/* Current path starts in the uA range, switched automatically afterwards */
+	current_meter_init(&adc_channels[ADC_CURRENT_CHN], &SHUNT_EN_PIN, &SHUNT_BYPASS_PIN);
 
-	int index=0;
-	// Check switchover flag status
-	if(pcf8523_switchover_occurred(dev_I2C0)){
-		// Switch-over occured
-		/* Send value through uart for debug purposes */
-		sprintf(str, "\nSwitch-over flag set.\n");
-		index =  strlen(str);
-
-		pcf8523_get_time_tm(dev_I2C0, &time);
-		time_1 = time.tm_sec;
-		convert_time_ascii(&time, time_str, date_str);
+	/* Do USB-specific work not related to UART, waits for the host device to connect */
+	setup_usb(dev_USB);
 
-		sprintf(&str[index], "\nStart time: %s", time_str);
-		ring_buf_put(&usb_tx_ringbuf, str, strlen(str));
-		uart_irq_tx_enable(dev_USB);
+	/* Initialize the ring buffers and interrupts of the USB and UART1 ports */
+	uart_port_init(&usb_port);
+	uart_port_init(&uart1_port);
 
-	}else{
-		// No switch-over occured
-		sprintf(str, "\nSwitch-over flag clear.\n");
-		index =  strlen(str);
+	seq_init();
 
-		// Set time and date to 1664506805: 03:00:05 30/09/2022
-		ts = 1664506805;
-		pcf8523_set_time(dev_I2C0, &ts);
+	/* Host commands are served from now on, also while the boot sequence runs */
+	host_proto_start(&host_config);
 
-		pcf8523_get_time_tm(dev_I2C0, &time);
-		time_1 = time.tm_sec;
-		convert_time_ascii(&time, time_str, date_str);
+	/* RTC tick check overlaps with the rail, current and RS-232 checks */
+	uint32_t seq_start = phase_timing_begin();
+	ret = seq_run(test_steps, ARRAY_SIZE(test_steps), K_MSEC(SEQ_TIMEOUT_MS));
+	phase_timing_end(PHASE_SEQUENCE, seq_start);
+	cancel_step_events();
+	time_steps(test_steps, ARRAY_SIZE(test_steps), 0);
 
-		sprintf(&str[index], "\nStart time: %s \n", time_str);
-		ring_buf_put(&usb_tx_ringbuf, str, strlen(str));
-		uart_irq_tx_enable(dev_USB);
+	/* The monitor kept watching the buck output while the other steps ran */
+	struct rail_status rail;
+	if((rail_monitor_get_status(rail_3v45, &rail) == 0) && rail.leave_count){
+		LOG_WRN("3.45V rail dropped out %u times", rail.leave_count);
 	}
 
-	// Wait for 2 seconds
-	k_msleep(2000);
-
-	pcf8523_get_time_tm(dev_I2C0, &time);
-	time_2 = time.tm_sec;
-	convert_time_ascii(&time, time_str, date_str);
-	sprintf(str, "\nTime after 2 seconds: %s\n", time_str);
-	ring_buf_put(&usb_tx_ringbuf, str, strlen(str));
-	uart_irq_tx_enable(dev_USB);
-
-	if(time_1 > 57)
-		time_2 += 60;
-	if((time_2-time_1) == 2){
-		ring_buf_put(&usb_tx_ringbuf, "\nPASSED\n", 7);
-		uart_irq_tx_enable(dev_USB);
-	}else{
-		ring_buf_put(&usb_tx_ringbuf, "\nFAILED\n", 7);
-		uart_irq_tx_enable(dev_USB);
+	for(size_t i = 0; i < ARRAY_SIZE(test_steps); i++){
+		LOG_INF("%s: %s (%lld ms)", test_steps[i].name, seq_result_str(test_steps[i].result),
+			test_steps[i].end_ms - test_steps[i].start_ms);
 	}
+	LOG_INF("%s", (ret == 0) ? "PASSED" : "FAILED");
 
-	uint8_t adc_str[60];
-	/* Read voltage value and make sure the voltage is 3.45V at the output of buck converter */
-	while((mv_Val < LOWER_3v45) || (mv_Val > UPPER_3v45)){
-		mv_Val = adc_read_ps_3v6(&adc_channels[ADC_3v45_CHN]);
-		gpio_pin_toggle(LED1.port, LED1.pin);
-		gpio_pin_toggle(LED2.port, LED2.pin);
-		k_msleep(350);	
+	/* Binary record for the MES, kept in flash until the host fetches it */
+	int64_t ts = 0;
+	pcf8523_get_time(dev_RTC, &ts);
+	if(result_log_append(test_steps, ARRAY_SIZE(test_steps), ret == 0, (uint32_t)ts) != 0){
+		LOG_WRN("Result not stored");
 	}
-
-	
-	/* Send value through uart for debug purposes */
-	sprintf(adc_str, " - Output Voltage: %d mV\n\n\n", mv_Val);
-	ring_buf_put(&usb_tx_ringbuf, adc_str, strlen(adc_str));
-	uart_irq_tx_enable(dev_USB);	
-	gpio_pin_set_raw(LED1.port, LED1.pin, 0);
-	gpio_pin_set_raw(LED2.port, LED2.pin, 0);
-
-
-	/* Test RS-232 Comms */
-	while(1){
-		sprintf(&str, "UART1 Test:\n");
-		ring_buf_put(&uart1_tx_ringbuf, str, strlen(str));
-		uart_irq_tx_enable(dev_UART1);
-
-		k_msleep(500);// Wait for 2 seconds
-
-		recv_len = ring_buf_get(&uart1_rx_ringbuf, buffer, sizeof(buffer));
-		if(recv_len) {
-			ptr = strchr(buffer, '\n');
-			if(ptr != NULL){
-				// Line feed character received, process command
-				/* Send value through uart for debug purposes */
-				ring_buf_put(&usb_tx_ringbuf, buffer, 12);
-				uart_irq_tx_enable(dev_USB);
-			}
-		}
-		
-		k_msleep(2000);// Wait for 2 seconds
-	};
-		
-
-	uint32_t startTime = k_cycle_get_32();
-	uint32_t startTime2 = k_cycle_get_32();
+	/* Also on the USB drive in the composite build, once no host has it; a no-op otherwise */
+	msc_export_write();
 
 	/* Infinite Loop */
 	while(1){
 
-
 		/* Toggle leds every x time */
-		if((k_cycle_get_32() - startTime) > LED_BLINK_TO){
-			gpio_pin_toggle(LED1.port, LED1.pin);
-			gpio_pin_toggle(LED2.port, LED2.pin);
-			startTime = k_cycle_get_32();
-		}
-		
+		gpio_pin_toggle(LED1.port, LED1.pin);
+		gpio_pin_toggle(LED2.port, LED2.pin);
+		k_msleep(LED_BLINK_TIME_OUT_MS);
 	}
 }
 
 
 
 void configure_and_set_io_pins(){
+	/* Preset the levels in one write per port, outputs then start at them glitch free */
+	if((pin_group_init(&board_out) != 0) || (pin_group_init(&dut_io) != 0)){
+		LOG_ERR("Pin groups do not fit");
+		return;
+	}
+	pin_group_set_raw(&board_out, BOARD_OUT_DEFAULT);
+	pin_group_set_raw(&dut_io, 0);
+
 	/* Configure the direction of the board IO pins */
-	gpio_pin_configure_dt(&LED1, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&LED2, GPIO_OUTPUT);
-	//gpio_pin_configure_dt(&SCL_PIN, GPIO_OUTPUT);
-	//gpio_pin_configure_dt(&SDA_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&COMM_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&STS_LED_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&SPARE_0_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&SPARE_1_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&SPARE_3_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&DIR_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&PLS_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&TAMPER_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&SPARE_2_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&SPARE_4_PIN, GPIO_OUTPUT);
-	// gpio_pin_configure_dt(&TX_CON_PIN, GPIO_OUTPUT);	// Used for uart1 rx
-	// gpio_pin_configure_dt(&RX_CON_PIN, GPIO_OUTPUT);	// Used for uart1 tx
-	gpio_pin_configure_dt(&EXTRA_1_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&EXTRA_2_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&AP22_EN_PIN, GPIO_OUTPUT);
+	pin_group_configure(&board_out, GPIO_OUTPUT);
+	pin_group_configure(&dut_io, GPIO_OUTPUT);
 	gpio_pin_configure_dt(&AP22_FLG_PIN, GPIO_INPUT);
-	gpio_pin_configure_dt(&SHUNT_BYPASS_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&SHUNT_EN_PIN, GPIO_OUTPUT);
-	gpio_pin_configure_dt(&LS_OE, GPIO_OUTPUT);
-
-	/* Set the default value of IO Pins */
-	gpio_pin_set_raw(LED1.port, LED1.pin, 0);
-	gpio_pin_set_raw(LED2.port, LED2.pin, 0);
-	gpio_pin_set_raw(LS_OE.port, LS_OE.pin, 1); 					/* Enable level shifters */
-	// gpio_pin_set_raw(SCL_PIN.port, SCL_PIN.pin, 0);
-	// gpio_pin_set_raw(SDA_PIN.port, SDA_PIN.pin, 0);
-	gpio_pin_set_raw(COMM_PIN.port, COMM_PIN.pin, 0);
-	gpio_pin_set_raw(STS_LED_PIN.port, STS_LED_PIN.pin, 0);
-	gpio_pin_set_raw(SPARE_0_PIN.port, SPARE_0_PIN.pin, 0);
-	gpio_pin_set_raw(SPARE_1_PIN.port, SPARE_1_PIN.pin, 0);
-	gpio_pin_set_raw(SPARE_3_PIN.port, SPARE_3_PIN.pin, 0);
-	gpio_pin_set_raw(DIR_PIN.port, DIR_PIN.pin, 0);
-	gpio_pin_set_raw(PLS_PIN.port, PLS_PIN.pin, 0);
-	gpio_pin_set_raw(TAMPER_PIN.port, TAMPER_PIN.pin,  0);
-	gpio_pin_set_raw(SPARE_2_PIN.port, SPARE_2_PIN.pin, 0);
-	gpio_pin_set_raw(SPARE_4_PIN.port, SPARE_4_PIN.pin, 0);
-	// gpio_pin_set_raw(TX_CON_PIN.port, TX_CON_PIN.pin, 0);	// Used for uart1 rx
-	// gpio_pin_set_raw(RX_CON_PIN.port, RX_CON_PIN.pin, 0);	// Used for uart1 tx
-	gpio_pin_set_raw(EXTRA_1_PIN.port, EXTRA_1_PIN.pin, 0);
-	gpio_pin_set_raw(EXTRA_2_PIN.port, EXTRA_2_PIN.pin, 0);
-	gpio_pin_set_raw(AP22_EN_PIN.port, AP22_EN_PIN.pin, 0);				/* Disable AP22 Power switch */
-	gpio_pin_set_raw(SHUNT_BYPASS_PIN.port, SHUNT_BYPASS_PIN.pin, 0);	/* Disable Shunt bypass path */
-	gpio_pin_set_raw(SHUNT_EN_PIN.port, SHUNT_EN_PIN.pin, 0);			/* Disable Shunt Resistor path */
 }
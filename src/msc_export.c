@@ -0,0 +1,284 @@
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_MSC_EXPORT
+
+#include "msc_export.h"
+#include "power_seq.h"
+#include "result_log.h"
+#include "sequencer.h"
+
+#include <ff.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(msc_export, LOG_LEVEL_INF);
+
+/* The mass storage class serves the same disk */
+#define MSC_EXPORT_MNT              "/" CONFIG_MASS_STORAGE_DISK_NAME ":"
+#define MSC_EXPORT_PATH_SIZE        (sizeof(MSC_EXPORT_MNT) + 13)
+#define MSC_EXPORT_LINE_SIZE        128
+
+static K_MUTEX_DEFINE(msc_export_lock);
+/* A USB host has the drive, and an export waits for it to let go */
+static atomic_t m_host_attached;
+static atomic_t m_pending;
+static FATFS m_fat;
+static struct fs_mount_t m_mnt = {
+	.type = FS_FATFS,
+	.fs_data = &m_fat,
+	.mnt_point = MSC_EXPORT_MNT,
+};
+
+/* A file being written, the first error is kept and the writes after it are skipped */
+struct msc_export_file {
+	struct fs_file_t file;
+	int err;
+};
+
+static int msc_export_open(struct msc_export_file *f, const char *name)
+{
+	char path[MSC_EXPORT_PATH_SIZE];
+
+	snprintf(path, sizeof(path), "%s/%s", MSC_EXPORT_MNT, name);
+	fs_file_t_init(&f->file);
+	f->err = fs_open(&f->file, path, FS_O_CREATE | FS_O_WRITE);
+	if (f->err == 0) {
+		f->err = fs_truncate(&f->file, 0);
+	}
+
+	return f->err;
+}
+
+static void msc_export_put(struct msc_export_file *f, const void *data, size_t len)
+{
+	ssize_t written;
+
+	if (f->err != 0) {
+		return;
+	}
+
+	written = fs_write(&f->file, data, len);
+	if (written < 0) {
+		f->err = written;
+	} else if (written != len) {
+		f->err = -ENOSPC;
+	}
+}
+
+static void msc_export_printf(struct msc_export_file *f, const char *fmt, ...)
+{
+	char line[MSC_EXPORT_LINE_SIZE];
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+
+	if (len > 0) {
+		msc_export_put(f, line, MIN((size_t)len, sizeof(line) - 1));
+	}
+}
+
+static int msc_export_close(struct msc_export_file *f)
+{
+	int err = fs_close(&f->file);
+
+	return (f->err != 0) ? f->err : err;
+}
+
+struct msc_export_results {
+	struct msc_export_file csv;
+	struct msc_export_file bin;
+};
+
+static bool msc_export_result_cb(const struct result_record *record, void *user_data)
+{
+	struct msc_export_results *ctx = user_data;
+
+	msc_export_put(&ctx->bin, record, sizeof(*record));
+
+	// Unit id in hex, 64 bit printf support is not a given
+	msc_export_printf(&ctx->csv, "%u,%08x%08x,%u,%s", record->seq, (uint32_t)(record->unit_id >> 32),
+			  (uint32_t)record->unit_id, record->timestamp, record->verdict ? "FAILED" : "PASSED");
+	for (size_t i = 0; i < MIN(record->step_count, RESULT_MAX_STEPS); i++) {
+		const struct result_step *step = &record->steps[i];
+
+		msc_export_printf(&ctx->csv, ",%s,%u,%d", seq_result_str(step->result), step->duration_ms,
+				  step->value);
+	}
+	msc_export_printf(&ctx->csv, "\r\n");
+
+	return (ctx->csv.err == 0) && (ctx->bin.err == 0);
+}
+
+static int msc_export_results(void)
+{
+	struct msc_export_results ctx;
+	uint32_t next = result_log_next_seq();
+	int err;
+	int ret;
+
+	msc_export_open(&ctx.csv, "RESULTS.CSV");
+	msc_export_open(&ctx.bin, "RESULTS.BIN");
+
+	msc_export_printf(&ctx.csv, "seq,unit_id,timestamp,verdict");
+	for (size_t i = 0; i < RESULT_MAX_STEPS; i++) {
+		unsigned int n = i;
+
+		msc_export_printf(&ctx.csv, ",step%u_result,step%u_ms,step%u_value", n, n, n);
+	}
+	msc_export_printf(&ctx.csv, "\r\n");
+
+	ret = result_log_read((next > MSC_EXPORT_MAX_RESULTS) ? (next - MSC_EXPORT_MAX_RESULTS) : 0,
+			      msc_export_result_cb, &ctx);
+
+	err = msc_export_close(&ctx.csv);
+	if (err == 0) {
+		err = msc_export_close(&ctx.bin);
+	} else {
+		(void)msc_export_close(&ctx.bin);
+	}
+
+	return (err != 0) ? err : ret;
+}
+
+static int msc_export_power_up(void)
+{
+	struct msc_export_file csv;
+	struct msc_export_file bin;
+	struct power_seq_sample sample;
+	int ret;
+
+	if (power_seq_get_sample(0, &sample) != 0) {
+		return -ENODATA;
+	}
+
+	msc_export_open(&csv, "POWERUP.CSV");
+	msc_export_open(&bin, "POWERUP.BIN");
+
+	msc_export_printf(&csv, "t_us,current_uA,rail_mV\r\n");
+	for (size_t i = 0; i < POWER_SEQ_SAMPLES; i++) {
+		if (power_seq_get_sample(i, &sample) != 0) {
+			break;
+		}
+		msc_export_put(&bin, &sample, sizeof(sample));
+		msc_export_printf(&csv, "%d,%d,%d\r\n", sample.t_us, sample.current_uA, sample.rail_mV);
+	}
+
+	ret = msc_export_close(&csv);
+	if (ret == 0) {
+		ret = msc_export_close(&bin);
+	} else {
+		(void)msc_export_close(&bin);
+	}
+
+	return ret;
+}
+
+static void msc_export_work_handler(struct k_work *work)
+{
+	int ret;
+
+	ARG_UNUSED(work);
+
+	ret = msc_export_write();
+	if (ret >= 0) {
+		LOG_INF("%d captures exported after the USB host left", ret);
+	}
+}
+
+static K_WORK_DEFINE(msc_export_work, msc_export_work_handler);
+
+/*!
+* @brief Tracks the USB host, called from the USB device status callback
+*
+* An export waiting for the host is written from the system work queue as
+* soon as it disconnects.
+*
+* @param status USB device status
+* @param param Status parameter, unused
+*/
+void msc_export_usb_status(enum usb_dc_status_code status, const uint8_t *param)
+{
+	ARG_UNUSED(param);
+
+	switch (status) {
+	case USB_DC_CONFIGURED:
+		atomic_set(&m_host_attached, 1);
+		break;
+	case USB_DC_DISCONNECTED:
+		atomic_clear(&m_host_attached);
+		if (atomic_cas(&m_pending, 1, 0)) {
+			k_work_submit(&msc_export_work);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*!
+* @brief Writes the result log and the last power up capture to the RAM disk
+*
+* The disk is mounted for the export only. While a USB host has the device
+* configured it may have the drive mounted, the export is then kept for when
+* the host disconnects. A power up capture is only written if there is one.
+*
+* @return Number of captures exported, results and power up
+* @return -EBUSY if a USB host has the drive, the export is written once it leaves
+* @return negative errno if the disk could not be mounted or a file written,
+*         the other captures are still exported
+*/
+int msc_export_write(void)
+{
+	int exported = 0;
+	int err;
+	int ret;
+
+	k_mutex_lock(&msc_export_lock, K_FOREVER);
+
+	// Checked under the lock, a disconnect meanwhile queues the work behind it
+	atomic_set(&m_pending, 1);
+	if (atomic_get(&m_host_attached)) {
+		k_mutex_unlock(&msc_export_lock);
+		LOG_INF("USB host has the drive, export deferred until it disconnects");
+		return -EBUSY;
+	}
+	atomic_clear(&m_pending);
+
+	// An empty RAM disk gets formatted by the first mount
+	ret = fs_mount(&m_mnt);
+	if (ret != 0) {
+		LOG_ERR("Could not mount %s (%d)", MSC_EXPORT_MNT, ret);
+		k_mutex_unlock(&msc_export_lock);
+		return ret;
+	}
+
+	ret = msc_export_results();
+	if (ret >= 0) {
+		exported++;
+	}
+	err = msc_export_power_up();
+	if (err == 0) {
+		exported++;
+	} else if ((err != -ENODATA) && (ret >= 0)) {
+		ret = err;
+	}
+
+	// Nothing stays cached on this side while the host owns the disk
+	(void)fs_unmount(&m_mnt);
+	k_mutex_unlock(&msc_export_lock);
+
+	if (ret < 0) {
+		LOG_ERR("Export failed (%d)", ret);
+		return ret;
+	}
+
+	return exported;
+}
+
+#endif /* CONFIG_MSC_EXPORT */
@@ -0,0 +1,43 @@
+#ifndef MSC_EXPORT_H
+#define MSC_EXPORT_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <zephyr/usb/usb_device.h>
+
+/*
+ * Test results and the last power up capture as files on the FAT RAM disk
+ * that the composite build (overlay-composite-cdc-msc.conf) exposes over USB
+ * mass storage:
+ *   RESULTS.CSV  RESULTS.BIN   last MSC_EXPORT_MAX_RESULTS result records
+ *   POWERUP.CSV  POWERUP.BIN   struct power_seq_sample per sampling
+ * The mass storage class can not tell the host the medium changed, and a host
+ * with the drive mounted keeps its own copy of the FAT. So the disk is only
+ * written while no USB host has the device configured: an export asked for
+ * meanwhile is kept and written once the host disconnects, the host sees the
+ * files when it enumerates the drive again.
+ * Without CONFIG_MSC_EXPORT the calls compile to nothing.
+ */
+
+/* Records exported, the most recent ones */
+#define MSC_EXPORT_MAX_RESULTS      200
+
+#ifdef CONFIG_MSC_EXPORT
+
+int msc_export_write(void);
+void msc_export_usb_status(enum usb_dc_status_code status, const uint8_t *param);
+
+#else
+
+static inline int msc_export_write(void)
+{
+	return -ENOTSUP;
+}
+
+static inline void msc_export_usb_status(enum usb_dc_status_code status, const uint8_t *param)
+{
+}
+
+#endif /* CONFIG_MSC_EXPORT */
+
+#endif /* MSC_EXPORT_H */
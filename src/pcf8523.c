@@ -1,47 +1,179 @@
+#define DT_DRV_COMPAT mdl_pcf8523
+
 #include "pcf8523.h"
+#include "bcd_time.h"
+#include "phase_timing.h"
 
 
 #include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/rtc.h>
 #include <zephyr/sys/timeutil.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
 #include <string.h>
+LOG_MODULE_REGISTER(pcf8523, LOG_LEVEL_INF);
+
+#define PCF8523_HAS_INT1 DT_ANY_INST_HAS_PROP_STATUS_OKAY(int1_gpios)
+
+struct pcf8523_config {
+	struct i2c_dt_spec i2c;
+#if PCF8523_HAS_INT1
+	struct gpio_dt_spec int1;
+#endif
+};
+
+struct pcf8523_data {
+	/* Shadow copy of Control_1 .. Years (0x00 - 0x09), refreshed by a single burst read */
+	uint8_t regs[PCF8523_CACHE_SIZE];
+	bool cache_valid;
+	const struct device *dev;
+	struct k_mutex lock;
+	/* Tmr_CLKOUT_ctrl is outside the burst, kept here instead */
+	uint8_t tmr_clkout;
+	uint8_t wd_count;		/* watchdog reload value */
+	pcf8523_timer_cb_t timer_cb[PCF8523_TIMER_COUNT];
+	void *timer_user_data[PCF8523_TIMER_COUNT];
+	/* Asynchronous refresh, one at a time; the shadow copy is only updated once it completes */
+	atomic_t async_busy;
+	uint8_t async_regs[PCF8523_CACHE_SIZE];
+	uint8_t async_reg_add;
+	struct i2c_msg async_msgs[2];
+	struct k_work async_work;	/* blocking read, for controllers without a callback API */
+	struct k_work async_done_work;	/* merges the read into the shadow copy under the lock */
+	int async_result;
+	uint16_t async_dirty;		/* shadow registers written since the read started, newer than it */
+	pcf8523_read_cb_t async_cb;
+	void *async_user_data;
+	uint32_t async_start;
+#if PCF8523_HAS_INT1
+	struct gpio_callback int1_cb;
+	struct k_work int1_work;
+	uint32_t int1_cycles;		/* k_cycle_get_32() at the last INT1 edge */
+#endif
+#ifdef CONFIG_RTC_ALARM
+	rtc_alarm_callback alarm_cb;
+	void *alarm_user_data;
+#endif
+#ifdef CONFIG_RTC_UPDATE
+	rtc_update_callback update_cb;
+	void *update_user_data;
+#endif
+};
 
 /*!
-* @brief Initialize/Configure i2C controller and RTC module
+* @brief Refreshes the shadow registers with one burst read of control, status and time
 *
-* @param dev Pointer to the device structure for an I2C controller
-* driver configured in master mode.
+* All the helpers touching the shadow registers take the driver lock, it
+* nests so they can be called from each other and from the lock holders.
 *
-* @return 0 if succesful
-* @return 1 if i2c controller is not ready
+* @param dev Pointer to the PCF8523 device structure
+*
+* @return 0 if successful
+* @return 1 if the I2C transaction failed
+*
+*/
+uint32_t pcf8523_refresh(const struct device *dev){
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+	uint32_t start;
+	int err;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	start = phase_timing_begin();
+	err = i2c_burst_read_dt(&config->i2c, PCF8523_CONTROL_1_ADD, data->regs, sizeof(data->regs));
+	phase_timing_end(PHASE_I2C, start);
+	if(err){
+		data->cache_valid = false;
+		k_mutex_unlock(&data->lock);
+		return 1;
+	}
+
+	data->async_dirty = BIT_MASK(PCF8523_CACHE_SIZE);
+	data->cache_valid = true;
+	k_mutex_unlock(&data->lock);
+	return 0;
+}
+
+/*!
+* @brief Returns a register from the shadow copy, reading the chip only if the cache is empty
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param reg Register address, PCF8523_CONTROL_1_ADD .. PCF8523_YEARS_ADD
+*
+* @return Register value, 0 if it could not be read
 *
 */
-uint32_t pcf8523_init(const struct device *dev){
-	uint8_t i2c_buff[7] = {0};
+uint8_t pcf8523_read_reg_cached(const struct device *dev, uint8_t reg){
+	struct pcf8523_data *data = dev->data;
+	uint8_t val;
 
-	// Configure I2C peripheral
-	i2c_configure(dev, I2C_SPEED_SET(I2C_SPEED_STANDARD));
+	if(reg >= PCF8523_CACHE_SIZE)
+		return 0;
 
-	if(!device_is_ready(dev)){ 
-		printk("Coud not get i2c device binding\n");
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if(!data->cache_valid)
+		pcf8523_refresh(dev);
+	val = data->regs[reg];
+	k_mutex_unlock(&data->lock);
+
+	return val;
+}
+
+/*!
+* @brief Writes a register and keeps the shadow copy in sync, skipping the write if the value is unchanged
+*
+* Registers the chip changes on its own (PCF8523_VOLATILE_REGS) are always
+* written, the shadow copy may be behind them. Control_2 flags written as 1
+* are left as they are by the chip, the shadow copy holds them as clear.
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param reg Register address, only PCF8523_CONTROL_1_ADD .. PCF8523_YEARS_ADD are mirrored
+* @param val Value to write
+*
+* @return 0 if successful
+* @return 1 if the I2C transaction failed
+*
+*/
+uint32_t pcf8523_write_reg(const struct device *dev, uint8_t reg, uint8_t val){
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+	uint32_t start;
+	int err;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if(data->cache_valid && (reg < PCF8523_CACHE_SIZE) && !(PCF8523_VOLATILE_REGS & BIT(reg)) &&
+	   (data->regs[reg] == val)){
+		k_mutex_unlock(&data->lock);
+		return 0;
+	}
+
+	start = phase_timing_begin();
+	err = i2c_reg_write_byte_dt(&config->i2c, reg, val);
+	phase_timing_end(PHASE_I2C, start);
+	if(err){
+		k_mutex_unlock(&data->lock);
 		return 1;
 	}
 
-	// Set pointer to the Control_3 register and write the switchover functionality. leave the rest to default values
-	i2c_buff[0] = PCF8523_CONTROL_3_ADD; // Control_3 Register (Address 02h)
-	if(pcf8523_switchover_occurred(dev))
-		// if switchover ocurred do not clear the flag yet
-		i2c_buff[1] = PCF8523_CTRL3_SO_MODE_4_MASK|PCF8523_CTRL3_BSF_MASK; // battery switch-over function is enabled in standard mode;battery low detection function is disabled*/
-	else
-		i2c_buff[1] = PCF8523_CTRL3_SO_MODE_4_MASK; // battery switch-over function is enabled in standard mode;battery low detection function is disabled*/
-	i2c_write(dev, i2c_buff, 2, PCF8523_SLAVE_ADD);
+	if(reg == PCF8523_CONTROL_2_ADD)
+		val &= ~PCF8523_CTRL2_FLAGS_MASK;
+	if(reg < PCF8523_CACHE_SIZE){
+		data->regs[reg] = val;
+		data->async_dirty |= BIT(reg);
+	}
+	k_mutex_unlock(&data->lock);
+
 	return 0;
 }
 
 /*!
 * @brief Checks if the switch-over flag is set and returns its state
 *
-* @param dev Pointer to the device structure for an I2C controller
-* driver configured in master mode.
+* @param dev Pointer to the PCF8523 device structure
+*
+* No I2C transaction is done, the flag comes from the shadow registers as of
+* the last pcf8523_init() or time read.
 *
 * @return 0 if no switch-over event occured
 * @return 1 if a sitch-over event occurred
@@ -49,13 +181,10 @@ uint32_t pcf8523_init(const struct device *dev){
 */
 uint32_t pcf8523_switchover_occurred(const struct device *dev){
 	
-	uint8_t i2c_buff[7] = {0};
 	uint8_t switch_over = 0;
 
-	i2c_buff[0] = PCF8523_CONTROL_3_ADD; // Register Control_3 (Address 02h)
-	i2c_write_read(dev, PCF8523_SLAVE_ADD, i2c_buff, 1, &i2c_buff[1], 1);
-
-	switch_over = i2c_buff[1] & PCF8523_CTRL3_BSF_MASK; // Get BSF flag state
+	// Control_3 comes from the shadow registers, refreshed by the last time read, read under the lock
+	switch_over = pcf8523_read_reg_cached(dev, PCF8523_CONTROL_3_ADD) & PCF8523_CTRL3_BSF_MASK; // Get BSF flag state
 
 	if(switch_over)
 		return true;// Switch-over event occurred
@@ -63,33 +192,10 @@ uint32_t pcf8523_switchover_occurred(const struct device *dev){
 		return false;// No switch-over event occurred
 }
 
-/*
- * Function from https://stackoverflow.com/questions/19377396/c-get-day-of-year-from-date
- */
-static int yisleap(int year)
-{
-	return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-}
-
-/*
- * Function from https://stackoverflow.com/questions/19377396/c-get-day-of-year-from-date
- */
-static int get_yday(int mon, int day, int year)
-{
-	static const int days[2][12] = {
-		{0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334},
-		{0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335}};
-	int leap = yisleap(year);
-
-	/* Minus 1 since gmtime starts from 0 */
-	return days[leap][mon] + day - 1;
-}
-
 /*!
 * @brief Writes date and time to RTC.
 *
-* @param dev Pointer to the device structure for an I2C controller
-* driver configured in master mode.
+* @param dev Pointer to the PCF8523 device structure
 * @param ts Pointer to the time in seconds since January 01 1970 (UTC)
 *
 * @return 0 if successful
@@ -97,41 +203,34 @@ static int get_yday(int mon, int day, int year)
 *
 */
 uint32_t pcf8523_set_time(const struct device *dev, int64_t *ts){
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+	uint8_t i2c_buff[BCD_TIME_REGS];
+	uint32_t start;
+	int err;
 
-	uint8_t i2c_buff[7] = {0};
-
-	/* Convert time to struct tm */
-	struct tm *tm_p= gmtime(ts);
-	struct tm time = {0};
-
-	if (tm_p != NULL){
-		memcpy(&time, tm_p, sizeof(struct tm));
-	}
-	else{	// Unable to convert to broken down UTC
+	// Seconds .. Years straight from the epoch, 24 hour format
+	if(bcd_time_from_epoch(*ts, i2c_buff))
 		return 1;
-	}
-
-	// Set pointer to the seconds register and write the time and date
-	i2c_buff[0] = PCF8523_SECONDS_MASK & (((time.tm_sec/10) << PCF8523_BCD_UPPER_SHIFT) + (time.tm_sec%10));	// Number of seconds in BCD
-	i2c_buff[1] = PCF8523_MINUTES_MASK & (((time.tm_min/10) << PCF8523_BCD_UPPER_SHIFT) + (time.tm_min%10));	// Number of minutes in BCD
-	i2c_buff[2] = PCF8523_HOURS_MASK & (((time.tm_hour/10) << PCF8523_BCD_UPPER_SHIFT) + (time.tm_hour%10));	// Number of hours in BCD - 24hr format
-	i2c_buff[3] = PCF8523_DAYS_MASK & (((time.tm_mday/10) << PCF8523_BCD_UPPER_SHIFT) + (time.tm_mday%10));		// Day of the month
-	i2c_buff[4] = PCF8523_WEEKDAYS_MASK & time.tm_wday;															// Day of the week Since Sunday
-	i2c_buff[5] = PCF8523_MONTHS_MASK & (((time.tm_mon/10) << PCF8523_BCD_UPPER_SHIFT) + (time.tm_mon%10));		// Day of the month
-	uint8_t year = time.tm_year%100;
-	i2c_buff[6] = ((year / 10) << PCF8523_BCD_UPPER_SHIFT) + (year % 10); // year
 
-	// Send data through I2C
-	i2c_burst_write(dev, PCF8523_SLAVE_ADD, PCF8523_SECONDS_ADD, i2c_buff, sizeof(i2c_buff));
+	// Send data through I2C, the shadow copy follows under the same lock
+	k_mutex_lock(&data->lock, K_FOREVER);
+	start = phase_timing_begin();
+	err = i2c_burst_write_dt(&config->i2c, PCF8523_SECONDS_ADD, i2c_buff, sizeof(i2c_buff));
+	phase_timing_end(PHASE_I2C, start);
+	if(!err){
+		memcpy(&data->regs[PCF8523_SECONDS_ADD], i2c_buff, sizeof(i2c_buff));
+		data->async_dirty |= BIT_MASK(sizeof(i2c_buff)) << PCF8523_SECONDS_ADD;
+	}
+	k_mutex_unlock(&data->lock);
 
-	return 0;
+	return err ? 1 : 0;
 }
 
 /*!
 * @brief Reads date and time from RTC in Unix Epoch (seconds since January 01 1970 (UTC)).
 *
-* @param dev Pointer to the device structure for an I2C controller
-* driver configured in master mode.
+* @param dev Pointer to the PCF8523 device structure
 * @param ts Pointer where the amounts of seconds since January 01 1970 (UTC) will be stored
 *
 * @return 0 if successful
@@ -140,33 +239,22 @@ uint32_t pcf8523_set_time(const struct device *dev, int64_t *ts){
 */
 uint32_t pcf8523_get_time(const struct device *dev, int64_t *ts){
 
-	uint8_t i2c_buff[7] = {0};
-	struct tm time = {0};
+	struct pcf8523_data *data = dev->data;
+	uint32_t err = 1;
 
-	// Read data from I2C
-	i2c_burst_read(dev, PCF8523_SLAVE_ADD, PCF8523_SECONDS_ADD, i2c_buff, sizeof(i2c_buff));
+	// Control, status and time in one burst, decoded before anything else updates them
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if((pcf8523_refresh(dev) == 0) && (bcd_time_to_epoch(&data->regs[PCF8523_SECONDS_ADD], ts) == 0))
+		err = 0;
+	k_mutex_unlock(&data->lock);
 
-	
-	time.tm_sec = (i2c_buff[0] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[0] & PCF8523_BCD_UPPER_MASK_SEC) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get seconds */
-	time.tm_min = (i2c_buff[1] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[1] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get minutes */
-	time.tm_hour = (i2c_buff[2] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[2] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get hours */
-	time.tm_mday = (i2c_buff[3] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[3] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get days */
-	time.tm_wday = (i2c_buff[4] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[4] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get weekdays */
-	time.tm_mon = (i2c_buff[5] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[5] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get month */
-	time.tm_year = (i2c_buff[6] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[6] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10) + 100;/* Get year with offset of 100 since we're in 2000+ */
-	time.tm_yday = get_yday(time.tm_mon, time.tm_mday, time.tm_year + 1900);/* Get day number in year */
-	time.tm_isdst = 0;/* DST not used  */
-
-	*ts = timeutil_timegm64(&time);
-
-	return 0;
+	return err;
 }
 
 /*!
 * @brief Reads date and time from RTC in time struct tm.
 *
-* @param dev Pointer to the device structure for an I2C controller
-* driver configured in master mode.
+* @param dev Pointer to the PCF8523 device structure
 * @param time Pointer to the tm struct
 *
 * @return 0 if successful
@@ -175,86 +263,838 @@ uint32_t pcf8523_get_time(const struct device *dev, int64_t *ts){
 */
 uint32_t pcf8523_get_time_tm(const struct device *dev, struct tm *time){
 
-	uint8_t i2c_buff[7] = {0};
+	struct pcf8523_data *data = dev->data;
+	uint32_t err = 1;
 
-	// Read data from I2C
-	i2c_burst_read(dev, PCF8523_SLAVE_ADD, PCF8523_SECONDS_ADD, i2c_buff, sizeof(i2c_buff));
+	// Control, status and time in one burst, decoded before anything else updates them
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if((pcf8523_refresh(dev) == 0) && (bcd_time_to_tm(&data->regs[PCF8523_SECONDS_ADD], time) == 0))
+		err = 0;
+	k_mutex_unlock(&data->lock);
 
-	
-	time->tm_sec = (i2c_buff[0] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[0] & PCF8523_BCD_UPPER_MASK_SEC) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get seconds */
-	time->tm_min = (i2c_buff[1] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[1] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get minutes */
-	time->tm_hour = (i2c_buff[2] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[2] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get hours */
-	time->tm_mday = (i2c_buff[3] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[3] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get days */
-	time->tm_wday = (i2c_buff[4] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[4] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get weekdays */
-	time->tm_mon = (i2c_buff[5] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[5] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10);/* Get month */
-	time->tm_year = (i2c_buff[6] & PCF8523_BCD_LOWER_MASK) + (((i2c_buff[6] & PCF8523_BCD_UPPER_MASK) >> PCF8523_BCD_UPPER_SHIFT) * 10) + 100;/* Get year with offset of 100 since we're in 2000+ */
-	time->tm_yday = get_yday(time->tm_mon, time->tm_mday, time->tm_year + 1900);/* Get day number in year */
-	time->tm_isdst = 0;/* DST not used  */
+	return err;
+}
 
-	return 0;
+/*!
+* @brief Decodes the time held by the shadow registers, no I2C transaction is done
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param ts Pointer where the amounts of seconds since January 01 1970 (UTC) will be stored
+*
+* @return 0 if successful
+* @return 1 if the shadow registers are empty or hold an invalid time
+*
+*/
+uint32_t pcf8523_get_time_cached(const struct device *dev, int64_t *ts){
+
+	struct pcf8523_data *data = dev->data;
+	uint32_t err = 1;
+
+	// Not torn by a background refresh completing meanwhile
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if(data->cache_valid && (bcd_time_to_epoch(&data->regs[PCF8523_SECONDS_ADD], ts) == 0))
+		err = 0;
+	k_mutex_unlock(&data->lock);
+
+	return err;
 }
 
-void convert_time_ascii(struct tm *time, char *tstr, char *dstr){
+/* End of the burst read, from the I2C interrupt: the shadow copy is only touched under the lock */
+static void pcf8523_refresh_done(const struct device *i2c_dev, int result, void *user_data)
+{
+	const struct device *dev = user_data;
+	struct pcf8523_data *data = dev->data;
 
-	int qty=0;
-	
-	qty += u8_to_dec(tstr, 3, (uint8_t)time->tm_hour);
-	if(time->tm_hour < 10){
-		tstr[qty] = tstr[qty-1];
-		tstr[qty-1] = '0';
-		tstr[qty+1] = ':';
-		qty += 2;
+	ARG_UNUSED(i2c_dev);
+
+	data->async_result = result;
+	k_work_submit(&data->async_done_work);
+}
+
+static void pcf8523_refresh_done_work_handler(struct k_work *work)
+{
+	struct pcf8523_data *data = CONTAINER_OF(work, struct pcf8523_data, async_done_work);
+	const struct device *dev = data->dev;
+	pcf8523_read_cb_t cb = data->async_cb;
+	void *cb_user_data = data->async_user_data;
+	int result = data->async_result;
+
+	phase_timing_end(PHASE_I2C, data->async_start);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if(result == 0){
+		// Registers written meanwhile keep their newer value
+		for(int reg = 0; reg < PCF8523_CACHE_SIZE; reg++){
+			if(!(data->async_dirty & BIT(reg)) || !data->cache_valid)
+				data->regs[reg] = data->async_regs[reg];
+		}
+		data->cache_valid = true;
 	}else{
-		tstr[qty] = ':';
-		qty++;
+		data->cache_valid = false;
+		result = -EIO;
 	}
-	qty += u8_to_dec(&tstr[qty], 3, (uint8_t)time->tm_min);
-	if(time->tm_min < 10){
-		tstr[qty] = tstr[qty-1];
-		tstr[qty-1] = '0';
-		tstr[qty+1] = ':';
-		qty += 2;
-	}else{
-		tstr[qty] = ':';
-		qty++;
+	k_mutex_unlock(&data->lock);
+
+	// Free before the callback, it may start the next refresh
+	atomic_clear(&data->async_busy);
+	if(cb)
+		cb(dev, result, cb_user_data);
+}
+
+static void pcf8523_refresh_work_handler(struct k_work *work)
+{
+	struct pcf8523_data *data = CONTAINER_OF(work, struct pcf8523_data, async_work);
+	const struct pcf8523_config *config = data->dev->config;
+
+	data->async_result = i2c_burst_read_dt(&config->i2c, PCF8523_CONTROL_1_ADD, data->async_regs,
+					       sizeof(data->async_regs));
+	pcf8523_refresh_done_work_handler(&data->async_done_work);
+}
+
+/*!
+* @brief Refreshes the shadow registers in the background, as pcf8523_refresh() does
+*
+* The burst read is queued on the I2C controller and the caller goes on.
+* Controllers without the callback API do the read from the system work
+* queue instead. The result is merged into the shadow copy from the system
+* work queue, under the driver lock; registers written since the read
+* started keep their newer value. Once it completes, pcf8523_get_time_cached()
+* and pcf8523_read_reg_cached() give the time and the status without
+* another transaction.
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param cb Called when the read completed, from the system work queue; may be NULL
+* @param user_data Passed to cb
+*
+* @return 0 if the read was started, cb gets 0 or -EIO
+* @return -EBUSY if a refresh is already running
+*
+*/
+int pcf8523_refresh_async(const struct device *dev, pcf8523_read_cb_t cb, void *user_data){
+	struct pcf8523_data *data = dev->data;
+
+	if(!atomic_cas(&data->async_busy, 0, 1))
+		return -EBUSY;
+
+	data->async_cb = cb;
+	data->async_user_data = user_data;
+	k_mutex_lock(&data->lock, K_FOREVER);
+	data->async_dirty = 0;
+	k_mutex_unlock(&data->lock);
+	data->async_start = phase_timing_begin();
+
+#ifdef CONFIG_I2C_CALLBACK
+	const struct pcf8523_config *config = dev->config;
+	int err;
+
+	// Register address then the burst, with a repeated start as i2c_burst_read() does
+	data->async_reg_add = PCF8523_CONTROL_1_ADD;
+	data->async_msgs[0].buf = &data->async_reg_add;
+	data->async_msgs[0].len = 1;
+	data->async_msgs[0].flags = I2C_MSG_WRITE;
+	data->async_msgs[1].buf = data->async_regs;
+	data->async_msgs[1].len = sizeof(data->async_regs);
+	data->async_msgs[1].flags = I2C_MSG_RESTART | I2C_MSG_READ | I2C_MSG_STOP;
+
+	err = i2c_transfer_cb_dt(&config->i2c, data->async_msgs, ARRAY_SIZE(data->async_msgs),
+				 pcf8523_refresh_done, (void *)dev);
+	if(err != -ENOSYS){
+		if(err)
+			pcf8523_refresh_done(config->i2c.bus, err, (void *)dev);
+		return 0;
 	}
-	qty += u8_to_dec(&tstr[qty], 3, (uint8_t)time->tm_sec);
-	if(time->tm_sec < 10){
-		tstr[qty] = tstr[qty-1];
-		tstr[qty-1] = '0';
+#endif
+
+	k_work_submit(&data->async_work);
+	return 0;
+}
+
+static void pcf8523_refresh_signal_cb(const struct device *dev, int err, void *user_data)
+{
+	ARG_UNUSED(dev);
+
+	k_poll_signal_raise(user_data, err);
+}
+
+/*!
+* @brief Refreshes the shadow registers in the background and raises a poll signal when done
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param signal Raised with 0 or -EIO as result, k_poll() on it or check it later
+*
+* @return 0 if the read was started
+* @return -EBUSY if a refresh is already running
+*
+*/
+int pcf8523_refresh_signal(const struct device *dev, struct k_poll_signal *signal){
+
+	k_poll_signal_reset(signal);
+
+	return pcf8523_refresh_async(dev, pcf8523_refresh_signal_cb, signal);
+}
+
+/* Registers and bits of each timer; timer A and the watchdog share the TAC field */
+static const struct {
+	uint8_t freq_reg;
+	uint8_t value_reg;
+	uint8_t enable_mask;	/* field in Tmr_CLKOUT_ctrl */
+	uint8_t enable;		/* value of that field while running */
+	uint8_t ie_mask;	/* interrupt enable in Control_2 */
+	uint8_t flag_mask;	/* interrupt flag in Control_2 */
+} pcf8523_timers[PCF8523_TIMER_COUNT] = {
+	[PCF8523_TIMER_A] = {PCF8523_TMR_A_FREQ_CTRL_ADD, PCF8523_TMR_A_REG_ADD, PCF8523_TMR_TAC_MASK,
+			     PCF8523_TMR_TAC_COUNTDOWN, PCF8523_CTRL2_CTAIE_MASK, PCF8523_CTRL2_CTAF_MASK},
+	[PCF8523_TIMER_B] = {PCF8523_TMR_B_FREQ_CTRL_ADD, PCF8523_TMR_B_REG_ADD, PCF8523_TMR_TBC_MASK,
+			     PCF8523_TMR_TBC_MASK, PCF8523_CTRL2_CTBIE_MASK, PCF8523_CTRL2_CTBF_MASK},
+	[PCF8523_WATCHDOG] = {PCF8523_TMR_A_FREQ_CTRL_ADD, PCF8523_TMR_A_REG_ADD, PCF8523_TMR_TAC_MASK,
+			      PCF8523_TMR_TAC_WATCHDOG, PCF8523_CTRL2_WTAIE_MASK, PCF8523_CTRL2_WTAF_MASK},
+};
+
+/* Source clocks from the finest, as frequency num/den in Hz */
+static const struct {
+	enum pcf8523_timer_clk clk;
+	uint32_t num;
+	uint32_t den;
+} pcf8523_timer_clks[] = {
+	{PCF8523_TMR_CLK_4096HZ, 4096, 1},
+	{PCF8523_TMR_CLK_64HZ, 64, 1},
+	{PCF8523_TMR_CLK_1HZ, 1, 1},
+	{PCF8523_TMR_CLK_1_60HZ, 1, 60},
+	{PCF8523_TMR_CLK_1_3600HZ, 1, 3600},
+};
+
+/* Timer callbacks need the INT1 line, or someone polling pcf8523_service_flags() */
+static bool pcf8523_int1_wired(const struct device *dev)
+{
+#if PCF8523_HAS_INT1
+	const struct pcf8523_config *config = dev->config;
+
+	return config->int1.port != NULL;
+#else
+	ARG_UNUSED(dev);
+
+	return false;
+#endif
+}
+
+/* Control_2 value enabling/disabling an interrupt and clearing its flag, other flags written as 1 to keep them */
+static uint8_t pcf8523_control_2_for(const struct device *dev, enum pcf8523_timer timer, bool enable)
+{
+	uint8_t control_2 = pcf8523_read_reg_cached(dev, PCF8523_CONTROL_2_ADD) | PCF8523_CTRL2_FLAGS_MASK;
+
+	control_2 &= ~pcf8523_timers[timer].flag_mask;
+	if(enable)
+		control_2 |= pcf8523_timers[timer].ie_mask;
+	else
+		control_2 &= ~pcf8523_timers[timer].ie_mask;
+
+	return control_2;
+}
+
+/*!
+* @brief Starts a countdown timer or the watchdog; countdown timers reload and fire every period
+*
+* The first period can be up to one source clock period short, as the
+* prescaler is not reset. Starting timer A stops the watchdog and the other
+* way round.
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param timer PCF8523_TIMER_A, PCF8523_TIMER_B or PCF8523_WATCHDOG
+* @param clk Source clock
+* @param count Periods of the source clock, 1 to 255
+* @param cb Called when the timer fires, may be NULL
+* @param user_data Passed to cb
+*
+* @return 0 if successful
+* @return -EINVAL if an argument is out of range
+* @return -ENOTSUP if cb is given but there is no INT1 line
+* @return -EIO if the RTC did not answer
+*
+*/
+int pcf8523_timer_start(const struct device *dev, enum pcf8523_timer timer, enum pcf8523_timer_clk clk,
+			uint8_t count, pcf8523_timer_cb_t cb, void *user_data){
+	struct pcf8523_data *data = dev->data;
+	uint8_t tmr;
+	uint32_t err = 0;
+
+	if((timer >= PCF8523_TIMER_COUNT) || (clk > PCF8523_TMR_CLK_1_3600HZ) || (count == 0))
+		return -EINVAL;
+	if((cb != NULL) && !pcf8523_int1_wired(dev))
+		return -ENOTSUP;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	// Timer A and the watchdog are the same counter
+	if(timer != PCF8523_TIMER_B){
+		enum pcf8523_timer other = (timer == PCF8523_TIMER_A) ? PCF8523_WATCHDOG : PCF8523_TIMER_A;
+
+		data->timer_cb[other] = NULL;
+		err |= pcf8523_write_reg(dev, PCF8523_CONTROL_2_ADD, pcf8523_control_2_for(dev, other, false));
 	}
-	qty++;
-	tstr[qty] = 0;
-
-	// Convert date to str
-	qty=0;
-	qty += u8_to_dec(dstr, 3, (uint8_t)time->tm_mday);
-	if(time->tm_mday < 10){
-		dstr[qty] = dstr[qty-1];
-		dstr[qty-1] = '0';
-		dstr[qty+1] = '/';
-		qty += 2;
-	}else{
-		dstr[qty] = '/';
-		qty++;
+
+	// Stopped while it is loaded, so the new value takes effect at once
+	tmr = data->tmr_clkout & ~pcf8523_timers[timer].enable_mask;
+	err |= pcf8523_write_reg(dev, PCF8523_TMR_CLKOUT_CTRL_ADD, tmr);
+	err |= pcf8523_write_reg(dev, pcf8523_timers[timer].freq_reg, clk);
+	err |= pcf8523_write_reg(dev, pcf8523_timers[timer].value_reg, count);
+
+	data->timer_cb[timer] = cb;
+	data->timer_user_data[timer] = user_data;
+	if(timer == PCF8523_WATCHDOG)
+		data->wd_count = count;
+
+	// A flag left from an earlier run would fire straight away
+	err |= pcf8523_refresh(dev);
+	err |= pcf8523_write_reg(dev, PCF8523_CONTROL_2_ADD, pcf8523_control_2_for(dev, timer, true));
+
+	tmr |= pcf8523_timers[timer].enable;
+	err |= pcf8523_write_reg(dev, PCF8523_TMR_CLKOUT_CTRL_ADD, tmr);
+	data->tmr_clkout = tmr;
+
+	k_mutex_unlock(&data->lock);
+
+	return err ? -EIO : 0;
+}
+
+/*!
+* @brief Starts a timer for a period in milliseconds, using the finest source clock that can count it
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param timer PCF8523_TIMER_A, PCF8523_TIMER_B or PCF8523_WATCHDOG
+* @param ms Period, rounded to the source clock (1/4096 s up to 62 ms, 1/64 s up to 3.98 s, ...)
+* @param cb Called when the timer fires, may be NULL
+* @param user_data Passed to cb
+*
+* @return 0 if successful
+* @return -EINVAL if ms is 0
+* @return -ERANGE if ms is over 255 hours
+* @return -ENOTSUP if cb is given but there is no INT1 line
+* @return -EIO if the RTC did not answer
+*
+*/
+int pcf8523_timer_start_ms(const struct device *dev, enum pcf8523_timer timer, uint32_t ms,
+			   pcf8523_timer_cb_t cb, void *user_data){
+	if(ms == 0)
+		return -EINVAL;
+
+	for(size_t i = 0; i < ARRAY_SIZE(pcf8523_timer_clks); i++){
+		uint64_t den = 1000ULL * pcf8523_timer_clks[i].den;
+		uint64_t count = ((uint64_t)ms * pcf8523_timer_clks[i].num + (den / 2)) / den;
+
+		if((count >= 1) && (count <= UINT8_MAX))
+			return pcf8523_timer_start(dev, timer, pcf8523_timer_clks[i].clk, (uint8_t)count,
+						   cb, user_data);
 	}
-	qty += u8_to_dec(&dstr[qty], 3, (uint8_t)time->tm_mon + 1);
-	if((time->tm_mon+1) < 10){
-		dstr[qty] = dstr[qty-1];
-		dstr[qty-1] = '0';
-		dstr[qty+1] = '/';
-		qty += 2;
-	}else{
-		dstr[qty] = '/';
-		qty++;
+
+	return -ERANGE;
+}
+
+/*!
+* @brief Stops a timer, disables its interrupt and clears its flag
+*
+* @param dev Pointer to the PCF8523 device structure
+* @param timer PCF8523_TIMER_A, PCF8523_TIMER_B or PCF8523_WATCHDOG
+*
+* @return 0 if successful
+* @return -EINVAL if timer is out of range
+* @return -EIO if the RTC did not answer
+*
+*/
+int pcf8523_timer_stop(const struct device *dev, enum pcf8523_timer timer){
+	struct pcf8523_data *data = dev->data;
+	uint8_t tmr;
+	uint32_t err = 0;
+
+	if(timer >= PCF8523_TIMER_COUNT)
+		return -EINVAL;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	// Leave the shared TAC field alone if the other mode owns it
+	tmr = data->tmr_clkout;
+	if((tmr & pcf8523_timers[timer].enable_mask) == pcf8523_timers[timer].enable)
+		tmr &= ~pcf8523_timers[timer].enable_mask;
+	err |= pcf8523_write_reg(dev, PCF8523_TMR_CLKOUT_CTRL_ADD, tmr);
+	data->tmr_clkout = tmr;
+
+	err |= pcf8523_write_reg(dev, PCF8523_CONTROL_2_ADD, pcf8523_control_2_for(dev, timer, false));
+	data->timer_cb[timer] = NULL;
+
+	k_mutex_unlock(&data->lock);
+
+	return err ? -EIO : 0;
+}
+
+/*!
+* @brief Reloads the watchdog before it runs out
+*
+* @param dev Pointer to the PCF8523 device structure
+*
+* @return 0 if successful
+* @return -EINVAL if the watchdog is not running
+* @return -EIO if the RTC did not answer
+*
+*/
+int pcf8523_watchdog_kick(const struct device *dev){
+	struct pcf8523_data *data = dev->data;
+	uint32_t err;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	if((data->tmr_clkout & PCF8523_TMR_TAC_MASK) != PCF8523_TMR_TAC_WATCHDOG){
+		k_mutex_unlock(&data->lock);
+		return -EINVAL;
+	}
+	err = pcf8523_write_reg(dev, PCF8523_TMR_A_REG_ADD, data->wd_count);
+
+	k_mutex_unlock(&data->lock);
+
+	return err ? -EIO : 0;
+}
+
+/*!
+* @brief Reads and clears the interrupt flags, then calls the alarm, update and timer callbacks
+*
+* Called from the INT1 work item; without an INT1 line it can be polled.
+* WTAF clears on the read itself, the others are written back as 0.
+*
+* @param dev Pointer to the PCF8523 device structure
+*
+* @return Control_2 flags that were set (PCF8523_CTRL2_*F_MASK)
+* @return -EIO if the RTC did not answer
+*
+*/
+int pcf8523_service_flags(const struct device *dev){
+	struct pcf8523_data *data = dev->data;
+	pcf8523_timer_cb_t timer_cb[PCF8523_TIMER_COUNT];
+	void *timer_user_data[PCF8523_TIMER_COUNT];
+	uint8_t control_2;
+	uint8_t flags;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	if(pcf8523_refresh(dev)){
+		k_mutex_unlock(&data->lock);
+		return -EIO;
+	}
+
+	control_2 = data->regs[PCF8523_CONTROL_2_ADD];
+	flags = control_2 & (PCF8523_CTRL2_FLAGS_MASK | PCF8523_CTRL2_WTAF_MASK);
+	if(flags & PCF8523_CTRL2_FLAGS_MASK)
+		pcf8523_write_reg(dev, PCF8523_CONTROL_2_ADD,
+				  (control_2 | PCF8523_CTRL2_FLAGS_MASK) & ~(flags & PCF8523_CTRL2_FLAGS_MASK));
+
+	// Callbacks run unlocked, they may well restart their timer
+	memcpy(timer_cb, data->timer_cb, sizeof(timer_cb));
+	memcpy(timer_user_data, data->timer_user_data, sizeof(timer_user_data));
+
+	k_mutex_unlock(&data->lock);
+
+#ifdef CONFIG_RTC_ALARM
+	if((flags & PCF8523_CTRL2_AF_MASK) && data->alarm_cb)
+		data->alarm_cb(dev, 0, data->alarm_user_data);
+#endif
+#ifdef CONFIG_RTC_UPDATE
+	if((flags & PCF8523_CTRL2_SF_MASK) && data->update_cb)
+		data->update_cb(dev, data->update_user_data);
+#endif
+	for(int i = 0; i < PCF8523_TIMER_COUNT; i++){
+		if((flags & pcf8523_timers[i].flag_mask) && timer_cb[i])
+			timer_cb[i](dev, (enum pcf8523_timer)i, timer_user_data[i]);
+	}
+
+	return flags;
+}
+
+/* Zephyr RTC API */
+
+static int pcf8523_rtc_set_time(const struct device *dev, const struct rtc_time *timeptr)
+{
+	struct pcf8523_data *data = dev->data;
+	int64_t ts;
+	uint32_t err;
+
+	if(timeptr == NULL)
+		return -EINVAL;
+
+	ts = timeutil_timegm64(rtc_time_to_tm((struct rtc_time *)timeptr));
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	err = pcf8523_set_time(dev, &ts);
+	k_mutex_unlock(&data->lock);
+
+	return err ? -EIO : 0;
+}
+
+static int pcf8523_rtc_get_time(const struct device *dev, struct rtc_time *timeptr)
+{
+	struct pcf8523_data *data = dev->data;
+	uint32_t err;
+
+	if(timeptr == NULL)
+		return -EINVAL;
+
+	memset(timeptr, 0, sizeof(*timeptr));
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	err = pcf8523_get_time_tm(dev, rtc_time_to_tm(timeptr));
+	k_mutex_unlock(&data->lock);
+
+	if(err)
+		return -EIO;
+
+	// Oscillator stopped at some point, the time is not reliable until it is set again
+	if(data->regs[PCF8523_SECONDS_ADD] & PCF8523_SECONDS_OS)
+		return -ENODATA;
+
+	return 0;
+}
+
+#ifdef CONFIG_RTC_ALARM
+
+#define PCF8523_ALARM_FIELDS	(RTC_ALARM_TIME_MASK_MINUTE | RTC_ALARM_TIME_MASK_HOUR | \
+				 RTC_ALARM_TIME_MASK_MONTHDAY | RTC_ALARM_TIME_MASK_WEEKDAY)
+
+static int pcf8523_alarm_get_supported_fields(const struct device *dev, uint16_t id, uint16_t *mask)
+{
+	ARG_UNUSED(dev);
+
+	if(id != 0)
+		return -EINVAL;
+
+	*mask = PCF8523_ALARM_FIELDS;
+	return 0;
+}
+
+static int pcf8523_alarm_set_time(const struct device *dev, uint16_t id, uint16_t mask,
+				  const struct rtc_time *timeptr)
+{
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+	uint8_t alarm[4];
+	uint8_t control_1;
+	int err;
+
+	if((id != 0) || (mask & ~PCF8523_ALARM_FIELDS) || ((mask != 0) && (timeptr == NULL)))
+		return -EINVAL;
+
+	// Fields not in the mask are disabled with their AEN bit
+	alarm[0] = (mask & RTC_ALARM_TIME_MASK_MINUTE) ? bcd_encode(timeptr->tm_min) : PCF8523_ALARM_AEN;
+	alarm[1] = (mask & RTC_ALARM_TIME_MASK_HOUR) ? bcd_encode(timeptr->tm_hour) : PCF8523_ALARM_AEN;
+	alarm[2] = (mask & RTC_ALARM_TIME_MASK_MONTHDAY) ? bcd_encode(timeptr->tm_mday) : PCF8523_ALARM_AEN;
+	alarm[3] = (mask & RTC_ALARM_TIME_MASK_WEEKDAY) ? timeptr->tm_wday : PCF8523_ALARM_AEN;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	err = i2c_burst_write_dt(&config->i2c, PCF8523_MINUTE_ALARM_ADD, alarm, sizeof(alarm));
+	if(!err){
+		control_1 = pcf8523_read_reg_cached(dev, PCF8523_CONTROL_1_ADD);
+		if(mask)
+			control_1 |= PCF8523_CTRL1_AIE_MASK;
+		else
+			control_1 &= ~PCF8523_CTRL1_AIE_MASK;
+		err = pcf8523_write_reg(dev, PCF8523_CONTROL_1_ADD, control_1);
+	}
+	if(!err){
+		// Clear a stale alarm flag, other flags are left alone by writing them as 1
+		err = pcf8523_write_reg(dev, PCF8523_CONTROL_2_ADD,
+				(pcf8523_read_reg_cached(dev, PCF8523_CONTROL_2_ADD) | PCF8523_CTRL2_FLAGS_MASK) &
+				~PCF8523_CTRL2_AF_MASK);
+	}
+
+	k_mutex_unlock(&data->lock);
+
+	return err ? -EIO : 0;
+}
+
+static int pcf8523_alarm_get_time(const struct device *dev, uint16_t id, uint16_t *mask,
+				  struct rtc_time *timeptr)
+{
+	const struct pcf8523_config *config = dev->config;
+	uint8_t alarm[4];
+
+	if(id != 0)
+		return -EINVAL;
+
+	if(i2c_burst_read_dt(&config->i2c, PCF8523_MINUTE_ALARM_ADD, alarm, sizeof(alarm)))
+		return -EIO;
+
+	memset(timeptr, 0, sizeof(*timeptr));
+	*mask = 0;
+
+	if(!(alarm[0] & PCF8523_ALARM_AEN)){
+		timeptr->tm_min = bcd_decode(alarm[0] & PCF8523_MINUTES_MASK);
+		*mask |= RTC_ALARM_TIME_MASK_MINUTE;
+	}
+	if(!(alarm[1] & PCF8523_ALARM_AEN)){
+		timeptr->tm_hour = bcd_decode(alarm[1] & PCF8523_HOURS_MASK);
+		*mask |= RTC_ALARM_TIME_MASK_HOUR;
+	}
+	if(!(alarm[2] & PCF8523_ALARM_AEN)){
+		timeptr->tm_mday = bcd_decode(alarm[2] & PCF8523_DAYS_MASK);
+		*mask |= RTC_ALARM_TIME_MASK_MONTHDAY;
+	}
+	if(!(alarm[3] & PCF8523_ALARM_AEN)){
+		timeptr->tm_wday = alarm[3] & PCF8523_WEEKDAYS_MASK;
+		*mask |= RTC_ALARM_TIME_MASK_WEEKDAY;
+	}
+
+	return 0;
+}
+
+static int pcf8523_alarm_is_pending(const struct device *dev, uint16_t id)
+{
+	struct pcf8523_data *data = dev->data;
+	uint8_t control_2;
+	int pending;
+
+	if(id != 0)
+		return -EINVAL;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	if(pcf8523_refresh(dev)){
+		k_mutex_unlock(&data->lock);
+		return -EIO;
 	}
-	qty += u8_to_dec(&dstr[qty], 3, (uint8_t)time->tm_year - 100);
-	if((time->tm_year-100) < 10){
-		dstr[qty] = dstr[qty-1];
-		dstr[qty-1] = '0';
+
+	control_2 = data->regs[PCF8523_CONTROL_2_ADD];
+	pending = (control_2 & PCF8523_CTRL2_AF_MASK) ? 1 : 0;
+	if(pending)
+		pcf8523_write_reg(dev, PCF8523_CONTROL_2_ADD,
+				  (control_2 | PCF8523_CTRL2_FLAGS_MASK) & ~PCF8523_CTRL2_AF_MASK);
+
+	k_mutex_unlock(&data->lock);
+
+	return pending;
+}
+
+static int pcf8523_alarm_set_callback(const struct device *dev, uint16_t id,
+				      rtc_alarm_callback callback, void *user_data)
+{
+	struct pcf8523_data *data = dev->data;
+
+	if(id != 0)
+		return -EINVAL;
+
+#if PCF8523_HAS_INT1
+	const struct pcf8523_config *config = dev->config;
+
+	if(config->int1.port == NULL)
+		return -ENOTSUP;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	data->alarm_cb = callback;
+	data->alarm_user_data = user_data;
+	k_mutex_unlock(&data->lock);
+
+	return 0;
+#else
+	ARG_UNUSED(data);
+	ARG_UNUSED(callback);
+	ARG_UNUSED(user_data);
+
+	return -ENOTSUP;
+#endif
+}
+
+#endif /* CONFIG_RTC_ALARM */
+
+#ifdef CONFIG_RTC_UPDATE
+
+static int pcf8523_update_set_callback(const struct device *dev, rtc_update_callback callback,
+				       void *user_data)
+{
+#if PCF8523_HAS_INT1
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+	uint8_t control_1;
+	uint32_t err;
+
+	if(config->int1.port == NULL)
+		return -ENOTSUP;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	data->update_cb = callback;
+	data->update_user_data = user_data;
+
+	// The second interrupt drives the update callback
+	control_1 = pcf8523_read_reg_cached(dev, PCF8523_CONTROL_1_ADD);
+	if(callback)
+		control_1 |= PCF8523_CTRL1_SIE_MASK;
+	else
+		control_1 &= ~PCF8523_CTRL1_SIE_MASK;
+	err = pcf8523_write_reg(dev, PCF8523_CONTROL_1_ADD, control_1);
+
+	k_mutex_unlock(&data->lock);
+
+	return err ? -EIO : 0;
+#else
+	ARG_UNUSED(dev);
+	ARG_UNUSED(callback);
+	ARG_UNUSED(user_data);
+
+	return -ENOTSUP;
+#endif
+}
+
+#endif /* CONFIG_RTC_UPDATE */
+
+#if PCF8523_HAS_INT1
+
+/* Flags are read over I2C, which cannot be done in the ISR */
+static void pcf8523_int1_work_handler(struct k_work *work)
+{
+	struct pcf8523_data *data = CONTAINER_OF(work, struct pcf8523_data, int1_work);
+
+	pcf8523_service_flags(data->dev);
+}
+
+static void pcf8523_int1_handler(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	struct pcf8523_data *data = CONTAINER_OF(cb, struct pcf8523_data, int1_cb);
+
+	ARG_UNUSED(port);
+	ARG_UNUSED(pins);
+
+	// Timestamp here, the work item only runs after the scheduler gets to it
+	data->int1_cycles = k_cycle_get_32();
+	k_work_submit(&data->int1_work);
+}
+
+static int pcf8523_init_int1(const struct device *dev)
+{
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+
+	if(config->int1.port == NULL)
+		return 0;
+
+	if(!gpio_is_ready_dt(&config->int1))
+		return -ENODEV;
+
+	// CLKOUT shares the pin, it has to be off for INT1 to work
+	data->tmr_clkout |= PCF8523_TMR_COF_DISABLED;
+	if(pcf8523_write_reg(dev, PCF8523_TMR_CLKOUT_CTRL_ADD, data->tmr_clkout))
+		return -EIO;
+
+	k_work_init(&data->int1_work, pcf8523_int1_work_handler);
+	gpio_init_callback(&data->int1_cb, pcf8523_int1_handler, BIT(config->int1.pin));
+
+	if(gpio_pin_configure_dt(&config->int1, GPIO_INPUT) ||
+	   gpio_add_callback(config->int1.port, &data->int1_cb) ||
+	   gpio_pin_interrupt_configure_dt(&config->int1, GPIO_INT_EDGE_TO_ACTIVE))
+		return -EIO;
+
+	return 0;
+}
+
+#endif /* PCF8523_HAS_INT1 */
+
+/*!
+* @brief Returns when the last INT1 interrupt arrived, for timing the RTC against the system clock
+*
+* @param dev Pointer to the PCF8523 device structure
+*
+* @return k_cycle_get_32() value taken in the INT1 ISR, 0 without an INT1 line
+*
+*/
+uint32_t pcf8523_int1_timestamp(const struct device *dev){
+#if PCF8523_HAS_INT1
+	struct pcf8523_data *data = dev->data;
+
+	return data->int1_cycles;
+#else
+	ARG_UNUSED(dev);
+
+	return 0;
+#endif
+}
+
+/*!
+* @brief Initialize/Configure i2C controller and RTC module
+*
+* @param dev Pointer to the PCF8523 device structure
+*
+* @return 0 if succesful
+* @return -ENODEV if i2c controller is not ready
+* @return -EIO if the RTC does not answer
+*
+*/
+static int pcf8523_init(const struct device *dev){
+	const struct pcf8523_config *config = dev->config;
+	struct pcf8523_data *data = dev->data;
+	uint8_t control_3;
+
+	data->dev = dev;
+	k_mutex_init(&data->lock);
+	k_work_init(&data->async_work, pcf8523_refresh_work_handler);
+	k_work_init(&data->async_done_work, pcf8523_refresh_done_work_handler);
+
+	if(!i2c_is_ready_dt(&config->i2c)){ 
+		LOG_ERR("Could not get i2c device binding");
+		return -ENODEV;
 	}
-	qty++;
-	dstr[qty] = 0;
 
-	return;
-}
\ No newline at end of file
+	// Configure I2C peripheral, fast mode if the controller takes it
+	if(IS_ENABLED(CONFIG_PCF8523_I2C_FAST) &&
+	   (i2c_configure(config->i2c.bus, I2C_SPEED_SET(I2C_SPEED_FAST) | I2C_MODE_CONTROLLER) == 0)){
+		LOG_DBG("I2C fast mode");
+	}else{
+		i2c_configure(config->i2c.bus, I2C_SPEED_SET(I2C_SPEED_STANDARD) | I2C_MODE_CONTROLLER);
+	}
+
+	// One burst fills the shadow registers, the switch-over flag is taken from there
+	if(pcf8523_refresh(dev) ||
+	   i2c_reg_read_byte_dt(&config->i2c, PCF8523_TMR_CLKOUT_CTRL_ADD, &data->tmr_clkout))
+		return -EIO;
+
+	// Write the switchover functionality to Control_3. leave the rest to default values
+	if(pcf8523_switchover_occurred(dev))
+		// if switchover ocurred do not clear the flag yet
+		control_3 = PCF8523_CTRL3_SO_MODE_4_MASK|PCF8523_CTRL3_BSF_MASK; // battery switch-over function is enabled in standard mode;battery low detection function is disabled*/
+	else
+		control_3 = PCF8523_CTRL3_SO_MODE_4_MASK; // battery switch-over function is enabled in standard mode;battery low detection function is disabled*/
+	if(pcf8523_write_reg(dev, PCF8523_CONTROL_3_ADD, control_3))
+		return -EIO;
+
+#if PCF8523_HAS_INT1
+	return pcf8523_init_int1(dev);
+#else
+	return 0;
+#endif
+}
+
+static const struct rtc_driver_api pcf8523_driver_api = {
+	.set_time = pcf8523_rtc_set_time,
+	.get_time = pcf8523_rtc_get_time,
+#ifdef CONFIG_RTC_ALARM
+	.alarm_get_supported_fields = pcf8523_alarm_get_supported_fields,
+	.alarm_set_time = pcf8523_alarm_set_time,
+	.alarm_get_time = pcf8523_alarm_get_time,
+	.alarm_is_pending = pcf8523_alarm_is_pending,
+	.alarm_set_callback = pcf8523_alarm_set_callback,
+#endif
+#ifdef CONFIG_RTC_UPDATE
+	.update_set_callback = pcf8523_update_set_callback,
+#endif
+};
+
+#if PCF8523_HAS_INT1
+#define PCF8523_INT1_INIT(inst) .int1 = GPIO_DT_SPEC_INST_GET_OR(inst, int1_gpios, {0}),
+#else
+#define PCF8523_INT1_INIT(inst)
+#endif
+
+#define PCF8523_DEFINE(inst)								\
+	static struct pcf8523_data pcf8523_data_##inst;					\
+	static const struct pcf8523_config pcf8523_config_##inst = {			\
+		.i2c = I2C_DT_SPEC_INST_GET(inst),					\
+		PCF8523_INT1_INIT(inst)							\
+	};										\
+	DEVICE_DT_INST_DEFINE(inst, pcf8523_init, NULL, &pcf8523_data_##inst,		\
+			      &pcf8523_config_##inst, POST_KERNEL,			\
+			      CONFIG_RTC_INIT_PRIORITY, &pcf8523_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(PCF8523_DEFINE)
@@ -2,17 +2,12 @@
 #define PCF8523_H
 
 #include <zephyr/device.h>
+#include <zephyr/kernel.h>
 #include <time.h>
 
 // I2C device slave address
 #define PCF8523_SLAVE_ADD           0x68
 
-// BCD related
-#define PCF8523_BCD_UPPER_SHIFT     4
-#define PCF8523_BCD_LOWER_MASK      0x0F
-#define PCF8523_BCD_UPPER_MASK      0xF0
-#define PCF8523_BCD_UPPER_MASK_SEC  0x70
-
 // Control_1; Control and status Register Masks
 #define PCF8523_CONTROL_1_ADD       0x00
 #define PCF8523_CTRL1_CIE_MASK      BIT(0) // interrupt pulses are generated at every correction cycle
@@ -34,6 +29,7 @@
 #define PCF8523_CTRL2_CTBF_MASK     BIT(5) // flag set when countdown timer B interrupt generated; flag must be cleared to clear interrupt
 #define PCF8523_CTRL2_CTAF_MASK     BIT(6) // flag set when countdown timer A interrupt generated; flag must be cleared to clear interrupt
 #define PCF8523_CTRL2_WTAF_MASK     BIT(7) // flag set when watchdog timer A interrupt generated; flag is read-only and cleared by reading register Control_2
+#define PCF8523_CTRL2_FLAGS_MASK    (PCF8523_CTRL2_AF_MASK|PCF8523_CTRL2_SF_MASK|PCF8523_CTRL2_CTBF_MASK|PCF8523_CTRL2_CTAF_MASK) // flags cleared by writing 0, writing 1 leaves them unchanged
 
 // Control_3; Control and status Register Masks
 #define PCF8523_CONTROL_3_ADD       0x02
@@ -93,13 +89,89 @@
 
 #define PCF8523_YEARS_ADD           0x09
 
+// Alarm registers; a field takes part in the alarm only while its AEN bit is 0
+#define PCF8523_MINUTE_ALARM_ADD    0x0A
+#define PCF8523_HOUR_ALARM_ADD      0x0B
+#define PCF8523_DAY_ALARM_ADD       0x0C
+#define PCF8523_WEEKDAY_ALARM_ADD   0x0D
+#define PCF8523_ALARM_AEN           BIT(7) // alarm disabled for this field
+
+#define PCF8523_OFFSET_ADD          0x0E
+
+// Tmr_CLKOUT_ctrl; timer and CLKOUT control
+#define PCF8523_TMR_CLKOUT_CTRL_ADD 0x0F
+#define PCF8523_TMR_TBC_MASK        BIT(0) // timer B enabled
+#define PCF8523_TMR_TAC_MASK        0x06   // timer A control
+#define PCF8523_TMR_TAC_COUNTDOWN   0x02   // timer A is a countdown timer
+#define PCF8523_TMR_TAC_WATCHDOG    0x04   // timer A is a watchdog timer
+#define PCF8523_TMR_COF_MASK        0x38   // CLKOUT frequency
+#define PCF8523_TMR_COF_DISABLED    0x38   // CLKOUT disabled; the shared pin is INT1 only
+#define PCF8523_TMR_TBM_MASK        BIT(6) // timer B interrupt pulsed instead of permanent
+#define PCF8523_TMR_TAM_MASK        BIT(7) // timer A and second interrupt pulsed instead of permanent
+
+// Timer A/B source clock and reload value
+#define PCF8523_TMR_A_FREQ_CTRL_ADD 0x10
+#define PCF8523_TMR_A_REG_ADD       0x11
+#define PCF8523_TMR_B_FREQ_CTRL_ADD 0x12
+#define PCF8523_TMR_B_REG_ADD       0x13
+#define PCF8523_TMR_FREQ_MASK       0x07   // TAQ / TBQ
+#define PCF8523_TMR_B_TBW_MASK      0x70   // timer B interrupt pulse width
+
+// Registers mirrored by the driver: Control_1 .. Years
+#define PCF8523_CACHE_SIZE          (PCF8523_YEARS_ADD + 1)
+// Mirrored registers the chip changes on its own: flags, battery status and the running time
+#define PCF8523_VOLATILE_REGS       (BIT(PCF8523_CONTROL_2_ADD) | BIT(PCF8523_CONTROL_3_ADD) | \
+                                     (BIT_MASK(PCF8523_YEARS_ADD - PCF8523_SECONDS_ADD + 1) << PCF8523_SECONDS_ADD))
+
+enum pcf8523_timer {
+	PCF8523_TIMER_A,
+	PCF8523_TIMER_B,
+	PCF8523_WATCHDOG,	/* timer A in watchdog mode, excludes PCF8523_TIMER_A */
+	PCF8523_TIMER_COUNT,
+};
+
+/* Timer source clocks, TAQ / TBQ values */
+enum pcf8523_timer_clk {
+	PCF8523_TMR_CLK_4096HZ,
+	PCF8523_TMR_CLK_64HZ,
+	PCF8523_TMR_CLK_1HZ,
+	PCF8523_TMR_CLK_1_60HZ,
+	PCF8523_TMR_CLK_1_3600HZ,
+};
+
+/* Called from the INT1 work item, or from pcf8523_service_flags() when polling */
+typedef void (*pcf8523_timer_cb_t)(const struct device *dev, enum pcf8523_timer timer, void *user_data);
+
+/* End of an asynchronous refresh, err is 0 or -EIO. Called from the system work queue */
+typedef void (*pcf8523_read_cb_t)(const struct device *dev, int err, void *user_data);
+
+/*
+ * The chip is a devicetree instance of "mdl,pcf8523" and registers the Zephyr
+ * RTC API (rtc_set_time, rtc_get_time, alarms, update callback). The functions
+ * below take that RTC device and remain for the test steps that need the raw
+ * registers or the epoch/tm conversions, and for the countdown timers and the
+ * watchdog, which the RTC API has no place for. The timer and asynchronous
+ * refresh functions return 0 or a negative errno.
+ */
 
-uint32_t pcf8523_init(const struct device *dev);
 uint32_t pcf8523_switchover_occurred(const struct device *dev);
+uint32_t pcf8523_refresh(const struct device *dev);
+uint8_t pcf8523_read_reg_cached(const struct device *dev, uint8_t reg);
+uint32_t pcf8523_write_reg(const struct device *dev, uint8_t reg, uint8_t val);
 uint32_t pcf8523_set_time(const struct device *dev, int64_t *ts);
 uint32_t pcf8523_get_time(const struct device *dev, int64_t *ts);
 uint32_t pcf8523_get_time_tm(const struct device *dev, struct tm *time);
-void convert_time_ascii(struct tm *time, char *tstr, char *dstr);
+uint32_t pcf8523_get_time_cached(const struct device *dev, int64_t *ts);
+int pcf8523_refresh_async(const struct device *dev, pcf8523_read_cb_t cb, void *user_data);
+int pcf8523_refresh_signal(const struct device *dev, struct k_poll_signal *signal);
+uint32_t pcf8523_int1_timestamp(const struct device *dev);
+int pcf8523_timer_start(const struct device *dev, enum pcf8523_timer timer, enum pcf8523_timer_clk clk,
+			uint8_t count, pcf8523_timer_cb_t cb, void *user_data);
+int pcf8523_timer_start_ms(const struct device *dev, enum pcf8523_timer timer, uint32_t ms,
+			   pcf8523_timer_cb_t cb, void *user_data);
+int pcf8523_timer_stop(const struct device *dev, enum pcf8523_timer timer);
+int pcf8523_watchdog_kick(const struct device *dev);
+int pcf8523_service_flags(const struct device *dev);
 
 
 #endif /* DUT_SPI HEADER*/
\ No newline at end of file
@@ -0,0 +1,379 @@
+#define DT_DRV_COMPAT mdl_pcf8523
+
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_PCF8523_EMUL
+
+#include "pcf8523.h"
+#include "pcf8523_emul.h"
+#include "bcd_time.h"
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+struct pcf8523_emul_cfg {
+	uint16_t addr;
+	struct gpio_dt_spec int1;	/* emulated GPIO input the driver listens on, optional */
+};
+
+struct pcf8523_emul_data {
+	struct i2c_emul i2c;
+	uint8_t regs[PCF8523_EMUL_NUM_REGS];
+	uint8_t ptr;			/* register pointer, auto-incremented */
+	int64_t base_ts;		/* epoch seconds held by the time registers at base_ms */
+	int64_t base_ms;
+	struct k_timer tick;		/* second interrupt, restarted when the time is written */
+	struct k_timer tmr_a;		/* countdown timer A or watchdog */
+	struct k_timer tmr_b;		/* countdown timer B */
+	struct k_spinlock lock;
+};
+
+/* Source clock periods, TAQ / TBQ 4..7 all count hours */
+static const uint64_t pcf8523_emul_clk_us[8] = {
+	244, 15625, USEC_PER_SEC, 60ULL * USEC_PER_SEC,
+	3600ULL * USEC_PER_SEC, 3600ULL * USEC_PER_SEC, 3600ULL * USEC_PER_SEC, 3600ULL * USEC_PER_SEC,
+};
+
+/* Current epoch time of the model, frozen while STOP is set */
+static int64_t pcf8523_emul_now(const struct pcf8523_emul_data *data)
+{
+	if(data->regs[PCF8523_CONTROL_1_ADD] & PCF8523_CTRL1_STOP_MASK)
+		return data->base_ts;
+
+	return data->base_ts + (k_uptime_get() - data->base_ms) / MSEC_PER_SEC;
+}
+
+/* Copies the running time into the time registers, as the chip does on a read */
+static void pcf8523_emul_sync_regs(struct pcf8523_emul_data *data)
+{
+	uint8_t *time_regs = &data->regs[PCF8523_SECONDS_ADD];
+	uint8_t os = time_regs[BCD_TIME_SEC] & PCF8523_SECONDS_OS;
+
+	if(bcd_time_from_epoch(pcf8523_emul_now(data), time_regs) == 0)
+		time_regs[BCD_TIME_SEC] |= os;
+}
+
+/* Restarts the time base from what was written to the time registers */
+static void pcf8523_emul_load_regs(struct pcf8523_emul_data *data)
+{
+	int64_t ts;
+
+	// Invalid registers keep the old time, as good as anything the chip would do
+	if(bcd_time_to_epoch(&data->regs[PCF8523_SECONDS_ADD], &ts) == 0)
+		data->base_ts = ts;
+	data->base_ms = k_uptime_get();
+
+	// The prescaler restarts with the new time
+	k_timer_start(&data->tick, K_SECONDS(1), K_SECONDS(1));
+}
+
+/* Sets AF when every enabled alarm field matches the time, checked on the minute */
+static void pcf8523_emul_check_alarm(struct pcf8523_emul_data *data, int64_t now)
+{
+	static const struct {
+		uint8_t alarm;
+		uint8_t time;
+		uint8_t mask;
+	} fields[] = {
+		{PCF8523_MINUTE_ALARM_ADD, BCD_TIME_MIN, PCF8523_MINUTES_MASK},
+		{PCF8523_HOUR_ALARM_ADD, BCD_TIME_HOUR, PCF8523_HOURS_MASK},
+		{PCF8523_DAY_ALARM_ADD, BCD_TIME_DAY, PCF8523_DAYS_MASK},
+		{PCF8523_WEEKDAY_ALARM_ADD, BCD_TIME_WEEKDAY, PCF8523_WEEKDAYS_MASK},
+	};
+	uint8_t time_regs[BCD_TIME_REGS];
+	bool enabled = false;
+
+	if(bcd_time_from_epoch(now, time_regs))
+		return;
+
+	for(size_t i = 0; i < ARRAY_SIZE(fields); i++){
+		uint8_t alarm = data->regs[fields[i].alarm];
+
+		if(alarm & PCF8523_ALARM_AEN)
+			continue;
+		if((alarm & fields[i].mask) != (time_regs[fields[i].time] & fields[i].mask))
+			return;
+		enabled = true;
+	}
+
+	if(enabled)
+		data->regs[PCF8523_CONTROL_2_ADD] |= PCF8523_CTRL2_AF_MASK;
+}
+
+/* INT1 is held active while an enabled flag is set (permanent interrupt mode) */
+static void pcf8523_emul_update_int1(const struct emul *target)
+{
+	const struct pcf8523_emul_cfg *cfg = target->cfg;
+	struct pcf8523_emul_data *data = target->data;
+	uint8_t control_1 = data->regs[PCF8523_CONTROL_1_ADD];
+	uint8_t control_2 = data->regs[PCF8523_CONTROL_2_ADD];
+	bool active;
+
+	if(cfg->int1.port == NULL)
+		return;
+
+	active = ((control_2 & PCF8523_CTRL2_SF_MASK) && (control_1 & PCF8523_CTRL1_SIE_MASK)) ||
+		 ((control_2 & PCF8523_CTRL2_AF_MASK) && (control_1 & PCF8523_CTRL1_AIE_MASK)) ||
+		 ((control_2 & PCF8523_CTRL2_CTAF_MASK) && (control_2 & PCF8523_CTRL2_CTAIE_MASK)) ||
+		 ((control_2 & PCF8523_CTRL2_CTBF_MASK) && (control_2 & PCF8523_CTRL2_CTBIE_MASK)) ||
+		 ((control_2 & PCF8523_CTRL2_WTAF_MASK) && (control_2 & PCF8523_CTRL2_WTAIE_MASK));
+
+	gpio_emul_input_set(cfg->int1.port, cfg->int1.pin,
+			    (cfg->int1.dt_flags & GPIO_ACTIVE_LOW) ? !active : active);
+}
+
+static void pcf8523_emul_tick(struct k_timer *timer)
+{
+	const struct emul *target = k_timer_user_data_get(timer);
+	struct pcf8523_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	if(!(data->regs[PCF8523_CONTROL_1_ADD] & PCF8523_CTRL1_STOP_MASK)){
+		int64_t now = pcf8523_emul_now(data);
+
+		if(data->regs[PCF8523_CONTROL_1_ADD] & PCF8523_CTRL1_SIE_MASK)
+			data->regs[PCF8523_CONTROL_2_ADD] |= PCF8523_CTRL2_SF_MASK;
+
+		if((now % 60) == 0)
+			pcf8523_emul_check_alarm(data, now);
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	pcf8523_emul_update_int1(target);
+}
+
+static void pcf8523_emul_tmr_expiry(struct k_timer *timer)
+{
+	const struct emul *target = k_timer_user_data_get(timer);
+	struct pcf8523_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	if(timer == &data->tmr_b){
+		data->regs[PCF8523_CONTROL_2_ADD] |= PCF8523_CTRL2_CTBF_MASK;
+	}else if((data->regs[PCF8523_TMR_CLKOUT_CTRL_ADD] & PCF8523_TMR_TAC_MASK) == PCF8523_TMR_TAC_WATCHDOG){
+		// The watchdog fires once and waits for a reload
+		data->regs[PCF8523_CONTROL_2_ADD] |= PCF8523_CTRL2_WTAF_MASK;
+		k_timer_stop(timer);
+	}else{
+		data->regs[PCF8523_CONTROL_2_ADD] |= PCF8523_CTRL2_CTAF_MASK;
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	pcf8523_emul_update_int1(target);
+}
+
+/* Restarts a timer from its reload value, countdown timers repeat */
+static void pcf8523_emul_tmr_arm(struct k_timer *timer, bool enabled, bool periodic, uint8_t freq, uint8_t count)
+{
+	k_timeout_t period;
+
+	if(!enabled || (count == 0)){
+		k_timer_stop(timer);
+		return;
+	}
+
+	period = K_USEC(pcf8523_emul_clk_us[freq & PCF8523_TMR_FREQ_MASK] * count);
+	k_timer_start(timer, period, periodic ? period : K_NO_WAIT);
+}
+
+/* Rearms the timers whose control, clock or value registers were written */
+static void pcf8523_emul_tmr_update(struct pcf8523_emul_data *data, uint32_t written, uint8_t old_ctrl)
+{
+	uint8_t ctrl = data->regs[PCF8523_TMR_CLKOUT_CTRL_ADD];
+	uint8_t tac = ctrl & PCF8523_TMR_TAC_MASK;
+
+	if((written & (BIT(PCF8523_TMR_A_FREQ_CTRL_ADD) | BIT(PCF8523_TMR_A_REG_ADD))) ||
+	   ((ctrl ^ old_ctrl) & PCF8523_TMR_TAC_MASK))
+		pcf8523_emul_tmr_arm(&data->tmr_a,
+				     (tac == PCF8523_TMR_TAC_COUNTDOWN) || (tac == PCF8523_TMR_TAC_WATCHDOG),
+				     tac == PCF8523_TMR_TAC_COUNTDOWN,
+				     data->regs[PCF8523_TMR_A_FREQ_CTRL_ADD], data->regs[PCF8523_TMR_A_REG_ADD]);
+
+	if((written & (BIT(PCF8523_TMR_B_FREQ_CTRL_ADD) | BIT(PCF8523_TMR_B_REG_ADD))) ||
+	   ((ctrl ^ old_ctrl) & PCF8523_TMR_TBC_MASK))
+		pcf8523_emul_tmr_arm(&data->tmr_b, ctrl & PCF8523_TMR_TBC_MASK, true,
+				     data->regs[PCF8523_TMR_B_FREQ_CTRL_ADD], data->regs[PCF8523_TMR_B_REG_ADD]);
+}
+
+static void pcf8523_emul_write_reg(struct pcf8523_emul_data *data, uint8_t reg, uint8_t val)
+{
+	uint8_t old = data->regs[reg];
+
+	switch(reg){
+	case PCF8523_CONTROL_1_ADD:
+		if((val ^ old) & PCF8523_CTRL1_STOP_MASK){
+			// Freeze the time on STOP, restart from the frozen time when released
+			pcf8523_emul_sync_regs(data);
+			data->regs[reg] = val;
+			pcf8523_emul_load_regs(data);
+			return;
+		}
+		break;
+	case PCF8523_CONTROL_2_ADD:
+		// Flags are cleared by writing 0 and kept by writing 1, WTAF is read-only
+		val = (val & ~(PCF8523_CTRL2_FLAGS_MASK | PCF8523_CTRL2_WTAF_MASK)) |
+		      (old & val & PCF8523_CTRL2_FLAGS_MASK) | (old & PCF8523_CTRL2_WTAF_MASK);
+		break;
+	case PCF8523_CONTROL_3_ADD:
+		// BSF is cleared by writing 0, BLF is read-only
+		val = (val & ~(PCF8523_CTRL3_BSF_MASK | PCF8523_CTRL3_BLF_MASK)) |
+		      (old & val & PCF8523_CTRL3_BSF_MASK) | (old & PCF8523_CTRL3_BLF_MASK);
+		break;
+	default:
+		break;
+	}
+
+	data->regs[reg] = val;
+}
+
+static int pcf8523_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+				 int addr)
+{
+	struct pcf8523_emul_data *data = target->data;
+	k_spinlock_key_t key;
+	int ret = 0;
+
+	ARG_UNUSED(addr);
+
+	key = k_spin_lock(&data->lock);
+
+	for(int i = 0; (i < num_msgs) && (ret == 0); i++){
+		if(msgs[i].flags & I2C_MSG_READ){
+			pcf8523_emul_sync_regs(data);
+			for(uint32_t j = 0; j < msgs[i].len; j++){
+				msgs[i].buf[j] = data->regs[data->ptr];
+				// WTAF clears once it has been read
+				if(data->ptr == PCF8523_CONTROL_2_ADD)
+					data->regs[data->ptr] &= ~PCF8523_CTRL2_WTAF_MASK;
+				data->ptr = (data->ptr + 1) % PCF8523_EMUL_NUM_REGS;
+			}
+			continue;
+		}
+
+		bool time_written = false;
+
+		uint8_t old_ctrl = data->regs[PCF8523_TMR_CLKOUT_CTRL_ADD];
+		uint32_t written = 0;
+
+		for(uint32_t j = 0; j < msgs[i].len; j++){
+			// The first byte written after the address is the register pointer
+			if((j == 0) && ((i == 0) || (msgs[i - 1].flags & I2C_MSG_READ) ||
+					(msgs[i - 1].flags & I2C_MSG_STOP))){
+				if(msgs[i].buf[0] >= PCF8523_EMUL_NUM_REGS){
+					ret = -EIO;
+					break;
+				}
+				data->ptr = msgs[i].buf[0];
+				continue;
+			}
+
+			if((data->ptr >= PCF8523_SECONDS_ADD) && (data->ptr <= PCF8523_YEARS_ADD)){
+				// Writing the seconds clears the oscillator stop flag
+				if(data->ptr == PCF8523_SECONDS_ADD)
+					msgs[i].buf[j] &= ~PCF8523_SECONDS_OS;
+				time_written = true;
+			}
+			pcf8523_emul_write_reg(data, data->ptr, msgs[i].buf[j]);
+			written |= BIT(data->ptr);
+			data->ptr = (data->ptr + 1) % PCF8523_EMUL_NUM_REGS;
+		}
+
+		if(time_written)
+			pcf8523_emul_load_regs(data);
+		if(written & GENMASK(PCF8523_TMR_B_REG_ADD, PCF8523_TMR_CLKOUT_CTRL_ADD))
+			pcf8523_emul_tmr_update(data, written, old_ctrl);
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	// Clearing a flag releases the line, enabling an interrupt with its flag set asserts it
+	pcf8523_emul_update_int1(target);
+
+	return ret;
+}
+
+/*!
+* @brief Sets the battery switch-over flag, as after a VDD loss with the backup battery fitted
+*
+* @param target Emulator of the RTC
+*
+*/
+void pcf8523_emul_set_switchover(const struct emul *target)
+{
+	struct pcf8523_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	data->regs[PCF8523_CONTROL_3_ADD] |= PCF8523_CTRL3_BSF_MASK;
+
+	k_spin_unlock(&data->lock, key);
+}
+
+/*!
+* @brief Moves the emulated time forward without waiting
+*
+* @param target Emulator of the RTC
+* @param seconds Number of seconds to add
+*
+*/
+void pcf8523_emul_advance(const struct emul *target, uint32_t seconds)
+{
+	struct pcf8523_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	data->base_ts += seconds;
+
+	k_spin_unlock(&data->lock, key);
+}
+
+static const struct i2c_emul_api pcf8523_emul_api = {
+	.transfer = pcf8523_emul_transfer,
+};
+
+static int pcf8523_emul_init(const struct emul *target, const struct device *parent)
+{
+	struct pcf8523_emul_data *data = target->data;
+
+	ARG_UNUSED(parent);
+
+	k_timer_init(&data->tick, pcf8523_emul_tick, NULL);
+	k_timer_user_data_set(&data->tick, (void *)target);
+	k_timer_init(&data->tmr_a, pcf8523_emul_tmr_expiry, NULL);
+	k_timer_user_data_set(&data->tmr_a, (void *)target);
+	k_timer_init(&data->tmr_b, pcf8523_emul_tmr_expiry, NULL);
+	k_timer_user_data_set(&data->tmr_b, (void *)target);
+
+	// Power-on reset values: Control_3 with switch-over disabled and the oscillator stop flag set
+	memset(data->regs, 0, sizeof(data->regs));
+	data->regs[PCF8523_CONTROL_3_ADD] = PCF8523_CTRL3_SO_MODE_6_MASK;
+	data->regs[PCF8523_SECONDS_ADD] = PCF8523_SECONDS_OS;
+	data->regs[PCF8523_DAYS_ADD] = 0x01;
+	data->regs[PCF8523_MONTHS_ADD] = PCF8523_MONTHS_JAN;
+	for(uint8_t reg = PCF8523_MINUTE_ALARM_ADD; reg <= PCF8523_WEEKDAY_ALARM_ADD; reg++)
+		data->regs[reg] = PCF8523_ALARM_AEN;
+	data->ptr = 0;
+
+	pcf8523_emul_load_regs(data);
+
+	return 0;
+}
+
+#define PCF8523_EMUL_DEFINE(inst)							\
+	static struct pcf8523_emul_data pcf8523_emul_data_##inst;			\
+	static const struct pcf8523_emul_cfg pcf8523_emul_cfg_##inst = {		\
+		.addr = DT_INST_REG_ADDR(inst),						\
+		.int1 = GPIO_DT_SPEC_INST_GET_OR(inst, int1_gpios, {0}),		\
+	};										\
+	EMUL_DT_INST_DEFINE(inst, pcf8523_emul_init, &pcf8523_emul_data_##inst,	\
+			    &pcf8523_emul_cfg_##inst, &pcf8523_emul_api, NULL);
+
+DT_INST_FOREACH_STATUS_OKAY(PCF8523_EMUL_DEFINE)
+
+#endif /* CONFIG_PCF8523_EMUL */
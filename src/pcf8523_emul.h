@@ -0,0 +1,14 @@
+#ifndef PCF8523_EMUL_H
+#define PCF8523_EMUL_H
+
+#include <zephyr/drivers/emul.h>
+#include <stdint.h>
+
+// Registers modelled by the emulator: Control_1 .. Timer B
+#define PCF8523_EMUL_NUM_REGS       0x14
+
+void pcf8523_emul_set_switchover(const struct emul *target);
+void pcf8523_emul_advance(const struct emul *target, uint32_t seconds);
+
+
+#endif /* PCF8523_EMUL_H */
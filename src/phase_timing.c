@@ -0,0 +1,94 @@
+#include <zephyr/kernel.h>
+
+#ifdef CONFIG_PHASE_TIMING
+
+#include "phase_timing.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+
+/* Phases are timed from threads, work queues and callbacks alike */
+static struct k_spinlock m_lock;
+static struct phase_stats m_stats[PHASE_COUNT];
+
+/*!
+* @brief Adds one duration to the statistics of a phase
+*
+* @param id Phase
+* @param us Duration
+*/
+void phase_timing_add(enum phase_id id, uint32_t us)
+{
+	uint32_t bucket = us ? (32 - __builtin_clz(us)) : 0;
+	struct phase_stats *st;
+	k_spinlock_key_t key;
+
+	if ((uint32_t)id >= PHASE_COUNT) {
+		return;
+	}
+	st = &m_stats[id];
+	bucket = MIN(bucket, PHASE_TIMING_BUCKETS - 1);
+
+	key = k_spin_lock(&m_lock);
+	if ((st->count == 0) || (us < st->min_us)) {
+		st->min_us = us;
+	}
+	st->max_us = MAX(st->max_us, us);
+	st->last_us = us;
+	st->total_us += us;
+	st->count++;
+	if (st->hist[bucket] < UINT16_MAX) {
+		st->hist[bucket]++;
+	}
+	k_spin_unlock(&m_lock, key);
+}
+
+/*!
+* @brief Ends the timing of a phase
+*
+* @param id Phase
+* @param start Value returned by phase_timing_begin() when the phase started
+*/
+void phase_timing_end(enum phase_id id, uint32_t start)
+{
+	phase_timing_add(id, k_cyc_to_us_near32(k_cycle_get_32() - start));
+}
+
+/*!
+* @brief Gets a consistent copy of the statistics of a phase
+*
+* @param id Phase
+* @param stats Where the statistics are stored
+*
+* @return 0 if successful
+* @return -EINVAL if the phase does not exist
+*/
+int phase_timing_get(enum phase_id id, struct phase_stats *stats)
+{
+	k_spinlock_key_t key;
+
+	if ((uint32_t)id >= PHASE_COUNT) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&m_lock);
+	*stats = m_stats[id];
+	k_spin_unlock(&m_lock, key);
+
+	return 0;
+}
+
+/*!
+* @brief Clears the statistics of all the phases
+*/
+void phase_timing_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+	memset(m_stats, 0, sizeof(m_stats));
+	k_spin_unlock(&m_lock, key);
+}
+
+#endif /* CONFIG_PHASE_TIMING */
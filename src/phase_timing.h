@@ -0,0 +1,71 @@
+#ifndef PHASE_TIMING_H
+#define PHASE_TIMING_H
+
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <stdint.h>
+
+/*
+ * Duration statistics of the test phases, kept across runs until reset.
+ * A phase is timed with phase_timing_begin()/phase_timing_end() around it,
+ * or added with phase_timing_add() when its duration is already known.
+ * Without CONFIG_PHASE_TIMING the calls compile to nothing.
+ */
+
+/* Test steps with their own statistics, indexed like the sequence */
+#define PHASE_TIMING_MAX_STEPS      8
+/* Histogram buckets: n holds durations of n bits, 2^(n-1) <= us < 2^n; 0 holds 0 us */
+#define PHASE_TIMING_BUCKETS        32
+
+enum phase_id {
+	PHASE_SEQUENCE,			/* whole test sequence */
+	PHASE_ADC_SCAN,			/* one sampling of the rails */
+	PHASE_ADC_WINDOW,		/* sleep current capture */
+	PHASE_ADC_BURST,		/* power up capture */
+	PHASE_I2C,			/* PCF8523 register transfers */
+	PHASE_STEP_0,			/* first test step */
+	PHASE_COUNT = PHASE_STEP_0 + PHASE_TIMING_MAX_STEPS,
+};
+
+/* Sent to the host as is */
+struct phase_stats {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t last_us;
+	uint64_t total_us;		/* average is total_us / count */
+	uint16_t hist[PHASE_TIMING_BUCKETS];	/* saturate at UINT16_MAX */
+} __packed;
+
+#ifdef CONFIG_PHASE_TIMING
+
+static inline uint32_t phase_timing_begin(void)
+{
+	return k_cycle_get_32();
+}
+
+void phase_timing_add(enum phase_id id, uint32_t us);
+void phase_timing_end(enum phase_id id, uint32_t start);
+int phase_timing_get(enum phase_id id, struct phase_stats *stats);
+void phase_timing_reset(void);
+
+#else
+
+static inline uint32_t phase_timing_begin(void)
+{
+	return 0;
+}
+
+static inline void phase_timing_add(enum phase_id id, uint32_t us) {}
+static inline void phase_timing_end(enum phase_id id, uint32_t start) {}
+
+static inline int phase_timing_get(enum phase_id id, struct phase_stats *stats)
+{
+	return -ENOTSUP;
+}
+
+static inline void phase_timing_reset(void) {}
+
+#endif /* CONFIG_PHASE_TIMING */
+
+#endif /* PHASE_TIMING_H */
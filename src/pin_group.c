@@ -0,0 +1,131 @@
+#include "pin_group.h"
+
+#include <errno.h>
+
+/*!
+* @brief Sorts the pins of a group by port, called once before using it
+*
+* @param grp Group with its pins set, see PIN_GROUP_INIT()
+*
+* @return 0 if successful
+* @return -EINVAL if the group has too many pins or spans too many ports
+*/
+int pin_group_init(struct pin_group *grp)
+{
+	if (grp->count > PIN_GROUP_MAX_PINS) {
+		return -EINVAL;
+	}
+
+	grp->port_count = 0;
+	for (size_t i = 0; i < grp->count; i++) {
+		const struct gpio_dt_spec *pin = grp->pins[i];
+		size_t p;
+
+		for (p = 0; p < grp->port_count; p++) {
+			if (grp->ports[p].port == pin->port) {
+				break;
+			}
+		}
+		if (p == grp->port_count) {
+			if (p == PIN_GROUP_MAX_PORTS) {
+				return -EINVAL;
+			}
+			grp->ports[p].port = pin->port;
+			grp->ports[p].mask = 0;
+			grp->port_count++;
+		}
+
+		grp->ports[p].mask |= BIT(pin->pin);
+		grp->port_of[i] = p;
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Configures every pin of a group, devicetree flags added
+*
+* GPIO drivers have no port wide configuration. Output pins configured
+* without an initial level keep the one set by pin_group_set_raw(), so a
+* group can be preset in one write and then switched to output glitch free.
+*
+* @param grp Group
+* @param flags GPIO_INPUT, GPIO_OUTPUT... as for gpio_pin_configure_dt()
+*
+* @return 0 if successful
+* @return negative errno from the GPIO driver
+*/
+int pin_group_configure(const struct pin_group *grp, gpio_flags_t flags)
+{
+	for (size_t i = 0; i < grp->count; i++) {
+		int ret = gpio_pin_configure_dt(grp->pins[i], flags);
+
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Sets the physical level of all the pins of a group, one write per port
+*
+* @param grp Group
+* @param values Bit i is the level of pins[i]
+*
+* @return 0 if successful
+* @return negative errno from the GPIO driver
+*/
+int pin_group_set_raw(const struct pin_group *grp, uint32_t values)
+{
+	gpio_port_value_t port_values[PIN_GROUP_MAX_PORTS] = {0};
+
+	for (size_t i = 0; i < grp->count; i++) {
+		if (values & BIT(i)) {
+			port_values[grp->port_of[i]] |= BIT(grp->pins[i]->pin);
+		}
+	}
+
+	for (size_t p = 0; p < grp->port_count; p++) {
+		int ret = gpio_port_set_masked_raw(grp->ports[p].port, grp->ports[p].mask, port_values[p]);
+
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Reads the physical level of all the pins of a group, one read per port
+*
+* @param grp Group
+* @param values Where the levels are stored, bit i is pins[i]
+*
+* @return 0 if successful
+* @return negative errno from the GPIO driver
+*/
+int pin_group_get_raw(const struct pin_group *grp, uint32_t *values)
+{
+	gpio_port_value_t port_values[PIN_GROUP_MAX_PORTS];
+	uint32_t v = 0;
+
+	for (size_t p = 0; p < grp->port_count; p++) {
+		int ret = gpio_port_get_raw(grp->ports[p].port, &port_values[p]);
+
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	for (size_t i = 0; i < grp->count; i++) {
+		if (port_values[grp->port_of[i]] & BIT(grp->pins[i]->pin)) {
+			v |= BIT(i);
+		}
+	}
+	*values = v;
+
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef PIN_GROUP_H
+#define PIN_GROUP_H
+
+#include <zephyr/drivers/gpio.h>
+#include <stdint.h>
+
+/*
+ * Set of pins spread over a few GPIO ports, driven and read as a bitmap in
+ * pin order: bit i is pins[i]. Every port is accessed once per call with the
+ * masked port functions, whatever the number of pins on it.
+ */
+
+#define PIN_GROUP_MAX_PINS          32
+#define PIN_GROUP_MAX_PORTS         2
+
+struct pin_group_port {
+	const struct device *port;
+	gpio_port_pins_t mask;			/* pins of the group on this port */
+};
+
+struct pin_group {
+	const struct gpio_dt_spec *const *pins;
+	size_t count;
+
+	/* Filled by pin_group_init() */
+	struct pin_group_port ports[PIN_GROUP_MAX_PORTS];
+	size_t port_count;
+	uint8_t port_of[PIN_GROUP_MAX_PINS];	/* index in ports of every pin */
+};
+
+#define PIN_GROUP_INIT(_pins)			\
+	{					\
+		.pins = _pins,			\
+		.count = ARRAY_SIZE(_pins),	\
+	}
+
+/* Bitmap with one bit per pin of the group */
+static inline uint32_t pin_group_all(const struct pin_group *grp)
+{
+	return (uint32_t)BIT64_MASK(grp->count);
+}
+
+int pin_group_init(struct pin_group *grp);
+int pin_group_configure(const struct pin_group *grp, gpio_flags_t flags);
+int pin_group_set_raw(const struct pin_group *grp, uint32_t values);
+int pin_group_get_raw(const struct pin_group *grp, uint32_t *values);
+
+#endif /* PIN_GROUP_H */
@@ -0,0 +1,272 @@
+#include "power_seq.h"
+#include "analog.h"
+#include "current_meter.h"
+#include "phase_timing.h"
+
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(power_seq, LOG_LEVEL_INF);
+
+/* Burst of the current and rail channels, interleaved in channel id order */
+static int16_t m_burst[POWER_SEQ_SAMPLES * 2];
+
+/* Last burst converted to uA and mV, with the calibration active when it was taken */
+static int32_t m_current_uA[POWER_SEQ_SAMPLES];
+static int32_t m_rail_mV[POWER_SEQ_SAMPLES];
+static bool m_captured;
+
+static const struct power_seq_config *m_config;
+static struct gpio_callback m_flg_cb;
+static bool m_powered;
+static uint32_t m_enable_cycles;
+static uint32_t m_fault_cycles;
+static atomic_t m_faults;
+
+static void power_seq_flg_isr(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	ARG_UNUSED(port);
+	ARG_UNUSED(cb);
+	ARG_UNUSED(pins);
+
+	if (atomic_inc(&m_faults) == 0) {
+		m_fault_cycles = k_cycle_get_32();
+	}
+}
+
+/* Called after every sampling of the burst, the switch is enabled between two of them */
+static enum adc_action power_seq_adc_cb(const struct device *dev, const struct adc_sequence *sequence,
+					uint16_t sampling_index)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(sequence);
+
+	if (sampling_index == (POWER_SEQ_PRE_SAMPLES - 1)) {
+		m_enable_cycles = k_cycle_get_32();
+		gpio_pin_set_raw(m_config->en->port, m_config->en->pin, 1);
+	}
+
+	return ADC_ACTION_CONTINUE;
+}
+
+static uint32_t power_seq_interval_us(void)
+{
+	return m_config->interval_us ? m_config->interval_us : POWER_SEQ_INTERVAL_US;
+}
+
+/* Time of a sampling from the enable edge, the first one after it counts as 0 */
+static uint32_t power_seq_sample_us(size_t idx)
+{
+	return (idx - POWER_SEQ_PRE_SAMPLES) * power_seq_interval_us();
+}
+
+static void power_seq_analyse(struct power_seq_result *result)
+{
+	int32_t base_mV = 0;
+	int32_t sum = 0;
+	int32_t low_mV;
+	int32_t high_mV;
+	size_t low_idx = 0;
+
+	result->inrush_peak_uA = INT32_MIN;
+	for (size_t i = POWER_SEQ_PRE_SAMPLES; i < POWER_SEQ_SAMPLES; i++) {
+		if (m_current_uA[i] > result->inrush_peak_uA) {
+			result->inrush_peak_uA = m_current_uA[i];
+			result->inrush_peak_us = power_seq_sample_us(i);
+		}
+	}
+
+	// Rail before the enable edge and once settled, rise time taken between them
+	for (size_t i = 0; i < POWER_SEQ_PRE_SAMPLES; i++) {
+		base_mV += m_rail_mV[i];
+	}
+	base_mV /= POWER_SEQ_PRE_SAMPLES;
+	for (size_t i = POWER_SEQ_SAMPLES - POWER_SEQ_SETTLED_SAMPLES; i < POWER_SEQ_SAMPLES; i++) {
+		sum += m_rail_mV[i];
+	}
+	result->rail_mV = sum / POWER_SEQ_SETTLED_SAMPLES;
+
+	low_mV = base_mV + (result->rail_mV - base_mV) / 10;
+	high_mV = base_mV + ((result->rail_mV - base_mV) * 9) / 10;
+	if (result->rail_mV <= base_mV) {
+		return;
+	}
+
+	for (size_t i = POWER_SEQ_PRE_SAMPLES; i < POWER_SEQ_SAMPLES; i++) {
+		if ((low_idx == 0) && (m_rail_mV[i] >= low_mV)) {
+			low_idx = i;
+			result->rail_delay_us = power_seq_sample_us(i);
+		}
+		if (low_idx && (m_rail_mV[i] >= high_mV)) {
+			// Both thresholds crossed within one sampling interval
+			result->rise_us = (i == low_idx) ? power_seq_interval_us()
+							 : power_seq_sample_us(i) - result->rail_delay_us;
+			result->rose = true;
+			break;
+		}
+	}
+}
+
+/*!
+* @brief Sets up the AP22 pins, the switch is left off
+*
+* @param config Pins and channels, must stay valid
+*
+* @return 0 if successful
+* @return -EINVAL if the channels can not be sampled in one sequence
+* @return other negative errno from the GPIO driver
+*/
+int power_seq_init(const struct power_seq_config *config)
+{
+	const struct adc_dt_spec *cur = &config->adc_specs[config->current_chn];
+	const struct adc_dt_spec *rail = &config->adc_specs[config->rail_chn];
+	int ret;
+
+	if ((cur->dev != rail->dev) || (cur->resolution != rail->resolution) ||
+	    (cur->channel_id == rail->channel_id)) {
+		return -EINVAL;
+	}
+
+	m_config = config;
+
+	ret = gpio_pin_set_raw(config->en->port, config->en->pin, 0);
+	if (ret != 0) {
+		return ret;
+	}
+
+	gpio_init_callback(&m_flg_cb, power_seq_flg_isr, BIT(config->flg->pin));
+	ret = gpio_add_callback(config->flg->port, &m_flg_cb);
+	if (ret != 0) {
+		return ret;
+	}
+
+	return gpio_pin_interrupt_configure_dt(config->flg, GPIO_INT_DISABLE);
+}
+
+/*!
+* @brief Powers the DUT up and measures how it went
+*
+* Blocks for the burst, POWER_SEQ_SAMPLES samplings. The current is taken in
+* the mA range, the inrush would saturate the uA shunt. FLG stays watched until
+* power_seq_off().
+*
+* @param result Where the measurements are stored
+*
+* @return 0 if the switch was enabled and the burst captured
+* @return -EALREADY if the DUT is already powered
+* @return -EIO if the burst could not be captured, the switch is left off
+*/
+int power_seq_on(struct power_seq_result *result)
+{
+	const struct adc_dt_spec *cur = &m_config->adc_specs[m_config->current_chn];
+	const struct adc_dt_spec *rail = &m_config->adc_specs[m_config->rail_chn];
+	uint32_t channels = BIT(cur->channel_id) | BIT(rail->channel_id);
+	uint32_t fault_cycles;
+	uint32_t start;
+	size_t cur_pos;
+	int err;
+
+	if (m_powered) {
+		return -EALREADY;
+	}
+
+	struct adc_sequence_options options = {
+		.interval_us = power_seq_interval_us(),
+		.callback = power_seq_adc_cb,
+		.extra_samplings = POWER_SEQ_SAMPLES - 1,
+	};
+
+	struct adc_sequence sequence = {
+		.options = &options,
+		.buffer = m_burst,
+		/* buffer size in bytes, not number of samples */
+		.buffer_size = sizeof(m_burst),
+	};
+
+	(void)adc_sequence_init_dt(cur, &sequence);
+	sequence.channels = channels;
+
+	*result = (struct power_seq_result){0};
+	current_meter_set_range(ADC_CURRENT_RANGE_MA);
+	m_captured = false;
+
+	m_powered = true;
+	atomic_clear(&m_faults);
+	gpio_pin_interrupt_configure_dt(m_config->flg, GPIO_INT_EDGE_TO_ACTIVE);
+
+	start = phase_timing_begin();
+	err = adc_read(cur->dev, &sequence);
+	phase_timing_end(PHASE_ADC_BURST, start);
+	if (err < 0) {
+		LOG_ERR("Could not capture power up (%d)", err);
+		power_seq_off();
+		return -EIO;
+	}
+
+	// Lower channel id first in every sampling
+	cur_pos = (cur->channel_id > rail->channel_id) ? 1 : 0;
+	adc_convert_block(&m_burst[cur_pos], 2, m_current_uA, POWER_SEQ_SAMPLES,
+			  adc_cal_get_current(adc_get_current_range()));
+	adc_convert_block(&m_burst[1 - cur_pos], 2, m_rail_mV, POWER_SEQ_SAMPLES, adc_cal_get_chn(rail));
+	m_captured = true;
+	power_seq_analyse(result);
+
+	// A flag already asserted before the enable edge is reported at 0
+	result->faults = atomic_get(&m_faults);
+	fault_cycles = m_fault_cycles - m_enable_cycles;
+	if (result->faults && ((int32_t)fault_cycles > 0)) {
+		result->fault_us = k_cyc_to_us_near32(fault_cycles);
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Disables the AP22 switch and stops watching its fault flag
+*/
+void power_seq_off(void)
+{
+	if (m_config == NULL) {
+		return;
+	}
+
+	gpio_pin_interrupt_configure_dt(m_config->flg, GPIO_INT_DISABLE);
+	gpio_pin_set_raw(m_config->en->port, m_config->en->pin, 0);
+	m_powered = false;
+}
+
+/*!
+* @brief Gets the number of FLG assertions since the last power_seq_on()
+*/
+uint32_t power_seq_faults(void)
+{
+	return atomic_get(&m_faults);
+}
+
+/*!
+* @brief Gets one sampling of the last power up capture
+*
+* @param idx Sampling, 0 to POWER_SEQ_SAMPLES - 1
+* @param sample Where the sampling is stored
+*
+* @return 0 if successful
+* @return -ENODATA if no burst was captured
+* @return -EINVAL if idx is out of range
+*/
+int power_seq_get_sample(size_t idx, struct power_seq_sample *sample)
+{
+	if (!m_captured) {
+		return -ENODATA;
+	}
+	if (idx >= POWER_SEQ_SAMPLES) {
+		return -EINVAL;
+	}
+
+	sample->t_us = ((int32_t)idx - POWER_SEQ_PRE_SAMPLES) *
+		       (int32_t)power_seq_interval_us();
+	sample->current_uA = m_current_uA[idx];
+	sample->rail_mV = m_rail_mV[idx];
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef POWER_SEQ_H
+#define POWER_SEQ_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/gpio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * DUT power up through the AP22 load switch. The switch is enabled from the
+ * ADC callback in the middle of a burst of the current and rail channels, so
+ * every sample has a known time relative to the enable edge. The FLG output
+ * is watched by interrupt from power on to power off.
+ */
+
+/* Samplings in a burst, POWER_SEQ_PRE_SAMPLES of them before the enable edge */
+#define POWER_SEQ_SAMPLES           512
+#define POWER_SEQ_PRE_SAMPLES       16
+/* Default time between two samplings of the burst */
+#define POWER_SEQ_INTERVAL_US       100
+/* Samplings at the end of the burst averaged into the settled rail value */
+#define POWER_SEQ_SETTLED_SAMPLES   32
+
+struct power_seq_config {
+	const struct gpio_dt_spec *en;		/* AP22 enable, driven raw, high to enable */
+	const struct gpio_dt_spec *flg;		/* AP22 fault flag, active level from the devicetree */
+	const struct adc_dt_spec *adc_specs;	/* zephyr,user io-channels */
+	uint8_t current_chn;			/* index of the DUT current channel in adc_specs */
+	uint8_t rail_chn;			/* index of the switched rail channel in adc_specs */
+	uint32_t interval_us;			/* 0 for POWER_SEQ_INTERVAL_US */
+};
+
+/* Times are in us from the enable edge, within one sampling interval */
+struct power_seq_result {
+	int32_t inrush_peak_uA;
+	uint32_t inrush_peak_us;
+	int32_t rail_mV;			/* settled value at the end of the burst */
+	uint32_t rail_delay_us;			/* rail at 10% of its settled value */
+	uint32_t rise_us;			/* 10% to 90% of the settled value, one interval if faster */
+	bool rose;				/* rail reached 90% of a settled value above its start */
+	uint32_t faults;			/* FLG assertions since power on */
+	uint32_t fault_us;			/* first FLG assertion, valid when faults != 0 */
+};
+
+/* One sampling of the last burst, converted with the calibration it was taken with */
+struct power_seq_sample {
+	int32_t t_us;				/* from the enable edge, negative before it */
+	int32_t current_uA;
+	int32_t rail_mV;
+} __packed;
+
+int power_seq_init(const struct power_seq_config *config);
+int power_seq_on(struct power_seq_result *result);
+void power_seq_off(void);
+uint32_t power_seq_faults(void);
+int power_seq_get_sample(size_t idx, struct power_seq_sample *sample);
+
+#endif /* POWER_SEQ_H */
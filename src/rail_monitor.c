@@ -0,0 +1,310 @@
+#include "rail_monitor.h"
+#include "analog.h"
+
+#include <zephyr/sys/atomic.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(rail_monitor, LOG_LEVEL_INF);
+
+#define RAIL_MONITOR_STACK_SIZE     1024
+#define RAIL_MONITOR_PRIORITY       7
+
+/* Event bits: BIT(rail) while the rail is in its window, BIT(RAIL_EVT_OUT + rail) while it is not */
+#define RAIL_EVT_OUT                RAIL_MONITOR_MAX_RAILS
+
+static K_EVENT_DEFINE(rail_events);
+static K_SEM_DEFINE(rail_start_sem, 0, 1);
+/* Protects the configuration, the status and the callback against the monitor thread */
+static K_MUTEX_DEFINE(rail_lock);
+static K_TIMER_DEFINE(rail_timer, NULL, NULL);
+static atomic_t rail_running;
+/* Held by the thread for a whole scan, rail_monitor_pause() takes it to wait for the scan to end */
+static K_MUTEX_DEFINE(rail_scan_lock);
+static K_SEM_DEFINE(rail_resume_sem, 0, 1);
+static atomic_t rail_paused;
+
+static struct {
+	const struct adc_dt_spec *specs;
+	size_t count;
+	struct rail_window windows[RAIL_MONITOR_MAX_RAILS];
+	size_t rails;
+	uint32_t period_ms;
+	uint32_t start_cycles;
+	struct rail_status status[RAIL_MONITOR_MAX_RAILS];
+	uint8_t streak[RAIL_MONITOR_MAX_RAILS];		/* scans disagreeing with the state */
+	uint32_t streak_start[RAIL_MONITOR_MAX_RAILS];	/* timestamp of the first of them */
+	rail_monitor_cb_t cb;
+	void *user_data;
+} m_mon;
+
+static uint32_t rail_bits(uint8_t rail)
+{
+	return BIT(rail) | BIT(RAIL_EVT_OUT + rail);
+}
+
+static void rail_monitor_update(const struct adc_scan_result *scan)
+{
+	for (size_t r = 0; r < m_mon.rails; r++) {
+		const struct rail_window *win = &m_mon.windows[r];
+		struct rail_status *st = &m_mon.status[r];
+		int32_t mv = scan->value[win->chn];
+		bool in = (mv >= win->min_mV) && (mv <= win->max_mV);
+
+		st->last_mV = mv;
+		if (in == st->in_window) {
+			m_mon.streak[r] = 0;
+			continue;
+		}
+
+		// The change is dated from the first scan that saw it
+		if (m_mon.streak[r]++ == 0) {
+			m_mon.streak_start[r] = scan->timestamp;
+		}
+		if (m_mon.streak[r] < RAIL_MONITOR_DEBOUNCE) {
+			continue;
+		}
+		m_mon.streak[r] = 0;
+
+		st->in_window = in;
+		if (in) {
+			if (st->enter_count++ == 0) {
+				st->regulation_us = k_cyc_to_us_near32(m_mon.streak_start[r] - m_mon.start_cycles);
+			}
+			k_event_set_masked(&rail_events, BIT(r), rail_bits(r));
+		} else {
+			st->leave_count++;
+			k_event_set_masked(&rail_events, BIT(RAIL_EVT_OUT + r), rail_bits(r));
+		}
+
+		if (m_mon.cb) {
+			m_mon.cb(r, in ? RAIL_EVT_ENTER : RAIL_EVT_LEAVE, mv, m_mon.user_data);
+		}
+	}
+}
+
+static void rail_monitor_thread(void *p1, void *p2, void *p3)
+{
+	struct adc_scan_result scan;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&rail_start_sem, K_FOREVER);
+
+		while (atomic_get(&rail_running)) {
+			// Returns early when the monitor is stopped or paused
+			(void)k_timer_status_sync(&rail_timer);
+
+			k_mutex_lock(&rail_scan_lock, K_FOREVER);
+			if (atomic_get(&rail_paused)) {
+				k_mutex_unlock(&rail_scan_lock);
+				(void)k_sem_take(&rail_resume_sem, K_FOREVER);
+				continue;
+			}
+
+			// The ADC may be busy with a capture, do not keep the lock meanwhile
+			if (adc_scan_chn(m_mon.specs, m_mon.count, &scan) != 0) {
+				k_mutex_unlock(&rail_scan_lock);
+				continue;
+			}
+			k_mutex_unlock(&rail_scan_lock);
+
+			k_mutex_lock(&rail_lock, K_FOREVER);
+			if (atomic_get(&rail_running)) {
+				rail_monitor_update(&scan);
+			}
+			k_mutex_unlock(&rail_lock);
+		}
+	}
+}
+
+K_THREAD_DEFINE(rail_monitor_tid, RAIL_MONITOR_STACK_SIZE, rail_monitor_thread,
+		NULL, NULL, NULL, RAIL_MONITOR_PRIORITY, 0, 0);
+
+/*!
+* @brief Starts supervising the rails in the background
+*
+* All the channels are scanned every period_ms, the rails are judged on the
+* channels picked by their window. Every rail starts out of its window; the
+* time from this call to its first entry is its time to regulation.
+*
+* @param adc_specs Channels to scan, usually the zephyr,user io-channels
+* @param count Number of entries in adc_specs
+* @param windows Rails to supervise, copied
+* @param rails Number of entries in windows, up to RAIL_MONITOR_MAX_RAILS
+* @param period_ms Time between two scans, 0 for RAIL_MONITOR_PERIOD_MS
+*
+* @return 0 if successful
+* @return -EINVAL if a window refers to a channel that is not scanned
+* @return -EBUSY if the monitor is already running
+*/
+int rail_monitor_start(const struct adc_dt_spec *adc_specs, size_t count,
+		       const struct rail_window *windows, size_t rails, uint32_t period_ms)
+{
+	if ((rails == 0) || (rails > RAIL_MONITOR_MAX_RAILS) || (count > ADC_SCAN_MAX_CHN)) {
+		return -EINVAL;
+	}
+	for (size_t r = 0; r < rails; r++) {
+		if (windows[r].chn >= count) {
+			return -EINVAL;
+		}
+	}
+
+	if (period_ms == 0) {
+		period_ms = RAIL_MONITOR_PERIOD_MS;
+	}
+
+	k_mutex_lock(&rail_lock, K_FOREVER);
+	if (!atomic_cas(&rail_running, 0, 1)) {
+		k_mutex_unlock(&rail_lock);
+		return -EBUSY;
+	}
+
+	m_mon.specs = adc_specs;
+	m_mon.count = count;
+	memcpy(m_mon.windows, windows, rails * sizeof(windows[0]));
+	m_mon.rails = rails;
+	m_mon.period_ms = period_ms;
+	memset(m_mon.status, 0, sizeof(m_mon.status));
+	memset(m_mon.streak, 0, sizeof(m_mon.streak));
+	m_mon.start_cycles = k_cycle_get_32();
+
+	k_event_clear(&rail_events, UINT32_MAX);
+	for (size_t r = 0; r < rails; r++) {
+		k_event_post(&rail_events, BIT(RAIL_EVT_OUT + r));
+	}
+
+	atomic_clear(&rail_paused);
+	k_sem_reset(&rail_resume_sem);
+	k_timer_start(&rail_timer, K_NO_WAIT, K_MSEC(period_ms));
+	k_mutex_unlock(&rail_lock);
+
+	k_sem_give(&rail_start_sem);
+
+	LOG_DBG("Monitoring %u rails every %u ms", rails, period_ms);
+	return 0;
+}
+
+/*!
+* @brief Stops the monitor, no callback is running or called once it returns
+*
+* The status of the rails is kept until the next start.
+*/
+void rail_monitor_stop(void)
+{
+	k_mutex_lock(&rail_lock, K_FOREVER);
+	atomic_clear(&rail_running);
+	k_timer_stop(&rail_timer);
+	// A paused thread goes back to waiting for the next start
+	k_sem_give(&rail_resume_sem);
+	k_mutex_unlock(&rail_lock);
+}
+
+/*!
+* @brief Suspends the scans while a measurement needs the ADC and a quiet fixture
+*
+* Once it returns no scan is running and none starts until the matching
+* rail_monitor_resume(). Calls nest. The rails keep their last state, the
+* debouncing starts over on resume.
+*/
+void rail_monitor_pause(void)
+{
+	k_mutex_lock(&rail_lock, K_FOREVER);
+	if (atomic_inc(&rail_paused) == 0) {
+		k_timer_stop(&rail_timer);
+	}
+	k_mutex_unlock(&rail_lock);
+
+	// Waits for a scan in progress
+	k_mutex_lock(&rail_scan_lock, K_FOREVER);
+	k_mutex_unlock(&rail_scan_lock);
+}
+
+/*!
+* @brief Restarts the scans suspended by rail_monitor_pause()
+*/
+void rail_monitor_resume(void)
+{
+	k_mutex_lock(&rail_lock, K_FOREVER);
+	if ((atomic_get(&rail_paused) > 0) && (atomic_dec(&rail_paused) == 1)) {
+		memset(m_mon.streak, 0, sizeof(m_mon.streak));
+		if (atomic_get(&rail_running)) {
+			k_timer_start(&rail_timer, K_MSEC(m_mon.period_ms), K_MSEC(m_mon.period_ms));
+			k_sem_give(&rail_resume_sem);
+		}
+	}
+	k_mutex_unlock(&rail_lock);
+}
+
+bool rail_monitor_is_running(void)
+{
+	return atomic_get(&rail_running) != 0;
+}
+
+/*!
+* @brief Sets the function told about every rail entering or leaving its window
+*
+* Once it returns the previous callback is not running and is not called again.
+*
+* @param cb Callback, NULL for none
+* @param user_data Passed to cb
+*/
+void rail_monitor_set_callback(rail_monitor_cb_t cb, void *user_data)
+{
+	k_mutex_lock(&rail_lock, K_FOREVER);
+	m_mon.cb = cb;
+	m_mon.user_data = user_data;
+	k_mutex_unlock(&rail_lock);
+}
+
+/*!
+* @brief Waits until a rail is in (or out of) its window
+*
+* Returns at once if the rail already is in the state asked for.
+*
+* @param rail Index in the windows given to rail_monitor_start()
+* @param in_window true to wait for regulation, false to wait for a drop out
+* @param timeout Deadline
+*
+* @return 0 if the rail is in the state asked for
+* @return -EAGAIN if the deadline expired
+* @return -EINVAL if the rail is not monitored
+*/
+int rail_monitor_wait(uint8_t rail, bool in_window, k_timeout_t timeout)
+{
+	uint32_t bit;
+
+	if (rail >= m_mon.rails) {
+		return -EINVAL;
+	}
+
+	bit = in_window ? BIT(rail) : BIT(RAIL_EVT_OUT + rail);
+
+	return (k_event_wait(&rail_events, bit, false, timeout) != 0) ? 0 : -EAGAIN;
+}
+
+/*!
+* @brief Gets the state, the latest reading and the timings of a rail
+*
+* @param rail Index in the windows given to rail_monitor_start()
+* @param status Where the status is stored
+*
+* @return 0 if successful
+* @return -EINVAL if the rail is not monitored
+*/
+int rail_monitor_get_status(uint8_t rail, struct rail_status *status)
+{
+	int ret = -EINVAL;
+
+	k_mutex_lock(&rail_lock, K_FOREVER);
+	if (rail < m_mon.rails) {
+		*status = m_mon.status[rail];
+		ret = 0;
+	}
+	k_mutex_unlock(&rail_lock);
+
+	return ret;
+}
@@ -0,0 +1,57 @@
+#ifndef RAIL_MONITOR_H
+#define RAIL_MONITOR_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/adc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Background supervision of the supply rails. A low priority thread scans the
+ * channels every period and raises an event whenever a rail enters or leaves
+ * its window, so nobody has to poll the ADC while the rails ramp up. The
+ * SAADC limit events only cover one channel in continuous mode and the Zephyr
+ * ADC API does not expose them, hence the sampler.
+ */
+
+/* Rails supervised at the same time */
+#define RAIL_MONITOR_MAX_RAILS      4
+/* Default time between two scans, also the resolution of the timings */
+#define RAIL_MONITOR_PERIOD_MS      5
+/* Consecutive scans needed to change state, filters the ADC noise at the limits */
+#define RAIL_MONITOR_DEBOUNCE       2
+
+/* Acceptance window of a rail */
+struct rail_window {
+	uint8_t chn;			/* index in the channels passed to rail_monitor_start() */
+	int32_t min_mV;
+	int32_t max_mV;
+};
+
+enum rail_event {
+	RAIL_EVT_ENTER,			/* the rail got into its window */
+	RAIL_EVT_LEAVE,			/* the rail fell out of its window */
+};
+
+struct rail_status {
+	bool in_window;
+	int32_t last_mV;		/* latest reading */
+	uint32_t enter_count;
+	uint32_t leave_count;
+	uint32_t regulation_us;		/* start to first entry, 0 while never in window */
+};
+
+/* Called from the monitor thread, rail is the index in the windows array */
+typedef void (*rail_monitor_cb_t)(uint8_t rail, enum rail_event event, int32_t mv, void *user_data);
+
+int rail_monitor_start(const struct adc_dt_spec *adc_specs, size_t count,
+		       const struct rail_window *windows, size_t rails, uint32_t period_ms);
+void rail_monitor_stop(void);
+void rail_monitor_pause(void);
+void rail_monitor_resume(void);
+bool rail_monitor_is_running(void);
+void rail_monitor_set_callback(rail_monitor_cb_t cb, void *user_data);
+int rail_monitor_wait(uint8_t rail, bool in_window, k_timeout_t timeout);
+int rail_monitor_get_status(uint8_t rail, struct rail_status *status);
+
+#endif /* RAIL_MONITOR_H */
@@ -0,0 +1,233 @@
+#include "result_log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(result_log, LOG_LEVEL_INF);
+
+/* result_partition from the overlays, the generic storage partition on a board without one */
+#if FIXED_PARTITION_EXISTS(result_partition)
+#define RESULT_LOG_PARTITION_ID     FIXED_PARTITION_ID(result_partition)
+#elif FIXED_PARTITION_EXISTS(storage_partition)
+#define RESULT_LOG_PARTITION_ID     FIXED_PARTITION_ID(storage_partition)
+#endif
+
+#define RESULT_LOG_MAGIC            0x52534C54      /* "RSLT" */
+#define RESULT_LOG_MAX_SECTORS      16
+
+static K_MUTEX_DEFINE(result_log_lock);
+static struct fcb m_fcb;
+static struct flash_sector m_sectors[RESULT_LOG_MAX_SECTORS];
+static bool m_ready;
+static uint32_t m_next_seq;
+static uint64_t m_unit_id;
+
+/* Reads the record of an entry, entries of another size are skipped */
+static int result_log_entry_read(struct fcb_entry_ctx *ctx, struct result_record *record)
+{
+	if (ctx->loc.fe_data_len != sizeof(*record)) {
+		return -EINVAL;
+	}
+
+	return flash_area_read(ctx->fap, FCB_ENTRY_FA_DATA_OFF(ctx->loc), record, sizeof(*record));
+}
+
+static int result_log_find_seq(struct fcb_entry_ctx *ctx, void *arg)
+{
+	struct result_record record;
+
+	ARG_UNUSED(arg);
+
+	if ((result_log_entry_read(ctx, &record) == 0) && (record.seq >= m_next_seq)) {
+		m_next_seq = record.seq + 1;
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Opens the result log, the record numbering continues after the last record stored
+*
+* @return 0 if successful
+* @return -ENODEV if the board has no partition for it
+* @return other negative errno from the flash or the FCB
+*
+*/
+int result_log_init(void)
+{
+#ifdef RESULT_LOG_PARTITION_ID
+	uint32_t sector_cnt = ARRAY_SIZE(m_sectors);
+	int err;
+
+	k_mutex_lock(&result_log_lock, K_FOREVER);
+
+	err = flash_area_get_sectors(RESULT_LOG_PARTITION_ID, &sector_cnt, m_sectors);
+	if (err == 0) {
+		m_fcb.f_magic = RESULT_LOG_MAGIC;
+		m_fcb.f_version = RESULT_RECORD_VERSION;
+		m_fcb.f_sectors = m_sectors;
+		m_fcb.f_sector_cnt = sector_cnt;
+		m_fcb.f_scratch_cnt = 0;
+		err = fcb_init(RESULT_LOG_PARTITION_ID, &m_fcb);
+	}
+	if (err == 0) {
+		m_next_seq = 0;
+		err = fcb_walk(&m_fcb, NULL, result_log_find_seq, NULL);
+	}
+
+	m_ready = (err == 0);
+	k_mutex_unlock(&result_log_lock);
+
+	if (err) {
+		LOG_ERR("Result log not available (%d)", err);
+	} else {
+		LOG_INF("Result log: %u sectors, next record %u", sector_cnt, m_next_seq);
+	}
+
+	return err;
+#else
+	return -ENODEV;
+#endif
+}
+
+/*!
+* @brief Sets the DUT serial stored in the next records
+*
+* @param unit_id Serial number, 0 if unknown
+*
+*/
+void result_log_set_unit_id(uint64_t unit_id)
+{
+	m_unit_id = unit_id;
+}
+
+/*!
+* @brief Stores the result of a test sequence, erasing the oldest sector if the log is full
+*
+* @param steps Steps of the sequence as left by seq_run()
+* @param count Number of steps, those past RESULT_MAX_STEPS are not stored
+* @param passed Overall verdict
+* @param timestamp RTC time of the test, seconds since 1970
+*
+* @return 0 if successful
+* @return -ENODEV if the log is not available
+* @return other negative errno from the flash or the FCB
+*
+*/
+int result_log_append(const struct seq_step *steps, size_t count, bool passed, uint32_t timestamp)
+{
+	struct result_record record = {
+		.version = RESULT_RECORD_VERSION,
+		.step_count = MIN(count, RESULT_MAX_STEPS),
+		.verdict = passed ? 0 : 1,
+		.unit_id = m_unit_id,
+		.timestamp = timestamp,
+	};
+	struct fcb_entry loc;
+	int err;
+
+	for (size_t i = 0; i < record.step_count; i++) {
+		record.steps[i].result = steps[i].result;
+		record.steps[i].duration_ms = (uint16_t)MIN(steps[i].end_ms - steps[i].start_ms, UINT16_MAX);
+		record.steps[i].value = steps[i].value;
+	}
+
+	k_mutex_lock(&result_log_lock, K_FOREVER);
+
+	if (!m_ready) {
+		k_mutex_unlock(&result_log_lock);
+		return -ENODEV;
+	}
+
+	record.seq = m_next_seq;
+
+	err = fcb_append(&m_fcb, sizeof(record), &loc);
+	if (err == -ENOSPC) {
+		/* Circular: the oldest sector makes room */
+		err = fcb_rotate(&m_fcb);
+		if (err == 0) {
+			err = fcb_append(&m_fcb, sizeof(record), &loc);
+		}
+	}
+	if (err == 0) {
+		err = flash_area_write(m_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), &record, sizeof(record));
+	}
+	if (err == 0) {
+		err = fcb_append_finish(&m_fcb, &loc);
+	}
+	if (err == 0) {
+		m_next_seq++;
+	}
+
+	k_mutex_unlock(&result_log_lock);
+
+	return err;
+}
+
+struct result_log_walk {
+	uint32_t first_seq;
+	result_log_cb_t cb;
+	void *user_data;
+	int count;
+};
+
+static int result_log_walk_cb(struct fcb_entry_ctx *ctx, void *arg)
+{
+	struct result_log_walk *walk = arg;
+	struct result_record record;
+
+	if ((result_log_entry_read(ctx, &record) != 0) || (record.seq < walk->first_seq)) {
+		return 0;
+	}
+
+	walk->count++;
+
+	/* Non-zero stops the walk */
+	return walk->cb(&record, walk->user_data) ? 0 : 1;
+}
+
+/*!
+* @brief Reads the stored records, oldest first
+*
+* @param first_seq Records numbered below this are skipped
+* @param cb Called with each record, in the caller's context
+* @param user_data Passed to cb
+*
+* @return Number of records given to cb
+* @return -ENODEV if the log is not available
+* @return other negative errno from the flash or the FCB
+*
+*/
+int result_log_read(uint32_t first_seq, result_log_cb_t cb, void *user_data)
+{
+	struct result_log_walk walk = {
+		.first_seq = first_seq,
+		.cb = cb,
+		.user_data = user_data,
+	};
+	int err;
+
+	k_mutex_lock(&result_log_lock, K_FOREVER);
+
+	if (!m_ready) {
+		k_mutex_unlock(&result_log_lock);
+		return -ENODEV;
+	}
+
+	err = fcb_walk(&m_fcb, NULL, result_log_walk_cb, &walk);
+
+	k_mutex_unlock(&result_log_lock);
+
+	/* The walk ends early with the callback's 1 */
+	return (err < 0) ? err : walk.count;
+}
+
+/*!
+* @brief Returns the number the next record will get
+*/
+uint32_t result_log_next_seq(void)
+{
+	return m_next_seq;
+}
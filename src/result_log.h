@@ -0,0 +1,44 @@
+#ifndef RESULT_LOG_H
+#define RESULT_LOG_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
+
+#include "sequencer.h"
+
+/*
+ * Test results as fixed layout, little-endian records, appended to a flash
+ * circular buffer (FCB). The oldest sector is erased when the log is full.
+ * Records survive fixture resets and are fetched in bulk by the host.
+ */
+#define RESULT_RECORD_VERSION       1
+#define RESULT_MAX_STEPS            8
+
+struct result_step {
+	uint8_t result;             /* enum seq_result */
+	uint8_t reserved;
+	uint16_t duration_ms;
+	int32_t value;              /* step measurement: mV, uA, ppb... as the step defines it */
+} __packed;
+
+struct result_record {
+	uint8_t version;
+	uint8_t step_count;
+	uint8_t verdict;            /* 0 passed, 1 failed */
+	uint8_t reserved;
+	uint32_t seq;               /* record number, continues across resets */
+	uint64_t unit_id;           /* DUT serial given by the host, 0 if unknown */
+	uint32_t timestamp;         /* RTC time, seconds since 1970 */
+	struct result_step steps[RESULT_MAX_STEPS];
+} __packed;
+
+/* Called for each record found, return false to stop */
+typedef bool (*result_log_cb_t)(const struct result_record *record, void *user_data);
+
+int result_log_init(void);
+void result_log_set_unit_id(uint64_t unit_id);
+int result_log_append(const struct seq_step *steps, size_t count, bool passed, uint32_t timestamp);
+int result_log_read(uint32_t first_seq, result_log_cb_t cb, void *user_data);
+uint32_t result_log_next_seq(void);
+
+#endif /* RESULT_LOG_H */
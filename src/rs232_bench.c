@@ -0,0 +1,312 @@
+#include "rs232_bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+/* Time without any block coming back after which the blocks in flight are counted as lost */
+#define RS232_BENCH_DRAIN_MS	200
+
+static uint32_t m_sent_cycles[UINT8_MAX + 1];
+static uint32_t m_latencies[RS232_BENCH_MAX_LATENCIES];
+
+/* Pattern generator, the same sequence is rebuilt on the receiving side */
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static void rs232_bench_payload(uint32_t seed, uint16_t seq, uint8_t *payload)
+{
+	uint32_t state = seed ^ ((uint32_t)seq * 0x9E3779B9u);
+
+	if (state == 0) {
+		state = 1;
+	}
+
+	for (size_t i = 0; i < RS232_BENCH_PAYLOAD; i += 4) {
+		uint32_t val = xorshift32(&state);
+
+		memcpy(&payload[i], &val, 4);
+	}
+}
+
+static void rs232_bench_send_block(struct uart_port *port, uint32_t seed, uint16_t seq)
+{
+	uint8_t block[RS232_BENCH_BLOCK_SIZE];
+	uint16_t crc;
+
+	block[0] = RS232_BENCH_SYNC;
+	sys_put_le16(seq, &block[1]);
+	rs232_bench_payload(seed, seq, &block[3]);
+	crc = crc16_ccitt(0xFFFF, &block[1], 2 + RS232_BENCH_PAYLOAD);
+	sys_put_le16(crc, &block[3 + RS232_BENCH_PAYLOAD]);
+
+	m_sent_cycles[seq & UINT8_MAX] = k_cycle_get_32();
+	// A block cut by a partial write would desynchronize the receiver, it goes whole or waits
+	while (!uart_port_write_all(port, block, sizeof(block))) {
+		k_yield();
+	}
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t va = *(const uint32_t *)a;
+	uint32_t vb = *(const uint32_t *)b;
+
+	return (va > vb) - (va < vb);
+}
+
+/* Receive state: bytes of the block being assembled and the next expected sequence */
+struct rs232_bench_rx {
+	uint8_t block[RS232_BENCH_BLOCK_SIZE];
+	size_t len;
+	uint16_t next_seq;
+	uint32_t latencies;
+	bool resync;			/* looking for the next block after a bad CRC */
+};
+
+/* Returns false if the CRC is bad */
+static bool rs232_bench_check_block(struct rs232_bench_rx *rx, const struct rs232_bench_config *cfg,
+				    struct rs232_bench_result *res)
+{
+	uint8_t expected[RS232_BENCH_PAYLOAD];
+	uint16_t seq = sys_get_le16(&rx->block[1]);
+	uint16_t crc = sys_get_le16(&rx->block[3 + RS232_BENCH_PAYLOAD]);
+	uint32_t now = k_cycle_get_32();
+	bool crc_ok = (crc == crc16_ccitt(0xFFFF, &rx->block[1], 2 + RS232_BENCH_PAYLOAD));
+
+	if (!crc_ok) {
+		/* Candidates scanned while resynchronizing are not blocks, only the first one counts */
+		if (rx->resync) {
+			return false;
+		}
+		res->crc_errors++;
+		/* Corrupted header, take the expected sequence for the bit compare */
+		seq = rx->next_seq;
+	} else if ((int16_t)(seq - rx->next_seq) > 0) {
+		res->blocks_lost += (uint16_t)(seq - rx->next_seq);
+	}
+
+	rs232_bench_payload(cfg->seed, seq, expected);
+	for (size_t i = 0; i < RS232_BENCH_PAYLOAD; i++) {
+		res->bit_errors += popcount(expected[i] ^ rx->block[3 + i]);
+	}
+
+	res->crc32 = crc32_ieee_update(res->crc32, &rx->block[3], RS232_BENCH_PAYLOAD);
+	res->blocks_received++;
+
+	if (rx->latencies < RS232_BENCH_MAX_LATENCIES) {
+		m_latencies[rx->latencies++] = k_cyc_to_us_floor32(now - m_sent_cycles[seq & UINT8_MAX]);
+	}
+
+	/* A late or repeated block does not move the expected sequence back */
+	if ((int16_t)(seq - rx->next_seq) >= 0) {
+		rx->next_seq = seq + 1;
+	}
+
+	return crc_ok;
+}
+
+/* Restarts the block being assembled at the next sync byte after its first one */
+static void rs232_bench_resync(struct rs232_bench_rx *rx)
+{
+	uint8_t *sync = memchr(&rx->block[1], RS232_BENCH_SYNC, rx->len - 1);
+
+	if (sync == NULL) {
+		rx->len = 0;
+		return;
+	}
+
+	rx->len = &rx->block[rx->len] - sync;
+	memmove(rx->block, sync, rx->len);
+}
+
+/* Consumes the RX ring in place, assembling blocks from the sync byte on */
+static void rs232_bench_receive(struct uart_port *port, struct rs232_bench_rx *rx,
+				const struct rs232_bench_config *cfg, struct rs232_bench_result *res)
+{
+	uint8_t *data;
+	uint32_t len;
+
+	while ((len = ring_buf_get_claim(&port->rx, &data, port->rx_size)) > 0) {
+		for (uint32_t i = 0; i < len; i++) {
+			if ((rx->len == 0) && (data[i] != RS232_BENCH_SYNC)) {
+				continue;
+			}
+
+			rx->block[rx->len++] = data[i];
+			if (rx->len < RS232_BENCH_BLOCK_SIZE) {
+				continue;
+			}
+
+			/* A bad block may hold the start of the next one after a lost byte, scan its bytes again */
+			rx->resync = !rs232_bench_check_block(rx, cfg, res);
+			if (rx->resync) {
+				rs232_bench_resync(rx);
+			} else {
+				rx->len = 0;
+			}
+		}
+		ring_buf_get_finish(&port->rx, len);
+	}
+}
+
+/*!
+* @brief Streams pattern blocks through the looped back UART and checks them
+*
+* The DUT side of the port must loop TX back to RX. Blocks are sent with at
+* most cfg->window of them in flight, every received block is checked for
+* sequence, CRC and bit errors against the regenerated pattern.
+*
+* @param port Looped back port, nothing else may read it meanwhile
+* @param cfg Benchmark configuration
+* @param res Where the results are stored
+*
+* @return 0 if successful
+* @return -EINVAL if the configuration is not valid
+*
+*/
+int rs232_bench_run(struct uart_port *port, const struct rs232_bench_config *cfg,
+		    struct rs232_bench_result *res)
+{
+	struct rs232_bench_rx rx = {0};
+	struct uart_config uart_cfg;
+	uint32_t dropped = port->rx_dropped;
+	uint16_t seq = 0;
+	uint32_t received = 0;
+	int64_t last_rx;
+	int64_t start;
+	int64_t end;
+	int64_t elapsed;
+
+	memset(res, 0, sizeof(*res));
+	if ((cfg->window == 0) || (cfg->window > UINT8_MAX)) {
+		return -EINVAL;
+	}
+
+	if (uart_config_get(port->dev, &uart_cfg) == 0) {
+		res->baudrate = uart_cfg.baudrate;
+	}
+
+	/* Start from an empty line */
+	(void)uart_port_rx_discard(port);
+	(void)uart_err_check(port->dev);
+
+	start = k_uptime_get();
+	end = start + cfg->duration_ms;
+	last_rx = start;
+
+	while (k_uptime_get() < end) {
+		while ((uint16_t)(seq - rx.next_seq) < cfg->window) {
+			rs232_bench_send_block(port, cfg->seed, seq++);
+		}
+
+		(void)k_sem_take(&port->rx_sem, K_MSEC(10));
+		rs232_bench_receive(port, &rx, cfg, res);
+
+		if (uart_err_check(port->dev) & UART_ERROR_OVERRUN) {
+			res->overruns++;
+		}
+
+		if (res->blocks_received != received) {
+			received = res->blocks_received;
+			last_rx = k_uptime_get();
+		} else if (k_uptime_get() - last_rx > RS232_BENCH_DRAIN_MS) {
+			/* Nothing came back, give up on the blocks in flight and carry on */
+			res->blocks_lost += (uint16_t)(seq - rx.next_seq);
+			rx.next_seq = seq;
+			rx.len = 0;
+			rx.resync = false;
+			last_rx = k_uptime_get();
+		}
+	}
+
+	/* Let the blocks in flight come back */
+	end = k_uptime_get() + RS232_BENCH_DRAIN_MS;
+	while ((rx.next_seq != seq) && (k_uptime_get() < end)) {
+		(void)k_sem_take(&port->rx_sem, K_MSEC(10));
+		rs232_bench_receive(port, &rx, cfg, res);
+	}
+
+	elapsed = k_uptime_get() - start;
+	res->blocks_sent = seq;
+	res->blocks_lost += (uint16_t)(seq - rx.next_seq);
+	res->overruns += port->rx_dropped - dropped;
+	res->bytes_per_s = (uint32_t)(((uint64_t)res->blocks_received * RS232_BENCH_PAYLOAD * 1000) /
+				      MAX(elapsed, 1));
+
+	if (rx.latencies > 0) {
+		qsort(m_latencies, rx.latencies, sizeof(m_latencies[0]), cmp_u32);
+		res->latency_p50_us = m_latencies[(rx.latencies - 1) * 50 / 100];
+		res->latency_p95_us = m_latencies[(rx.latencies - 1) * 95 / 100];
+		res->latency_p99_us = m_latencies[(rx.latencies - 1) * 99 / 100];
+		res->latency_max_us = m_latencies[rx.latencies - 1];
+	}
+
+	return 0;
+}
+
+/*!
+* @brief Runs the benchmark at every given baud rate
+*
+* The original UART configuration is restored at the end. A rate the UART
+* does not accept is reported with all its counters at zero.
+*
+* @param port Looped back port
+* @param cfg Benchmark configuration used at every rate
+* @param bauds Baud rates to try, NULL for RS232_BENCH_DEFAULT_BAUDS
+* @param count Number of entries in bauds, and of results in res
+* @param res One result per baud rate
+*
+* @return Number of results stored in res
+* @return -EINVAL if the configuration is not valid
+* @return -ENOTSUP if the UART configuration can not be changed
+*
+*/
+int rs232_bench_sweep(struct uart_port *port, const struct rs232_bench_config *cfg,
+		      const uint32_t *bauds, size_t count, struct rs232_bench_result *res)
+{
+	static const uint32_t default_bauds[] = { RS232_BENCH_DEFAULT_BAUDS };
+	struct uart_config orig_cfg;
+	struct uart_config uart_cfg;
+
+	if ((cfg->window == 0) || (cfg->window > UINT8_MAX)) {
+		return -EINVAL;
+	}
+	if (uart_config_get(port->dev, &orig_cfg) != 0) {
+		return -ENOTSUP;
+	}
+
+	if (bauds == NULL) {
+		bauds = default_bauds;
+		count = MIN(count, ARRAY_SIZE(default_bauds));
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		uart_cfg = orig_cfg;
+		uart_cfg.baudrate = bauds[i];
+
+		if (uart_configure(port->dev, &uart_cfg) != 0) {
+			memset(&res[i], 0, sizeof(res[i]));
+			res[i].baudrate = bauds[i];
+			continue;
+		}
+
+		rs232_bench_run(port, cfg, &res[i]);
+	}
+
+	(void)uart_configure(port->dev, &orig_cfg);
+
+	return count;
+}
@@ -0,0 +1,46 @@
+#ifndef RS232_BENCH_H
+#define RS232_BENCH_H
+
+#include <zephyr/kernel.h>
+
+#include "uart_port.h"
+
+/* Pattern block: sync byte, 16 bit sequence number, payload, CRC-16 */
+#define RS232_BENCH_SYNC		0xA5
+#define RS232_BENCH_PAYLOAD		64
+#define RS232_BENCH_BLOCK_SIZE		(1 + 2 + RS232_BENCH_PAYLOAD + 2)
+
+/* Blocks whose latency is kept for the percentiles */
+#define RS232_BENCH_MAX_LATENCIES	512
+
+/* Baud rates tried by a sweep when none are given */
+#define RS232_BENCH_DEFAULT_BAUDS	9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1000000
+
+struct rs232_bench_config {
+	uint32_t duration_ms;		/* how long pattern blocks are sent */
+	uint32_t seed;			/* PRBS seed, the payload of each block derives from it */
+	uint8_t window;			/* blocks in flight before waiting for the loop */
+};
+
+struct rs232_bench_result {
+	uint32_t baudrate;
+	uint32_t blocks_sent;
+	uint32_t blocks_received;
+	uint32_t blocks_lost;		/* sequence numbers skipped */
+	uint32_t crc_errors;		/* blocks received with a bad CRC */
+	uint32_t bit_errors;		/* payload bits different from the pattern */
+	uint32_t overruns;		/* UART overrun errors plus bytes dropped in the RX ring */
+	uint32_t bytes_per_s;		/* received payload throughput */
+	uint32_t crc32;			/* running CRC of all the payload received */
+	uint32_t latency_p50_us;
+	uint32_t latency_p95_us;
+	uint32_t latency_p99_us;
+	uint32_t latency_max_us;
+};
+
+int rs232_bench_run(struct uart_port *port, const struct rs232_bench_config *cfg,
+		    struct rs232_bench_result *res);
+int rs232_bench_sweep(struct uart_port *port, const struct rs232_bench_config *cfg,
+		      const uint32_t *bauds, size_t count, struct rs232_bench_result *res);
+
+#endif /* RS232_BENCH_H */
@@ -0,0 +1,243 @@
+#include "rtc_drift.h"
+#include "pcf8523.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/rtc.h>
+#include <zephyr/sys/util.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(rtc_drift, LOG_LEVEL_INF);
+
+static void rtc_drift_count_work_handler(struct k_work *work);
+
+static struct {
+	const struct device *rtc;
+	uint32_t ticks;			/* seconds wanted */
+	uint32_t seen;			/* seconds timed so far */
+	bool started;			/* first interrupt taken as the reference */
+	uint32_t last_cycles;
+	int64_t first_ts;		/* counted mode: RTC time at the start */
+	struct rtc_drift_result result;
+	rtc_drift_done_t done;
+	void *user_data;
+} m_drift;
+
+static K_WORK_DELAYABLE_DEFINE(rtc_drift_count_work, rtc_drift_count_work_handler);
+
+static void rtc_drift_finish(void)
+{
+	struct rtc_drift_result *res = &m_drift.result;
+
+	if (res->counted) {
+		// Only whole seconds were counted, there is no drift to compute
+		m_drift.rtc = NULL;
+	} else {
+		uint64_t expected = (uint64_t)res->ticks * sys_clock_hw_cycles_per_sec();
+
+		rtc_update_set_callback(m_drift.rtc, NULL, NULL);
+		m_drift.rtc = NULL;
+
+		// Every interval spanned missed seconds, there is no single period to report
+		if (res->period_min_us == UINT32_MAX) {
+			res->period_min_us = 0;
+		}
+
+		// RTC fast: its seconds take fewer fixture cycles than they should
+		res->drift_ppb = (int32_t)(((int64_t)expected - (int64_t)res->cycles) * 1000000000LL /
+					   (int64_t)res->cycles);
+	}
+
+	if (m_drift.done) {
+		m_drift.done(res, m_drift.user_data);
+	}
+}
+
+static void rtc_drift_update_cb(const struct device *dev, void *user_data)
+{
+	uint32_t hz = sys_clock_hw_cycles_per_sec();
+	uint32_t now = pcf8523_int1_timestamp(dev);
+	uint32_t delta;
+	uint32_t n;
+
+	ARG_UNUSED(user_data);
+
+	if (m_drift.rtc == NULL) {
+		return;
+	}
+
+	if (!m_drift.started) {
+		m_drift.started = true;
+		m_drift.last_cycles = now;
+		return;
+	}
+
+	// Unsigned difference survives the 32 bit counter wrapping
+	delta = now - m_drift.last_cycles;
+	m_drift.last_cycles = now;
+
+	// An interrupt served late still ends a whole number of RTC seconds
+	n = (delta + hz / 2) / hz;
+	if (n == 0) {
+		return;
+	}
+	m_drift.result.missed += n - 1;
+	m_drift.seen += n;
+	m_drift.result.ticks = m_drift.seen;
+	m_drift.result.cycles += delta;
+
+	if (n == 1) {
+		uint32_t us = k_cyc_to_us_near32(delta);
+
+		m_drift.result.period_min_us = MIN(m_drift.result.period_min_us, us);
+		m_drift.result.period_max_us = MAX(m_drift.result.period_max_us, us);
+	}
+
+	if (m_drift.seen >= m_drift.ticks) {
+		rtc_drift_finish();
+	}
+}
+
+/* Counted mode, the second read is in the shadow registers */
+static void rtc_drift_count_read_done(const struct device *dev, int err, void *user_data)
+{
+	int64_t ts;
+
+	ARG_UNUSED(user_data);
+
+	if (m_drift.rtc == NULL) {
+		return;
+	}
+
+	if ((err == 0) && (pcf8523_get_time_cached(dev, &ts) == 0) && (ts > m_drift.first_ts)) {
+		m_drift.result.ticks = (uint32_t)(ts - m_drift.first_ts);
+	}
+	rtc_drift_finish();
+}
+
+/* Counted mode, ticks fixture seconds after the first read: the second one, in the background */
+static void rtc_drift_count_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (m_drift.rtc == NULL) {
+		return;
+	}
+
+	m_drift.result.cycles = (uint32_t)(k_cycle_get_32() - m_drift.last_cycles);
+	if (pcf8523_refresh_async(m_drift.rtc, rtc_drift_count_read_done, NULL) != 0) {
+		rtc_drift_count_read_done(m_drift.rtc, pcf8523_refresh(m_drift.rtc) ? -EIO : 0, NULL);
+	}
+}
+
+/* No second interrupt, the time is read now and after ticks fixture seconds */
+static int rtc_drift_start_counted(const struct device *rtc, uint32_t ticks)
+{
+	if (pcf8523_get_time(rtc, &m_drift.first_ts) != 0) {
+		return -EIO;
+	}
+	m_drift.last_cycles = k_cycle_get_32();
+	m_drift.result.counted = true;
+	m_drift.result.period_min_us = 0;
+
+	k_work_schedule(&rtc_drift_count_work, K_SECONDS(ticks));
+	return 0;
+}
+
+/*!
+* @brief Starts timing RTC second interrupts, the result is delivered to a callback
+*
+* Returns at once; the other tests keep running while the RTC ticks. The
+* first interrupt only sets the reference, so the measurement takes
+* ticks + 1 seconds. An RTC without an interrupt line has its seconds
+* counted over ticks seconds instead, see rtc_drift_result.counted.
+*
+* @param rtc RTC device
+* @param ticks Number of RTC seconds to time
+* @param done Called with the result
+* @param user_data Passed to done
+*
+* @return 0 if the measurement started
+* @return -EBUSY if a measurement is already running
+* @return -EIO if the RTC could not be read
+* @return other negative errno from the RTC driver
+*/
+int rtc_drift_start(const struct device *rtc, uint32_t ticks, rtc_drift_done_t done, void *user_data)
+{
+	int ret;
+
+	if ((ticks == 0) || (done == NULL)) {
+		return -EINVAL;
+	}
+	if (m_drift.rtc != NULL) {
+		return -EBUSY;
+	}
+
+	memset(&m_drift, 0, sizeof(m_drift));
+	m_drift.ticks = ticks;
+	m_drift.done = done;
+	m_drift.user_data = user_data;
+	m_drift.result.period_min_us = UINT32_MAX;
+	m_drift.rtc = rtc;
+
+	ret = rtc_update_set_callback(rtc, rtc_drift_update_cb, NULL);
+	if ((ret == -ENOTSUP) || (ret == -ENOSYS)) {
+		LOG_DBG("No RTC second interrupt, counting %u seconds", ticks);
+		ret = rtc_drift_start_counted(rtc, ticks);
+	}
+	if (ret != 0) {
+		m_drift.rtc = NULL;
+		return ret;
+	}
+
+	LOG_DBG("Timing %u RTC seconds", ticks);
+	return 0;
+}
+
+/*!
+* @brief Stops a running measurement without calling its callback
+*/
+void rtc_drift_cancel(void)
+{
+	const struct device *rtc = m_drift.rtc;
+
+	if (rtc != NULL) {
+		m_drift.rtc = NULL;
+		if (m_drift.result.counted) {
+			(void)k_work_cancel_delayable(&rtc_drift_count_work);
+		} else {
+			rtc_update_set_callback(rtc, NULL, NULL);
+		}
+	}
+}
+
+/*!
+* @brief Checks a measurement against RTC_DRIFT_MAX_PPM
+*
+* A counted measurement passes when the RTC advanced by the fixture seconds,
+* give or take the one a second boundary between the two reads can add.
+*
+* @param result Measurement result
+*
+* @return true if every second was timed and the drift is within limits
+*/
+bool rtc_drift_ok(const struct rtc_drift_result *result)
+{
+	int32_t ppb = result->drift_ppb;
+
+	if (result->ticks == 0) {
+		return false;
+	}
+	if (result->counted) {
+		uint32_t hz = sys_clock_hw_cycles_per_sec();
+		int64_t fixture_s = (result->cycles + hz / 2) / hz;
+
+		return llabs((int64_t)result->ticks - fixture_s) <= 1;
+	}
+	if (ppb < 0) {
+		ppb = -ppb;
+	}
+
+	return ppb <= RTC_DRIFT_MAX_PPM * 1000;
+}
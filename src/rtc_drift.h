@@ -0,0 +1,42 @@
+#ifndef RTC_DRIFT_H
+#define RTC_DRIFT_H
+
+#include <zephyr/device.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * RTC crystal accuracy, measured by timestamping consecutive PCF8523 second
+ * interrupts (SF on INT1) against k_cycle_get_32(). The result is only as
+ * good as the fixture clock: on the nRF52840 the system timer runs from the
+ * 32.768 kHz LFCLK, so 10 ticks resolve about 3 ppm.
+ *
+ * Without an INT1 line, as on the current fixture board, the RTC seconds are
+ * only counted: the time is read at the start and again after the same
+ * number of fixture seconds. That finds a stopped or wrongly set oscillator,
+ * not a drift in ppm, and the result says so with counted set.
+ */
+
+/* RTC seconds timed by a default measurement */
+#define RTC_DRIFT_TICKS             10
+/* Accepted crystal error */
+#define RTC_DRIFT_MAX_PPM           50
+
+struct rtc_drift_result {
+	uint32_t ticks;			/* RTC seconds measured */
+	uint32_t missed;		/* seconds without their own interrupt, covered by the next one */
+	uint64_t cycles;		/* system clock cycles over those seconds */
+	int32_t drift_ppb;		/* positive when the RTC runs fast */
+	uint32_t period_min_us;		/* shortest and longest time between interrupts one second apart, */
+	uint32_t period_max_us;		/* 0 if every interval covered missed seconds */
+	bool counted;			/* no INT1: seconds counted between two reads, drift_ppb is 0 */
+};
+
+/* Called from the system work queue once the measurement is over */
+typedef void (*rtc_drift_done_t)(const struct rtc_drift_result *result, void *user_data);
+
+int rtc_drift_start(const struct device *rtc, uint32_t ticks, rtc_drift_done_t done, void *user_data);
+void rtc_drift_cancel(void);
+bool rtc_drift_ok(const struct rtc_drift_result *result);
+
+#endif /* RTC_DRIFT_H */
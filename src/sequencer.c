@@ -0,0 +1,244 @@
+#include "sequencer.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(sequencer, LOG_LEVEL_INF);
+
+#define SEQ_STACK_SIZE		2048
+#define SEQ_PRIORITY		5
+
+K_THREAD_STACK_DEFINE(seq_stack, SEQ_STACK_SIZE);
+static struct k_work_q seq_work_q;
+static K_EVENT_DEFINE(seq_events);
+/* One sequence at a time, the host may ask for single steps while the boot sequence runs */
+static K_MUTEX_DEFINE(seq_lock);
+
+/* Sequence being run, needed to map a step to its event bit */
+static struct seq_step *m_steps;
+
+static uint32_t seq_step_bit(const struct seq_step *step)
+{
+	return BIT(step - m_steps);
+}
+
+static void seq_step_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct seq_step *step = CONTAINER_OF(dwork, struct seq_step, work);
+
+	if (!atomic_get(&step->done)) {
+		step->handler(step);
+	}
+}
+
+static void seq_step_timeout_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct seq_step *step = CONTAINER_OF(dwork, struct seq_step, timeout);
+
+	seq_step_done(step, SEQ_TIMEOUT);
+}
+
+static void seq_step_start(struct seq_step *step)
+{
+	step->result = SEQ_RUNNING;
+	step->start_ms = k_uptime_get();
+
+	if (step->timeout_ms) {
+		k_work_schedule_for_queue(&seq_work_q, &step->timeout, K_MSEC(step->timeout_ms));
+	}
+	k_work_schedule_for_queue(&seq_work_q, &step->work, K_NO_WAIT);
+}
+
+/*!
+* @brief Starts the sequencer work queue, called once before seq_run()
+*/
+void seq_init(void)
+{
+	k_work_queue_start(&seq_work_q, seq_stack, K_THREAD_STACK_SIZEOF(seq_stack),
+			   SEQ_PRIORITY, NULL);
+	k_thread_name_set(&seq_work_q.thread, "sequencer");
+}
+
+static int seq_run_locked(struct seq_step *steps, size_t count, k_timeout_t timeout);
+
+/*!
+* @brief Runs a sequence of test steps
+*
+* Every step whose dependencies passed is started right away, so
+* independent steps overlap: while one waits in seq_step_defer() the others
+* keep running. Steps depending on a step that did not pass are skipped.
+* Sequences are run one at a time, a second caller waits for the first one.
+*
+* All the handlers share the one sequencer work queue, steps only overlap
+* while they wait in seq_step_defer() or on an event. A handler that blocks,
+* e.g. on an ADC window or a power up capture, holds every other step back
+* for as long, their timeouts keep running meanwhile.
+*
+* @param steps Steps of the sequence, results are stored in them
+* @param count Number of steps, up to SEQ_MAX_STEPS
+* @param timeout Deadline for the whole sequence
+*
+* @return 0 if all the steps passed
+* @return -EFAULT if a step did not pass
+* @return -EAGAIN if the sequence deadline expired
+* @return -EINVAL if there are too many steps
+*
+*/
+int seq_run(struct seq_step *steps, size_t count, k_timeout_t timeout)
+{
+	int ret;
+
+	k_mutex_lock(&seq_lock, K_FOREVER);
+	ret = seq_run_locked(steps, count, timeout);
+	k_mutex_unlock(&seq_lock);
+
+	return ret;
+}
+
+/*!
+* @brief Runs a sequence of test steps unless another one is running
+*
+* Same as seq_run(), without waiting for a sequence already running.
+*
+* @return -EBUSY if a sequence is running
+*
+*/
+int seq_try_run(struct seq_step *steps, size_t count, k_timeout_t timeout)
+{
+	int ret;
+
+	if (k_mutex_lock(&seq_lock, K_NO_WAIT) != 0) {
+		return -EBUSY;
+	}
+	ret = seq_run_locked(steps, count, timeout);
+	k_mutex_unlock(&seq_lock);
+
+	return ret;
+}
+
+static int seq_run_locked(struct seq_step *steps, size_t count, k_timeout_t timeout)
+{
+	uint32_t all;
+	uint32_t finished = 0;
+	uint32_t passed = 0;
+	uint32_t started = 0;
+	k_timepoint_t deadline = sys_timepoint_calc(timeout);
+	bool progress = true;
+
+	if (count > SEQ_MAX_STEPS) {
+		return -EINVAL;
+	}
+	/* BIT_MASK(32) would shift a 32 bit value by its width */
+	all = (count == 32) ? UINT32_MAX : BIT_MASK(count);
+
+	m_steps = steps;
+	k_event_clear(&seq_events, UINT32_MAX);
+
+	for (size_t i = 0; i < count; i++) {
+		steps[i].result = SEQ_PENDING;
+		steps[i].phase = 0;
+		steps[i].value = 0;
+		atomic_clear(&steps[i].done);
+		k_work_init_delayable(&steps[i].work, seq_step_work_handler);
+		k_work_init_delayable(&steps[i].timeout, seq_step_timeout_handler);
+	}
+
+	while (finished != all) {
+		/* Start or skip whatever became ready */
+		while (progress) {
+			progress = false;
+			for (size_t i = 0; i < count; i++) {
+				if ((started | finished) & BIT(i)) {
+					continue;
+				}
+				if ((steps[i].depends & finished & ~passed) != 0) {
+					steps[i].result = SEQ_SKIPPED;
+					finished |= BIT(i);
+					progress = true;
+				} else if ((steps[i].depends & passed) == steps[i].depends) {
+					started |= BIT(i);
+					seq_step_start(&steps[i]);
+				}
+			}
+		}
+
+		if (finished == all) {
+			break;
+		}
+
+		uint32_t events = k_event_wait(&seq_events, all & ~finished, false,
+					       sys_timepoint_timeout(deadline));
+		if (events == 0) {
+			LOG_ERR("Sequence deadline expired");
+			for (size_t i = 0; i < count; i++) {
+				if (!(finished & BIT(i))) {
+					seq_step_done(&steps[i], SEQ_TIMEOUT);
+				}
+			}
+			return -EAGAIN;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			if ((events & BIT(i)) && !(finished & BIT(i))) {
+				finished |= BIT(i);
+				if (steps[i].result == SEQ_PASSED) {
+					passed |= BIT(i);
+				}
+				progress = true;
+			}
+		}
+	}
+
+	return (passed == all) ? 0 : -EFAULT;
+}
+
+/*!
+* @brief Finishes a step, only the first call for a step counts
+*
+* @param step Step to finish
+* @param result Final result of the step
+*/
+void seq_step_done(struct seq_step *step, enum seq_result result)
+{
+	if (!atomic_cas(&step->done, 0, 1)) {
+		return;
+	}
+
+	(void)k_work_cancel_delayable(&step->timeout);
+	(void)k_work_cancel_delayable(&step->work);
+
+	step->result = result;
+	step->end_ms = k_uptime_get();
+	k_event_post(&seq_events, seq_step_bit(step));
+}
+
+/*!
+* @brief Calls the step handler again after a delay, without blocking the work queue
+*
+* @param step Step to resume
+* @param delay_ms Time to wait
+*/
+void seq_step_defer(struct seq_step *step, uint32_t delay_ms)
+{
+	k_work_schedule_for_queue(&seq_work_q, &step->work, K_MSEC(delay_ms));
+}
+
+const char *seq_result_str(enum seq_result result)
+{
+	switch (result) {
+	case SEQ_PENDING:
+		return "PENDING";
+	case SEQ_RUNNING:
+		return "RUNNING";
+	case SEQ_PASSED:
+		return "PASSED";
+	case SEQ_FAILED:
+		return "FAILED";
+	case SEQ_TIMEOUT:
+		return "TIMEOUT";
+	case SEQ_SKIPPED:
+		return "SKIPPED";
+	default:
+		return "?";
+	}
+}
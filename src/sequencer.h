@@ -0,0 +1,61 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+/* Maximum number of steps in a sequence, one event bit per step */
+#define SEQ_MAX_STEPS		32
+
+enum seq_result {
+	SEQ_PENDING,
+	SEQ_RUNNING,
+	SEQ_PASSED,
+	SEQ_FAILED,
+	SEQ_TIMEOUT,
+	SEQ_SKIPPED,		/* a step it depends on did not pass */
+};
+
+struct seq_step;
+
+/*
+ * Step handler, called from the sequencer work queue. It must not block for
+ * long: either finish with seq_step_done() or come back later with
+ * seq_step_defer(), using step->phase to know where it left off. The queue
+ * is shared by all the steps, while one handler blocks the others wait.
+ */
+typedef void (*seq_step_handler_t)(struct seq_step *step);
+
+struct seq_step {
+	const char *name;
+	seq_step_handler_t handler;
+	uint32_t depends;		/* BIT() of the steps that must pass before this one starts */
+	uint32_t timeout_ms;		/* 0 for no timeout */
+
+	/* Runtime state */
+	enum seq_result result;
+	uint32_t phase;			/* free for the handler, 0 on the first call */
+	int32_t value;			/* main measurement of the step, kept in the result record */
+	int64_t start_ms;
+	int64_t end_ms;
+	atomic_t done;
+	struct k_work_delayable work;
+	struct k_work_delayable timeout;
+};
+
+#define SEQ_STEP(_name, _handler, _depends, _timeout_ms)	\
+	{							\
+		.name = _name,					\
+		.handler = _handler,				\
+		.depends = _depends,				\
+		.timeout_ms = _timeout_ms,			\
+	}
+
+void seq_init(void);
+int seq_run(struct seq_step *steps, size_t count, k_timeout_t timeout);
+int seq_try_run(struct seq_step *steps, size_t count, k_timeout_t timeout);
+void seq_step_done(struct seq_step *step, enum seq_result result);
+void seq_step_defer(struct seq_step *step, uint32_t delay_ms);
+const char *seq_result_str(enum seq_result result);
+
+#endif /* SEQUENCER_H */
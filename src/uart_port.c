@@ -0,0 +1,256 @@
+#include "uart_port.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/uart.h>
+
+/*
+ * The ISR moves data straight between the UART FIFO and the ring buffer
+ * memory with the claim API, nothing is copied through the stack.
+ */
+static void uart_port_interrupt_handler(const struct device *dev, void *user_data)
+{
+	struct uart_port *port = user_data;
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+
+		/* Interrupt triggered by RX pin */
+		if (uart_irq_rx_ready(dev)) {
+			uint8_t *data;
+			uint32_t len;
+			int recv_len;
+
+			len = ring_buf_put_claim(&port->rx, &data, port->rx_size);
+			if ((len == 0) && port->rx_flow_control) {
+				/* Leave the data in the FIFO, the sender is held off until there is room */
+				uart_irq_rx_disable(dev);
+				port->rx_paused = true;
+				continue;
+			} else if (len == 0) {
+				/* Ring full, drain the FIFO so the interrupt is cleared */
+				uint8_t discard[16];
+
+				recv_len = uart_fifo_read(dev, discard, sizeof(discard));
+				if (recv_len > 0) {
+					port->rx_dropped += recv_len;
+				}
+				continue;
+			}
+
+			recv_len = uart_fifo_read(dev, data, len);
+			if (recv_len < 0) {
+				recv_len = 0;
+			}
+			ring_buf_put_finish(&port->rx, recv_len);
+			if (recv_len > 0) {
+				k_sem_give(&port->rx_sem);
+			}
+		}
+
+		/* Interrupt triggered by TX pin */
+		if (uart_irq_tx_ready(dev)) {
+			uint8_t *data;
+			uint32_t len;
+			int send_len;
+
+			len = ring_buf_get_claim(&port->tx, &data, port->tx_size);
+			if (len == 0) {
+				uart_irq_tx_disable(dev);
+				continue;
+			}
+
+			send_len = uart_fifo_fill(dev, data, len);
+			if (send_len < 0) {
+				send_len = 0;
+			}
+			/* Whatever did not fit in the FIFO stays in the ring for the next interrupt */
+			ring_buf_get_finish(&port->tx, send_len);
+		}
+	}
+}
+
+/* Enables RX again once the application made room in a paused ring */
+static void uart_port_rx_resume(struct uart_port *port)
+{
+	if (port->rx_paused && (ring_buf_space_get(&port->rx) > 0)) {
+		port->rx_paused = false;
+		uart_irq_rx_enable(port->dev);
+	}
+}
+
+/*!
+* @brief Initializes the ring buffers of a port and enables its RX interrupt
+*
+* @param port Port defined with UART_PORT_DEFINE
+*
+* @return 0 if successful
+* @return -ENODEV if the UART is not ready
+*
+*/
+int uart_port_init(struct uart_port *port)
+{
+	if (!device_is_ready(port->dev)) {
+		return -ENODEV;
+	}
+
+	ring_buf_init(&port->rx, port->rx_size, port->rx_storage);
+	ring_buf_init(&port->tx, port->tx_size, port->tx_storage);
+	k_sem_init(&port->rx_sem, 0, 1);
+
+	uart_irq_callback_user_data_set(port->dev, uart_port_interrupt_handler, port);
+	uart_irq_rx_enable(port->dev);
+
+	return 0;
+}
+
+/*!
+* @brief Queues data for transmission and starts the TX interrupt
+*
+* Safe to call from several threads.
+*
+* @return Number of bytes queued
+*/
+uint32_t uart_port_write(struct uart_port *port, const uint8_t *data, uint32_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&port->tx_lock);
+	uint32_t put = ring_buf_put(&port->tx, data, len);
+
+	port->tx_dropped += len - put;
+	k_spin_unlock(&port->tx_lock, key);
+
+	if (put) {
+		uart_irq_tx_enable(port->dev);
+	}
+
+	return put;
+}
+
+/*!
+* @brief Queues data for transmission only if all of it fits
+*
+* Used for frames that must not be cut by other writers.
+*
+* @return true if the data was queued, false if nothing was queued
+*/
+bool uart_port_write_all(struct uart_port *port, const uint8_t *data, uint32_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&port->tx_lock);
+	bool fits = ring_buf_space_get(&port->tx) >= len;
+
+	if (fits) {
+		ring_buf_put(&port->tx, data, len);
+	} else {
+		port->tx_dropped += len;
+	}
+	k_spin_unlock(&port->tx_lock, key);
+
+	if (fits) {
+		uart_irq_tx_enable(port->dev);
+	}
+
+	return fits;
+}
+
+/*!
+* @brief Gets received data from the port
+*
+* @return Number of bytes copied to data
+*/
+uint32_t uart_port_read(struct uart_port *port, uint8_t *data, uint32_t len)
+{
+	uint32_t got = ring_buf_get(&port->rx, data, len);
+
+	uart_port_rx_resume(port);
+
+	return got;
+}
+
+/*!
+* @brief Drops everything received so far
+*
+* The ring is emptied from the reading side, so the ISR can keep filling it
+* meanwhile.
+*
+* @return Number of bytes dropped
+*/
+uint32_t uart_port_rx_discard(struct uart_port *port)
+{
+	uint32_t dropped = 0;
+	uint32_t len;
+	uint8_t *data;
+
+	while ((len = ring_buf_get_claim(&port->rx, &data, port->rx_size)) > 0) {
+		ring_buf_get_finish(&port->rx, len);
+		dropped += len;
+	}
+	uart_port_rx_resume(port);
+
+	return dropped;
+}
+
+/*!
+* @brief Moves received data of one port to the transmit ring of another one
+*
+* Data is read in place from the RX ring and only what fits in the TX ring
+* is consumed, the rest stays queued so the sender is held back.
+*
+* @return Number of bytes moved
+*/
+uint32_t uart_port_forward(struct uart_port *from, struct uart_port *to)
+{
+	uint32_t moved = 0;
+	uint32_t len;
+	uint8_t *data;
+
+	do {
+		k_spinlock_key_t key = k_spin_lock(&to->tx_lock);
+
+		len = ring_buf_get_claim(&from->rx, &data, ring_buf_space_get(&to->tx));
+		len = ring_buf_put(&to->tx, data, len);
+		k_spin_unlock(&to->tx_lock, key);
+
+		ring_buf_get_finish(&from->rx, len);
+		moved += len;
+	} while (len > 0);
+
+	if (moved) {
+		uart_irq_tx_enable(to->dev);
+		uart_port_rx_resume(from);
+	}
+
+	return moved;
+}
+
+/*!
+* @brief Selects what happens when the RX ring is full
+*
+* @param enable true to stop reading the UART (the USB host is NAKed), false to drop data
+*/
+void uart_port_set_flow_control(struct uart_port *port, bool enable)
+{
+	port->rx_flow_control = enable;
+	if (!enable) {
+		uart_port_rx_resume(port);
+	}
+}
+
+/*!
+* @brief Takes the port for a user that needs the line alone
+*
+* The bridge, the RS-232 benchmark and test and the DUT programming all
+* share the DUT UART, each one claims it for as long as it runs.
+*
+* @return 0 if successful
+* @return -EBUSY if another user has it
+*/
+int uart_port_claim(struct uart_port *port)
+{
+	return atomic_cas(&port->claimed, 0, 1) ? 0 : -EBUSY;
+}
+
+/*!
+* @brief Gives back a port taken with uart_port_claim()
+*/
+void uart_port_release(struct uart_port *port)
+{
+	atomic_clear(&port->claimed);
+}
@@ -0,0 +1,56 @@
+#ifndef UART_PORT_H
+#define UART_PORT_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/ring_buffer.h>
+
+/* Buffer sizes of the ports used by the application */
+#define USB_PORT_RX_SIZE	1024
+#define USB_PORT_TX_SIZE	4096
+#define UART1_PORT_RX_SIZE	2048
+#define UART1_PORT_TX_SIZE	2048
+
+/* Interrupt driven UART with its own RX and TX ring buffers */
+struct uart_port {
+	const struct device *dev;
+	uint8_t *rx_storage;
+	uint8_t *tx_storage;
+	uint32_t rx_size;
+	uint32_t tx_size;
+	struct ring_buf rx;
+	struct ring_buf tx;
+	struct k_spinlock tx_lock;
+	struct k_sem rx_sem;		/* given by the ISR when data is received */
+	bool rx_flow_control;		/* stop reading the FIFO instead of dropping when the RX ring is full */
+	bool rx_paused;
+	uint32_t rx_dropped;		/* bytes lost because the RX ring was full */
+	uint32_t tx_dropped;		/* bytes not queued because the TX ring was full */
+	atomic_t claimed;		/* taken by a user that needs the port alone */
+};
+
+/* Defines a port and the storage of its ring buffers */
+#define UART_PORT_DEFINE(_name, _dev, _rx_size, _tx_size)		\
+	static uint8_t _name##_rx_storage[_rx_size];			\
+	static uint8_t _name##_tx_storage[_tx_size];			\
+	struct uart_port _name = {					\
+		.dev = _dev,						\
+		.rx_storage = _name##_rx_storage,			\
+		.tx_storage = _name##_tx_storage,			\
+		.rx_size = _rx_size,					\
+		.tx_size = _tx_size,					\
+	}
+
+int uart_port_init(struct uart_port *port);
+uint32_t uart_port_write(struct uart_port *port, const uint8_t *data, uint32_t len);
+bool uart_port_write_all(struct uart_port *port, const uint8_t *data, uint32_t len);
+uint32_t uart_port_read(struct uart_port *port, uint8_t *data, uint32_t len);
+uint32_t uart_port_rx_discard(struct uart_port *port);
+uint32_t uart_port_forward(struct uart_port *from, struct uart_port *to);
+void uart_port_set_flow_control(struct uart_port *port, bool enable);
+int uart_port_claim(struct uart_port *port);
+void uart_port_release(struct uart_port *port);
+
+#endif /* UART_PORT_H */
@@ -0,0 +1,45 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+#ifdef CONFIG_EXTERNAL_LIBC
+#include <time.h>
+#endif
+
+/*
+ * Elapsed time for the benchmarks. On native_sim the kernel clock is
+ * simulated and only moves when the CPU idles, so the host monotonic clock
+ * is used instead. The thresholds are an order of magnitude below what a
+ * build host reaches, they catch a regression, not a slower machine.
+ */
+
+static inline uint64_t bench_start(void)
+{
+#ifdef CONFIG_EXTERNAL_LIBC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * NSEC_PER_SEC) + ts.tv_nsec;
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+static inline uint64_t bench_elapsed_ns(uint64_t start)
+{
+#ifdef CONFIG_EXTERNAL_LIBC
+	return MAX(bench_start() - start, 1);
+#else
+	return MAX(k_cyc_to_ns_floor64((uint32_t)(k_cycle_get_32() - (uint32_t)start)), 1);
+#endif
+}
+
+/* Rate of count items done in ns */
+static inline uint64_t bench_per_sec(uint64_t count, uint64_t ns)
+{
+	return (count * NSEC_PER_SEC) / ns;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,191 @@
+#include "dut_bl_emul.h"
+#include "dut_flash.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#define DUT_BL_EMUL_MAX_PAYLOAD     (4 + DUT_FLASH_BLOCK_SIZE)
+#define DUT_BL_EMUL_NAK             1
+
+struct dut_bl_emul dut_bl_emul;
+
+static const struct device *m_dev;
+static bool m_powered;
+static uint8_t m_rx[DUT_BL_HEADER_SIZE + DUT_BL_EMUL_MAX_PAYLOAD + DUT_BL_CRC_SIZE];
+static size_t m_rx_len;
+
+static void dut_bl_emul_answer(uint8_t cmd, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+	uint8_t frame[DUT_BL_HEADER_SIZE + 8 + DUT_BL_CRC_SIZE];
+
+	frame[0] = DUT_BL_SYNC;
+	frame[1] = cmd | DUT_BL_ANSWER;
+	sys_put_le16(seq, &frame[2]);
+	sys_put_le16(len, &frame[4]);
+	memcpy(&frame[DUT_BL_HEADER_SIZE], payload, len);
+	sys_put_le16(crc16_ccitt(0xFFFF, &frame[1], DUT_BL_HEADER_SIZE - 1 + len), &frame[DUT_BL_HEADER_SIZE + len]);
+
+	(void)uart_emul_put_rx_data(m_dev, frame, DUT_BL_HEADER_SIZE + len + DUT_BL_CRC_SIZE);
+}
+
+static void dut_bl_emul_status(uint8_t cmd, uint16_t seq, uint8_t status)
+{
+	dut_bl_emul_answer(cmd, seq, &status, 1);
+}
+
+static uint8_t dut_bl_emul_write(const uint8_t *payload, uint16_t len)
+{
+	uint32_t offset = sys_get_le32(payload);
+	uint16_t data_len = len - 4;
+
+	if ((offset > dut_bl_emul.next) || ((offset + data_len) > dut_bl_emul.size)) {
+		return DUT_BL_EMUL_NAK;
+	}
+	// A block sent again after a rewind is ACKed as it is already written
+	if (offset == dut_bl_emul.next) {
+		memcpy(&dut_bl_emul.flash[offset], &payload[4], data_len);
+		if ((offset == 0) && dut_bl_emul.corrupt) {
+			dut_bl_emul.flash[0] ^= 0x01;
+		}
+		dut_bl_emul.next += data_len;
+	}
+
+	return 0;
+}
+
+static void dut_bl_emul_handle(uint8_t cmd, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+	uint8_t ping[6] = { 0, DUT_BL_EMUL_VERSION };
+	uint8_t status = DUT_BL_EMUL_NAK;
+
+	switch (cmd) {
+	case DUT_BL_CMD_PING:
+		sys_put_le32(DUT_BL_EMUL_MAX_BAUD, &ping[2]);
+		dut_bl_emul_answer(cmd, seq, ping, sizeof(ping));
+		return;
+
+	case DUT_BL_CMD_BAUD:
+		if (len == 4) {
+			// ACKed at the old rate, listens at the new one right after
+			dut_bl_emul_status(cmd, seq, 0);
+			dut_bl_emul.baudrate = sys_get_le32(payload);
+			return;
+		}
+		break;
+
+	case DUT_BL_CMD_ERASE:
+		if ((len == 4) && (sys_get_le32(payload) <= sizeof(dut_bl_emul.flash))) {
+			dut_bl_emul.size = sys_get_le32(payload);
+			dut_bl_emul.next = 0;
+			memset(dut_bl_emul.flash, 0xFF, sizeof(dut_bl_emul.flash));
+			status = 0;
+		}
+		break;
+
+	case DUT_BL_CMD_WRITE:
+		if (++dut_bl_emul.writes == dut_bl_emul.drop_write) {
+			return;
+		}
+		if (len > 4) {
+			status = dut_bl_emul_write(payload, len);
+		}
+		break;
+
+	case DUT_BL_CMD_VERIFY:
+		dut_bl_emul.verifies++;
+		if ((len == 8) && (sys_get_le32(payload) == dut_bl_emul.size) && (dut_bl_emul.next == dut_bl_emul.size) &&
+		    (crc32_ieee(dut_bl_emul.flash, dut_bl_emul.size) == sys_get_le32(&payload[4]))) {
+			status = 0;
+		}
+		break;
+
+	case DUT_BL_CMD_RUN:
+		dut_bl_emul.run = true;
+		status = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	dut_bl_emul_status(cmd, seq, status);
+}
+
+static void dut_bl_emul_parse(uint8_t byte)
+{
+	uint16_t len;
+
+	if ((m_rx_len == 0) && (byte != DUT_BL_SYNC)) {
+		return;
+	}
+	m_rx[m_rx_len++] = byte;
+	if (m_rx_len < DUT_BL_HEADER_SIZE) {
+		return;
+	}
+
+	len = sys_get_le16(&m_rx[4]);
+	if (len > DUT_BL_EMUL_MAX_PAYLOAD) {
+		m_rx_len = 0;
+		return;
+	}
+	if (m_rx_len < (DUT_BL_HEADER_SIZE + len + DUT_BL_CRC_SIZE)) {
+		return;
+	}
+	m_rx_len = 0;
+
+	if (sys_get_le16(&m_rx[DUT_BL_HEADER_SIZE + len]) == crc16_ccitt(0xFFFF, &m_rx[1], DUT_BL_HEADER_SIZE - 1 + len)) {
+		dut_bl_emul_handle(m_rx[1], sys_get_le16(&m_rx[2]), &m_rx[DUT_BL_HEADER_SIZE], len);
+	}
+}
+
+/* Called by the UART emulator with what the fixture sent */
+static void dut_bl_emul_rx(const struct device *dev, size_t size, void *user_data)
+{
+	struct uart_config cfg;
+	uint8_t buf[32];
+	uint32_t n;
+
+	ARG_UNUSED(size);
+	ARG_UNUSED(user_data);
+
+	while ((n = uart_emul_get_tx_data(dev, buf, sizeof(buf))) > 0) {
+		// Nothing readable unless powered and listening at the line rate
+		if (!m_powered || (uart_config_get(dev, &cfg) != 0) || (cfg.baudrate != dut_bl_emul.baudrate)) {
+			m_rx_len = 0;
+			continue;
+		}
+		for (uint32_t i = 0; i < n; i++) {
+			dut_bl_emul_parse(buf[i]);
+		}
+	}
+}
+
+void dut_bl_emul_init(const struct device *dev)
+{
+	m_dev = dev;
+	uart_emul_callback_tx_data_ready_set(dev, dut_bl_emul_rx, NULL);
+}
+
+/* The bootloader starts at power up, at the rate the line is at */
+void dut_bl_emul_power(bool on)
+{
+	struct uart_config cfg;
+
+	m_powered = on;
+	m_rx_len = 0;
+	if (on && (uart_config_get(m_dev, &cfg) == 0)) {
+		dut_bl_emul.baudrate = cfg.baudrate;
+		dut_bl_emul.size = 0;
+		dut_bl_emul.next = 0;
+	}
+}
+
+/* Clears the faults and what the last transfer left */
+void dut_bl_emul_reset(void)
+{
+	memset(&dut_bl_emul, 0, sizeof(dut_bl_emul));
+}
@@ -0,0 +1,39 @@
+#ifndef DUT_BL_EMUL_H
+#define DUT_BL_EMUL_H
+
+#include <zephyr/device.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * DUT serial bootloader on the far end of an emulated UART, answering the
+ * frames of src/dut_flash.h as the real one does. Frames sent at a rate it
+ * is not listening at are lost, as on the line.
+ */
+
+#define DUT_BL_EMUL_FLASH_SIZE      8192
+#define DUT_BL_EMUL_VERSION         2
+#define DUT_BL_EMUL_MAX_BAUD        1000000
+
+struct dut_bl_emul {
+	/* Faults, set by the test before the transfer */
+	uint32_t drop_write;			/* write frame (from 1) lost on the line, 0 for none */
+	bool corrupt;				/* first image byte written wrong */
+
+	/* What the bootloader saw */
+	uint32_t baudrate;			/* rate it listens at */
+	uint32_t size;				/* image size given to the erase */
+	uint32_t next;				/* next offset it writes */
+	uint32_t writes;			/* write frames received, the lost one included */
+	uint32_t verifies;
+	bool run;				/* asked to start the image */
+	uint8_t flash[DUT_BL_EMUL_FLASH_SIZE];
+};
+
+extern struct dut_bl_emul dut_bl_emul;
+
+void dut_bl_emul_init(const struct device *dev);
+void dut_bl_emul_power(bool on);
+void dut_bl_emul_reset(void);
+
+#endif /* DUT_BL_EMUL_H */
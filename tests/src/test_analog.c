@@ -0,0 +1,237 @@
+#include <zephyr/ztest.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc/adc_emul.h>
+#include <zephyr/sys/util.h>
+
+#include "analog.h"
+#include "bench.h"
+
+/* Unity, the SAADC mV per count at 1/6 gain, a negative gain and a fractional one with an offset */
+static const struct adc_cal test_cals[] = {
+	{ .gain_q16 = BIT(ADC_CAL_Q), .offset = 0 },
+	{ .gain_q16 = (3600 << ADC_CAL_Q) / 4096, .offset = 0 },
+	{ .gain_q16 = -(5 << ADC_CAL_Q), .offset = 1200 },
+	{ .gain_q16 = 0x8000, .offset = -37 },
+};
+
+/* Conversion throughput floor, samples per second */
+#define TEST_CONVERT_MIN_PER_S      20000000ULL
+#define TEST_CONVERT_SAMPLES        1024
+#define TEST_CONVERT_ROUNDS         2000
+
+static int16_t test_raw[2 * TEST_CONVERT_SAMPLES];
+static int32_t test_out[TEST_CONVERT_SAMPLES + 1];
+
+static void *analog_setup(void)
+{
+	// Whole 12 bit range and a little below zero, as the SAADC reads in single ended mode
+	for (size_t i = 0; i < ARRAY_SIZE(test_raw); i++) {
+		test_raw[i] = (int16_t)((i * 7) % 4200) - 64;
+	}
+
+	return NULL;
+}
+
+ZTEST(analog, test_cal_apply_rounds_to_nearest)
+{
+	const struct adc_cal half = { .gain_q16 = 0x8000, .offset = 0 };
+	const struct adc_cal unity = { .gain_q16 = BIT(ADC_CAL_Q), .offset = -100 };
+
+	zassert_equal(adc_cal_apply(&half, 0), 0);
+	zassert_equal(adc_cal_apply(&half, 1), 1, "0.5 rounds up");
+	zassert_equal(adc_cal_apply(&half, 2), 1);
+	zassert_equal(adc_cal_apply(&half, 3), 2, "1.5 rounds up");
+	zassert_equal(adc_cal_apply(&half, -1), 0, "-0.5 rounds up");
+	zassert_equal(adc_cal_apply(&half, -3), -1, "-1.5 rounds up");
+
+	for (int32_t raw = -4096; raw < 4096; raw++) {
+		zassert_equal(adc_cal_apply(&unity, raw), raw - 100);
+	}
+}
+
+ZTEST(analog, test_cal_apply_no_overflow)
+{
+	const struct adc_cal big = { .gain_q16 = INT32_MAX, .offset = 0 };
+
+	// 32767 * 32767.99 does not fit 32 bits, the product is taken in 64
+	zassert_equal(adc_cal_apply(&big, INT16_MAX), (int32_t)(((int64_t)INT16_MAX * INT32_MAX + BIT(15)) >> 16));
+}
+
+ZTEST(analog, test_convert_block_matches_apply)
+{
+	for (size_t c = 0; c < ARRAY_SIZE(test_cals); c++) {
+		adc_convert_block(test_raw, 1, test_out, TEST_CONVERT_SAMPLES, &test_cals[c]);
+		for (size_t i = 0; i < TEST_CONVERT_SAMPLES; i++) {
+			zassert_equal(test_out[i], adc_cal_apply(&test_cals[c], test_raw[i]),
+				      "cal %zu sample %zu", c, i);
+		}
+	}
+}
+
+ZTEST(analog, test_convert_block_stride)
+{
+	const struct adc_cal *cal = &test_cals[1];
+
+	// Interleaved channels, the second one of every pair, and nothing past count written
+	test_out[TEST_CONVERT_SAMPLES] = 0x5A5A5A5A;
+	adc_convert_block(&test_raw[1], 2, test_out, TEST_CONVERT_SAMPLES, cal);
+	for (size_t i = 0; i < TEST_CONVERT_SAMPLES; i++) {
+		zassert_equal(test_out[i], adc_cal_apply(cal, test_raw[(2 * i) + 1]), "sample %zu", i);
+	}
+	zassert_equal(test_out[TEST_CONVERT_SAMPLES], 0x5A5A5A5A);
+
+	adc_convert_block(test_raw, 2, test_out, 0, cal);
+	zassert_equal(test_out[0], adc_cal_apply(cal, test_raw[1]), "count 0 writes nothing");
+}
+
+ZTEST(analog, test_convert_block_throughput)
+{
+	uint64_t start, ns, rate;
+
+	start = bench_start();
+	for (int r = 0; r < TEST_CONVERT_ROUNDS; r++) {
+		adc_convert_block(test_raw, 2, test_out, TEST_CONVERT_SAMPLES, &test_cals[r % ARRAY_SIZE(test_cals)]);
+	}
+	ns = bench_elapsed_ns(start);
+
+	rate = bench_per_sec((uint64_t)TEST_CONVERT_ROUNDS * TEST_CONVERT_SAMPLES, ns);
+	TC_PRINT("adc_convert_block: %llu samples/s\n", rate);
+	zassert_true(rate >= TEST_CONVERT_MIN_PER_S, "%llu samples/s, expected %llu",
+		     rate, TEST_CONVERT_MIN_PER_S);
+}
+
+ZTEST_SUITE(analog, NULL, analog_setup, NULL, NULL, NULL);
+
+/*
+ * The channels of the application on the emulated ADC: 600mV reference, 1/6
+ * gain, 12 bit, so 3600mV full scale at the pin. The input voltages are set
+ * on the pins, the expected values worked out from the board front end:
+ * rails through a 1/2 divider, the current at 879/1500 uA per count + 95uA
+ * through the sense shunt and 100 times that through the bypass.
+ */
+#define DT_SPEC_AND_COMMA(node_id, prop, idx) ADC_DT_SPEC_GET_BY_IDX(node_id, idx),
+
+static const struct adc_dt_spec test_channels[] = {
+	DT_FOREACH_PROP_ELEM(DT_PATH(zephyr_user), io_channels, DT_SPEC_AND_COMMA)
+};
+
+#define TEST_CURRENT_MV             1000        /* 1137.8 counts */
+#define TEST_CURRENT_UA             762         /* sense shunt */
+#define TEST_CURRENT_MA_UA          66676       /* bypass */
+#define TEST_3V6_MV                 1800        /* 3600mV rail */
+#define TEST_3V45_MV                1725        /* 3450mV rail */
+/* Sleep current with a wake-up spike every TEST_SPIKE_EVERY samples */
+#define TEST_SLEEP_MV               300         /* 295uA */
+#define TEST_SPIKE_MV               2000        /* 1428uA */
+#define TEST_SPIKE_EVERY            5
+
+/* About two counts: the emulator truncates, the calibration rounds */
+#define TEST_RAIL_TOL_MV            4
+#define TEST_UA_TOL                 2
+#define TEST_MA_TOL_UA              120
+
+static const struct device *const adc_dev = DEVICE_DT_GET(DT_NODELABEL(adc0));
+static uint32_t test_samples;
+
+static int test_spiky_current(const struct device *dev, unsigned int chan, void *data, uint32_t *result)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(chan);
+	ARG_UNUSED(data);
+
+	*result = ((++test_samples % TEST_SPIKE_EVERY) == 0) ? TEST_SPIKE_MV : TEST_SLEEP_MV;
+
+	return 0;
+}
+
+static void *analog_emul_setup(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(test_channels); i++) {
+		zassert_ok(adc_init_chn(&test_channels[i]));
+	}
+
+	return NULL;
+}
+
+static void analog_emul_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	adc_set_current_range(ADC_CURRENT_RANGE_UA);
+	test_samples = 0;
+	zassert_ok(adc_emul_const_value_set(adc_dev, test_channels[ADC_CURRENT_CHN].channel_id, TEST_CURRENT_MV));
+	zassert_ok(adc_emul_const_value_set(adc_dev, test_channels[ADC_3v6_CHN].channel_id, TEST_3V6_MV));
+	zassert_ok(adc_emul_const_value_set(adc_dev, test_channels[ADC_3v45_CHN].channel_id, TEST_3V45_MV));
+}
+
+ZTEST(analog_emul, test_raw_to_current)
+{
+	// 1137 counts, what the sense shunt and the bypass turn it into
+	zassert_within(adc_raw_to_current_uA(1137, ADC_CURRENT_RANGE_UA), TEST_CURRENT_UA, TEST_UA_TOL);
+	zassert_within(adc_raw_to_current_uA(1137, ADC_CURRENT_RANGE_MA), TEST_CURRENT_MA_UA, TEST_MA_TOL_UA);
+	zassert_equal(adc_raw_to_current_uA(0, ADC_CURRENT_RANGE_UA), 95, "shunt amplifier offset");
+	zassert_equal(adc_raw_to_current_uA(0, ADC_CURRENT_RANGE_MA), 0);
+}
+
+ZTEST(analog_emul, test_scan_scales_every_rail)
+{
+	struct adc_scan_result res;
+
+	zassert_ok(adc_scan_chn(test_channels, ARRAY_SIZE(test_channels), &res));
+
+	// Results in io-channels order, not in channel id order
+	zassert_within(res.raw[ADC_CURRENT_CHN], (TEST_CURRENT_MV << 12) / 3600, 1);
+	zassert_within(res.value[ADC_CURRENT_CHN], TEST_CURRENT_UA, TEST_UA_TOL);
+	zassert_within(res.value[ADC_3v6_CHN], 2 * TEST_3V6_MV, TEST_RAIL_TOL_MV);
+	zassert_within(res.value[ADC_3v45_CHN], 2 * TEST_3V45_MV, TEST_RAIL_TOL_MV);
+	zassert_true((res.value[ADC_3v45_CHN] >= LOWER_3v45) && (res.value[ADC_3v45_CHN] <= UPPER_3v45));
+
+	// Current through the range the meter is switched to
+	adc_set_current_range(ADC_CURRENT_RANGE_MA);
+	zassert_ok(adc_scan_chn(test_channels, ARRAY_SIZE(test_channels), &res));
+	zassert_within(res.value[ADC_CURRENT_CHN], TEST_CURRENT_MA_UA, TEST_MA_TOL_UA);
+}
+
+ZTEST(analog_emul, test_scan_invalid)
+{
+	struct adc_scan_result res;
+
+	zassert_equal(adc_scan_chn(test_channels, 0, &res), -1);
+	zassert_equal(adc_scan_chn(test_channels, ADC_SCAN_MAX_CHN + 1, &res), -1);
+}
+
+ZTEST(analog_emul, test_measure_constant_current)
+{
+	const struct adc_current_window window = { .window_ms = 2, .oversampling = 4, .percentile = 95 };
+	struct adc_current_stats stats;
+
+	zassert_ok(adc_measure_dut_current(&test_channels[ADC_CURRENT_CHN], &window, &stats));
+
+	// 2ms of 192us oversampled conversions
+	zassert_equal(stats.samples, 10);
+	zassert_within(stats.mean_uA, TEST_CURRENT_UA, TEST_UA_TOL);
+	zassert_equal(stats.min_uA, stats.max_uA);
+	zassert_equal(stats.pct_uA, stats.mean_uA);
+	zassert_equal(stats.rms_uA, stats.mean_uA);
+	zassert_false(adc_dut_sleep_current_ok(&stats), "%d uA is not a sleep current", stats.mean_uA);
+}
+
+ZTEST(analog_emul, test_measure_spiky_current)
+{
+	const struct adc_current_window window = { .window_ms = 2, .oversampling = 4, .percentile = 95 };
+	struct adc_current_stats stats;
+
+	zassert_ok(adc_emul_value_func_set(adc_dev, test_channels[ADC_CURRENT_CHN].channel_id,
+					   test_spiky_current, NULL));
+	zassert_ok(adc_measure_dut_current(&test_channels[ADC_CURRENT_CHN], &window, &stats));
+
+	// 2 spikes in 10 samples: the 95th percentile is a spike, the mean is not
+	zassert_equal(stats.samples, 10);
+	zassert_within(stats.min_uA, 295, TEST_UA_TOL);
+	zassert_within(stats.max_uA, 1428, TEST_UA_TOL);
+	zassert_equal(stats.pct_uA, stats.max_uA);
+	zassert_within(stats.mean_uA, ((8 * stats.min_uA) + (2 * stats.max_uA)) / 10, 1);
+	zassert_true(stats.rms_uA > stats.mean_uA);
+}
+
+ZTEST_SUITE(analog_emul, NULL, analog_emul_setup, analog_emul_before, NULL, NULL);
@@ -0,0 +1,169 @@
+#include <zephyr/ztest.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "bcd_time.h"
+#include "bench.h"
+
+/* The reference needs the dates past 2038 */
+BUILD_ASSERT(sizeof(time_t) >= 8, "64 bit time_t needed to check against gmtime_r()");
+
+#define SECS_PER_DAY                86400
+#define TEST_DAY_2024_02_29         1709164800LL
+
+/* Codec rate floors, conversions per second, and against the host libc */
+#define TEST_ENCODE_MIN_PER_S       10000000ULL
+#define TEST_FORMAT_MIN_PER_S       5000000ULL
+#define TEST_BENCH_ROUNDS           200000
+
+/* Sink for the benchmark loops, so they are not optimized away */
+static volatile uint32_t bench_sink;
+
+/* The codec against gmtime_r() and strftime(), and back to the same time */
+static void check_ts(int64_t ts)
+{
+	uint8_t regs[BCD_TIME_REGS];
+	char buf[BCD_TIME_ISO8601_SIZE];
+	char ref[32];
+	time_t t = (time_t)ts;
+	struct tm ref_tm, tm;
+	int64_t back;
+
+	zassert_not_null(gmtime_r(&t, &ref_tm));
+	zassert_ok(bcd_time_from_epoch(ts, regs), "%lld", ts);
+
+	zassert_equal(bcd_decode(regs[BCD_TIME_SEC]), ref_tm.tm_sec, "%lld", ts);
+	zassert_equal(bcd_decode(regs[BCD_TIME_MIN]), ref_tm.tm_min, "%lld", ts);
+	zassert_equal(bcd_decode(regs[BCD_TIME_HOUR]), ref_tm.tm_hour, "%lld", ts);
+	zassert_equal(bcd_decode(regs[BCD_TIME_DAY]), ref_tm.tm_mday, "%lld", ts);
+	zassert_equal(regs[BCD_TIME_WEEKDAY], ref_tm.tm_wday, "%lld", ts);
+	zassert_equal(bcd_decode(regs[BCD_TIME_MONTH]), ref_tm.tm_mon + 1, "%lld", ts);
+	zassert_equal(bcd_decode(regs[BCD_TIME_YEAR]), ref_tm.tm_year - 100, "%lld", ts);
+
+	zassert_ok(bcd_time_to_epoch(regs, &back));
+	zassert_equal(back, ts);
+
+	zassert_ok(bcd_time_to_tm(regs, &tm));
+	zassert_equal(tm.tm_wday, ref_tm.tm_wday, "%lld", ts);
+	zassert_equal(tm.tm_yday, ref_tm.tm_yday, "%lld", ts);
+
+	zassert_equal(strftime(ref, sizeof(ref), "%Y-%m-%dT%H:%M:%SZ", &ref_tm), BCD_TIME_ISO8601_LEN);
+	zassert_equal(bcd_time_format(ts, buf, sizeof(buf)), BCD_TIME_ISO8601_LEN);
+	zassert_mem_equal(buf, ref, BCD_TIME_ISO8601_SIZE);
+}
+
+ZTEST(bcd_time, test_bcd_codec)
+{
+	for (uint8_t bin = 0; bin < 100; bin++) {
+		uint8_t bcd = ((bin / 10) << 4) | (bin % 10);
+
+		zassert_equal(bcd_encode(bin), bcd, "%u", bin);
+		zassert_equal(bcd_decode(bcd), bin, "%u", bin);
+		zassert_true(bcd_valid(bcd));
+	}
+
+	zassert_false(bcd_valid(0x0A));
+	zassert_false(bcd_valid(0xA0));
+	zassert_false(bcd_valid(0x9F));
+}
+
+ZTEST(bcd_time, test_every_day_of_the_century)
+{
+	// A different time of day on each, so the hours, minutes and seconds move too
+	for (int64_t day = 0; day < (BCD_TIME_EPOCH_2100 - BCD_TIME_EPOCH_2000) / SECS_PER_DAY; day++) {
+		check_ts(BCD_TIME_EPOCH_2000 + (day * SECS_PER_DAY) + ((day * 7919) % SECS_PER_DAY));
+	}
+}
+
+ZTEST(bcd_time, test_every_second_of_a_day)
+{
+	for (int64_t sec = 0; sec < SECS_PER_DAY; sec++) {
+		check_ts(TEST_DAY_2024_02_29 + sec);
+	}
+}
+
+ZTEST(bcd_time, test_range_and_invalid_regs)
+{
+	uint8_t regs[BCD_TIME_REGS];
+	char buf[BCD_TIME_ISO8601_SIZE];
+	int64_t ts;
+
+	zassert_equal(bcd_time_from_epoch(BCD_TIME_EPOCH_2000 - 1, regs), -ERANGE);
+	zassert_equal(bcd_time_from_epoch(BCD_TIME_EPOCH_2100, regs), -ERANGE);
+	zassert_ok(bcd_time_from_epoch(BCD_TIME_EPOCH_2100 - 1, regs));
+	zassert_equal(bcd_time_format(BCD_TIME_EPOCH_2000, buf, sizeof(buf) - 1), -ENOMEM);
+
+	// 2023-02-29 does not exist, 2024-02-29 does
+	zassert_ok(bcd_time_from_epoch(TEST_DAY_2024_02_29, regs));
+	zassert_ok(bcd_time_to_epoch(regs, &ts));
+	regs[BCD_TIME_YEAR] = 0x23;
+	zassert_equal(bcd_time_to_epoch(regs, &ts), -EINVAL);
+
+	zassert_ok(bcd_time_from_epoch(TEST_DAY_2024_02_29, regs));
+	regs[BCD_TIME_MONTH] = 0x13;
+	zassert_equal(bcd_time_to_epoch(regs, &ts), -EINVAL);
+
+	zassert_ok(bcd_time_from_epoch(TEST_DAY_2024_02_29, regs));
+	regs[BCD_TIME_MIN] = 0x1A;
+	zassert_equal(bcd_time_to_epoch(regs, &ts), -EINVAL);
+
+	// The oscillator stop flag shares the seconds register and is ignored
+	zassert_ok(bcd_time_from_epoch(TEST_DAY_2024_02_29 + 12, regs));
+	regs[BCD_TIME_SEC] |= BIT(7);
+	zassert_ok(bcd_time_to_epoch(regs, &ts));
+	zassert_equal(ts, TEST_DAY_2024_02_29 + 12);
+}
+
+ZTEST(bcd_time, test_codec_throughput)
+{
+	uint8_t regs[BCD_TIME_REGS];
+	char buf[32];
+	struct tm tm;
+	uint64_t start, ns_enc, ns_gm, ns_fmt, ns_strf;
+	uint32_t sink = 0;
+
+	start = bench_start();
+	for (int i = 0; i < TEST_BENCH_ROUNDS; i++) {
+		(void)bcd_time_from_epoch(TEST_DAY_2024_02_29 + (i * 7919), regs);
+		sink += regs[BCD_TIME_SEC];
+	}
+	ns_enc = bench_elapsed_ns(start);
+
+	start = bench_start();
+	for (int i = 0; i < TEST_BENCH_ROUNDS; i++) {
+		time_t t = (time_t)(TEST_DAY_2024_02_29 + (i * 7919));
+
+		(void)gmtime_r(&t, &tm);
+		sink += tm.tm_sec;
+	}
+	ns_gm = bench_elapsed_ns(start);
+
+	start = bench_start();
+	for (int i = 0; i < TEST_BENCH_ROUNDS; i++) {
+		(void)bcd_time_format(TEST_DAY_2024_02_29 + (i * 7919), buf, sizeof(buf));
+		sink += buf[18];
+	}
+	ns_fmt = bench_elapsed_ns(start);
+
+	start = bench_start();
+	for (int i = 0; i < TEST_BENCH_ROUNDS; i++) {
+		time_t t = (time_t)(TEST_DAY_2024_02_29 + (i * 7919));
+
+		(void)strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&t, &tm));
+		sink += buf[18];
+	}
+	ns_strf = bench_elapsed_ns(start);
+	bench_sink = sink;
+
+	TC_PRINT("bcd_time_from_epoch: %llu ns per %d, gmtime_r: %llu\n", ns_enc, TEST_BENCH_ROUNDS, ns_gm);
+	TC_PRINT("bcd_time_format: %llu ns per %d, gmtime_r + strftime: %llu\n", ns_fmt, TEST_BENCH_ROUNDS, ns_strf);
+
+	zassert_true(bench_per_sec(TEST_BENCH_ROUNDS, ns_enc) >= TEST_ENCODE_MIN_PER_S);
+	zassert_true(bench_per_sec(TEST_BENCH_ROUNDS, ns_fmt) >= TEST_FORMAT_MIN_PER_S);
+	zassert_true(ns_enc < ns_gm, "encoding slower than gmtime_r()");
+	zassert_true(ns_fmt < ns_strf, "formatting slower than gmtime_r() + strftime()");
+}
+
+ZTEST_SUITE(bcd_time, NULL, NULL, NULL, NULL, NULL);
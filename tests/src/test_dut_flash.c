@@ -0,0 +1,184 @@
+#include <zephyr/ztest.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+
+#include "dut_flash.h"
+#include "dut_bl_emul.h"
+#include "uart_port.h"
+
+#define TEST_IMAGE_SIZE             5000        /* 20 blocks, the last one short */
+#define TEST_CHUNK                  512         /* image bytes per dut_flash_write(), as the host sends them */
+#define TEST_FLASH_MS               5000
+/* An abort has to end the transfer well before the host data timeout */
+#define TEST_ABORT_MS               50
+
+UART_PORT_DEFINE(bl_port, DEVICE_DT_GET(DT_NODELABEL(uart_bl)), 1024, 2048);
+
+static uint8_t test_image[TEST_IMAGE_SIZE];
+static uint32_t test_crc;
+
+static int test_power(bool on)
+{
+	dut_bl_emul_power(on);
+	return 0;
+}
+
+static const struct dut_flash_config test_config = {
+	.port = &bl_port,
+	.power = test_power,
+};
+
+static int test_feed(void)
+{
+	for (size_t i = 0; i < sizeof(test_image); i += TEST_CHUNK) {
+		int ret = dut_flash_write(&test_image[i], MIN(TEST_CHUNK, sizeof(test_image) - i), K_MSEC(TEST_FLASH_MS));
+
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/* Waits for the end of the transfer, returns its status */
+static void test_wait(struct dut_flash_status *st)
+{
+	int64_t end = k_uptime_get() + TEST_FLASH_MS;
+
+	while (dut_flash_is_running() && (k_uptime_get() < end)) {
+		k_msleep(1);
+	}
+	zassert_false(dut_flash_is_running(), "transfer did not end");
+	dut_flash_get_status(st);
+}
+
+static void *dut_flash_setup(void)
+{
+	dut_bl_emul_init(bl_port.dev);
+	zassert_ok(uart_port_init(&bl_port));
+
+	for (size_t i = 0; i < sizeof(test_image); i++) {
+		test_image[i] = (uint8_t)((i * 13) + (i >> 8));
+	}
+	test_crc = crc32_ieee(test_image, sizeof(test_image));
+
+	return NULL;
+}
+
+static void dut_flash_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	dut_bl_emul_reset();
+}
+
+static void dut_flash_after(void *fixture)
+{
+	struct dut_flash_status st;
+
+	ARG_UNUSED(fixture);
+
+	dut_flash_abort();
+	test_wait(&st);
+}
+
+ZTEST(dut_flash, test_full_transfer)
+{
+	struct dut_flash_status st;
+
+	zassert_ok(dut_flash_start(&test_config, sizeof(test_image), test_crc, 0));
+	zassert_equal(dut_flash_start(&test_config, sizeof(test_image), test_crc, 0), -EBUSY);
+	zassert_ok(test_feed());
+	test_wait(&st);
+
+	zassert_equal(st.state, DUT_FLASH_DONE, "err %d", st.err);
+	zassert_equal(st.err, 0);
+	zassert_equal(st.acked, sizeof(test_image));
+	zassert_equal(st.retransmits, 0);
+	zassert_equal(st.baudrate, DUT_BL_EMUL_MAX_BAUD, "line raised to the bootloader maximum");
+	zassert_equal(dut_bl_emul.writes, DIV_ROUND_UP(sizeof(test_image), DUT_FLASH_BLOCK_SIZE));
+	zassert_equal(dut_bl_emul.verifies, 1);
+	zassert_true(dut_bl_emul.run);
+	zassert_mem_equal(dut_bl_emul.flash, test_image, sizeof(test_image));
+}
+
+ZTEST(dut_flash, test_lost_block_rewinds_window)
+{
+	struct dut_flash_status st;
+
+	// Block 2 is lost, the bootloader NAKs block 3 as past the next offset
+	dut_bl_emul.drop_write = 3;
+
+	zassert_ok(dut_flash_start(&test_config, sizeof(test_image), test_crc, 0));
+	zassert_ok(test_feed());
+	test_wait(&st);
+
+	zassert_equal(st.state, DUT_FLASH_DONE, "err %d", st.err);
+	zassert_equal(st.acked, sizeof(test_image));
+	zassert_true(st.retransmits > 0, "window not sent again");
+	zassert_equal(dut_bl_emul.writes, DIV_ROUND_UP(sizeof(test_image), DUT_FLASH_BLOCK_SIZE) + st.retransmits);
+	zassert_mem_equal(dut_bl_emul.flash, test_image, sizeof(test_image));
+}
+
+ZTEST(dut_flash, test_host_crc_mismatch)
+{
+	struct dut_flash_status st;
+
+	zassert_ok(dut_flash_start(&test_config, sizeof(test_image), test_crc ^ 1, 0));
+	zassert_ok(test_feed());
+	test_wait(&st);
+
+	zassert_equal(st.state, DUT_FLASH_FAILED);
+	zassert_equal(st.err, -EBADMSG);
+	zassert_equal(dut_bl_emul.verifies, 0, "the DUT is not asked to check a wrong image");
+	zassert_false(dut_bl_emul.run);
+}
+
+ZTEST(dut_flash, test_dut_crc_mismatch)
+{
+	struct dut_flash_status st;
+
+	dut_bl_emul.corrupt = true;
+
+	zassert_ok(dut_flash_start(&test_config, sizeof(test_image), test_crc, 0));
+	zassert_ok(test_feed());
+	test_wait(&st);
+
+	zassert_equal(st.state, DUT_FLASH_FAILED);
+	zassert_equal(st.err, -EBADMSG);
+	zassert_equal(dut_bl_emul.verifies, 1);
+	zassert_false(dut_bl_emul.run);
+}
+
+ZTEST(dut_flash, test_abort_while_waiting_for_host)
+{
+	struct dut_flash_status st;
+	int64_t start;
+
+	zassert_ok(dut_flash_start(&test_config, sizeof(test_image), test_crc, 0));
+
+	// No image data: the thread waits for the host once the flash is erased
+	start = k_uptime_get();
+	do {
+		k_msleep(1);
+		dut_flash_get_status(&st);
+	} while ((st.state != DUT_FLASH_WRITING) && ((k_uptime_get() - start) < TEST_FLASH_MS));
+	zassert_equal(st.state, DUT_FLASH_WRITING);
+
+	start = k_uptime_get();
+	dut_flash_abort();
+	while (dut_flash_is_running() && ((k_uptime_get() - start) < TEST_FLASH_MS)) {
+		k_msleep(1);
+	}
+	zassert_true((k_uptime_get() - start) < TEST_ABORT_MS, "abort took %lld ms", k_uptime_get() - start);
+
+	dut_flash_get_status(&st);
+	zassert_equal(st.state, DUT_FLASH_FAILED);
+	zassert_equal(st.err, -ECANCELED);
+	zassert_equal(st.acked, 0);
+	zassert_equal(dut_flash_write(test_image, TEST_CHUNK, K_NO_WAIT), -ECANCELED);
+}
+
+ZTEST_SUITE(dut_flash, NULL, dut_flash_setup, dut_flash_before, dut_flash_after, NULL);
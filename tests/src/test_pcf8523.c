@@ -0,0 +1,162 @@
+#include <zephyr/ztest.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/rtc.h>
+
+#include "pcf8523.h"
+#include "pcf8523_emul.h"
+#include "phase_timing.h"
+#include "bench.h"
+
+#define TEST_TS                     1709251198LL    /* 2024-02-29T23:59:58Z */
+
+/* Register access floor through the driver and the emulator, bus transactions per second */
+#define TEST_RTC_MIN_READS_PER_S    20000ULL
+#define TEST_RTC_READS              2000
+
+static const struct device *const rtc_dev = DEVICE_DT_GET(DT_NODELABEL(pcf8523));
+static const struct emul *const rtc_emul = EMUL_DT_GET(DT_NODELABEL(pcf8523));
+
+/* Every PCF8523 transfer goes through the PHASE_I2C statistics */
+static uint32_t i2c_transfers(void)
+{
+	struct phase_stats stats;
+
+	zassert_ok(phase_timing_get(PHASE_I2C, &stats));
+	return stats.count;
+}
+
+static void *pcf8523_setup(void)
+{
+	struct rtc_time tm;
+
+	zassert_true(device_is_ready(rtc_dev));
+	// Power-on reset of the emulator, the time is not valid until set
+	zassert_equal(rtc_get_time(rtc_dev, &tm), -ENODATA);
+
+	return NULL;
+}
+
+ZTEST(pcf8523, test_set_get_time)
+{
+	int64_t ts = TEST_TS;
+	struct tm tm;
+
+	zassert_equal(pcf8523_set_time(rtc_dev, &ts), 0);
+	zassert_equal(pcf8523_get_time(rtc_dev, &ts), 0);
+	zassert_equal(ts, TEST_TS);
+
+	// Leap day to the first of March
+	k_sleep(K_SECONDS(3));
+	zassert_equal(pcf8523_get_time_tm(rtc_dev, &tm), 0);
+	zassert_equal(tm.tm_year, 124);
+	zassert_equal(tm.tm_mon, 2);
+	zassert_equal(tm.tm_mday, 1);
+	zassert_equal(tm.tm_hour, 0);
+	zassert_equal(tm.tm_min, 0);
+	zassert_equal(tm.tm_sec, 1);
+	zassert_equal(pcf8523_get_time_cached(rtc_dev, &ts), 0);
+	zassert_equal(ts, TEST_TS + 3);
+}
+
+ZTEST(pcf8523, test_rtc_api)
+{
+	struct rtc_time set = {
+		.tm_year = 199,
+		.tm_mon = 11,
+		.tm_mday = 31,
+		.tm_hour = 23,
+		.tm_min = 59,
+		.tm_sec = 50,
+	};
+	struct rtc_time get;
+
+	zassert_ok(rtc_set_time(rtc_dev, &set));
+	zassert_ok(rtc_get_time(rtc_dev, &get), "writing the seconds clears the oscillator stop flag");
+	zassert_equal(get.tm_year, set.tm_year);
+	zassert_equal(get.tm_mon, set.tm_mon);
+	zassert_equal(get.tm_mday, set.tm_mday);
+	zassert_equal(get.tm_hour, set.tm_hour);
+	zassert_equal(get.tm_min, set.tm_min);
+	zassert_equal(get.tm_sec, set.tm_sec);
+	zassert_equal(get.tm_wday, 4, "2099-12-31 is a Thursday");
+}
+
+ZTEST(pcf8523, test_switchover_flag)
+{
+	zassert_equal(pcf8523_write_reg(rtc_dev, PCF8523_CONTROL_3_ADD, PCF8523_CTRL3_SO_MODE_4_MASK), 0);
+	zassert_equal(pcf8523_refresh(rtc_dev), 0);
+	zassert_false(pcf8523_switchover_occurred(rtc_dev));
+
+	// VDD lost with the battery fitted, seen on the next read only
+	pcf8523_emul_set_switchover(rtc_emul);
+	zassert_false(pcf8523_switchover_occurred(rtc_dev));
+	zassert_equal(pcf8523_refresh(rtc_dev), 0);
+	zassert_true(pcf8523_switchover_occurred(rtc_dev));
+
+	// Writing the mode back with BSF set keeps the flag, without it clears it
+	zassert_equal(pcf8523_write_reg(rtc_dev, PCF8523_CONTROL_3_ADD,
+					PCF8523_CTRL3_SO_MODE_4_MASK | PCF8523_CTRL3_BSF_MASK), 0);
+	zassert_equal(pcf8523_refresh(rtc_dev), 0);
+	zassert_true(pcf8523_switchover_occurred(rtc_dev));
+	zassert_equal(pcf8523_write_reg(rtc_dev, PCF8523_CONTROL_3_ADD, PCF8523_CTRL3_SO_MODE_4_MASK), 0);
+	zassert_equal(pcf8523_refresh(rtc_dev), 0);
+	zassert_false(pcf8523_switchover_occurred(rtc_dev));
+}
+
+ZTEST(pcf8523, test_time_jumps)
+{
+	int64_t ts = TEST_TS;
+
+	zassert_equal(pcf8523_set_time(rtc_dev, &ts), 0);
+
+	// Over the leap day, then a year, without waiting for them
+	pcf8523_emul_advance(rtc_emul, 2);
+	zassert_equal(pcf8523_get_time(rtc_dev, &ts), 0);
+	zassert_equal(ts, TEST_TS + 2);
+
+	pcf8523_emul_advance(rtc_emul, 365 * 24 * 3600);
+	zassert_equal(pcf8523_get_time(rtc_dev, &ts), 0);
+	zassert_equal(ts, TEST_TS + 2 + (365 * 24 * 3600));
+	zassert_equal(pcf8523_get_time_cached(rtc_dev, &ts), 0);
+	zassert_equal(ts, TEST_TS + 2 + (365 * 24 * 3600));
+}
+
+ZTEST(pcf8523, test_one_transfer_per_access)
+{
+	int64_t ts = TEST_TS;
+	uint32_t count = i2c_transfers();
+
+	// Control, status and time in a single burst each way
+	zassert_equal(pcf8523_set_time(rtc_dev, &ts), 0);
+	zassert_equal(i2c_transfers(), count + 1);
+	zassert_equal(pcf8523_get_time(rtc_dev, &ts), 0);
+	zassert_equal(i2c_transfers(), count + 2);
+
+	// Served from the shadow registers
+	zassert_equal(pcf8523_get_time_cached(rtc_dev, &ts), 0);
+	(void)pcf8523_switchover_occurred(rtc_dev);
+	(void)pcf8523_read_reg_cached(rtc_dev, PCF8523_CONTROL_1_ADD);
+	zassert_equal(i2c_transfers(), count + 2);
+}
+
+ZTEST(pcf8523, test_read_throughput)
+{
+	uint32_t count = i2c_transfers();
+	uint64_t start, ns, rate;
+	int64_t ts;
+
+	start = bench_start();
+	for (int i = 0; i < TEST_RTC_READS; i++) {
+		zassert_equal(pcf8523_get_time(rtc_dev, &ts), 0);
+	}
+	ns = bench_elapsed_ns(start);
+
+	zassert_equal(i2c_transfers(), count + TEST_RTC_READS);
+
+	rate = bench_per_sec(TEST_RTC_READS, ns);
+	TC_PRINT("pcf8523_get_time: %llu transactions/s\n", rate);
+	zassert_true(rate >= TEST_RTC_MIN_READS_PER_S, "%llu transactions/s, expected %llu",
+		     rate, TEST_RTC_MIN_READS_PER_S);
+}
+
+ZTEST_SUITE(pcf8523, NULL, pcf8523_setup, NULL, NULL, NULL);
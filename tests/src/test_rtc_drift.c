@@ -0,0 +1,85 @@
+#include <zephyr/ztest.h>
+#include <zephyr/device.h>
+#include <string.h>
+
+#include "pcf8523.h"
+#include "pcf8523_emul.h"
+#include "rtc_drift.h"
+
+#define TEST_TS                     1709251198LL    /* 2024-02-29T23:59:58Z */
+#define TEST_TICKS                  3
+
+static const struct device *const rtc_dev = DEVICE_DT_GET(DT_NODELABEL(pcf8523));
+static const struct emul *const rtc_emul = EMUL_DT_GET(DT_NODELABEL(pcf8523));
+
+static K_SEM_DEFINE(drift_sem, 0, 1);
+static struct rtc_drift_result drift_res;
+
+static void drift_done(const struct rtc_drift_result *res, void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	drift_res = *res;
+	k_sem_give(&drift_sem);
+}
+
+static void rtc_drift_before(void *fixture)
+{
+	int64_t ts = TEST_TS;
+
+	ARG_UNUSED(fixture);
+
+	zassert_equal(pcf8523_set_time(rtc_dev, &ts), 0);
+	k_sem_reset(&drift_sem);
+	memset(&drift_res, 0, sizeof(drift_res));
+}
+
+static void rtc_drift_after(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	rtc_drift_cancel();
+}
+
+ZTEST(rtc_drift, test_invalid_args)
+{
+	zassert_equal(rtc_drift_start(rtc_dev, 0, drift_done, NULL), -EINVAL);
+	zassert_equal(rtc_drift_start(rtc_dev, TEST_TICKS, NULL, NULL), -EINVAL);
+}
+
+ZTEST(rtc_drift, test_counted_without_int1)
+{
+	zassert_ok(rtc_drift_start(rtc_dev, TEST_TICKS, drift_done, NULL));
+	zassert_equal(rtc_drift_start(rtc_dev, TEST_TICKS, drift_done, NULL), -EBUSY);
+	zassert_ok(k_sem_take(&drift_sem, K_SECONDS(TEST_TICKS + 2)));
+
+	zassert_true(drift_res.counted, "the test RTC has no INT1 line");
+	zassert_equal(drift_res.ticks, TEST_TICKS);
+	zassert_equal(drift_res.drift_ppb, 0);
+	zassert_equal(k_cyc_to_ms_near32((uint32_t)drift_res.cycles), TEST_TICKS * MSEC_PER_SEC);
+	zassert_true(rtc_drift_ok(&drift_res));
+}
+
+ZTEST(rtc_drift, test_counted_rtc_off)
+{
+	zassert_ok(rtc_drift_start(rtc_dev, TEST_TICKS, drift_done, NULL));
+
+	// The RTC gains 5 s meanwhile, as a wrong oscillator or a reset would show
+	pcf8523_emul_advance(rtc_emul, 5);
+	zassert_ok(k_sem_take(&drift_sem, K_SECONDS(TEST_TICKS + 2)));
+
+	zassert_equal(drift_res.ticks, TEST_TICKS + 5);
+	zassert_false(rtc_drift_ok(&drift_res));
+}
+
+ZTEST(rtc_drift, test_cancel)
+{
+	zassert_ok(rtc_drift_start(rtc_dev, TEST_TICKS, drift_done, NULL));
+	rtc_drift_cancel();
+	zassert_equal(k_sem_take(&drift_sem, K_SECONDS(TEST_TICKS + 1)), -EAGAIN, "cancelled, no result");
+
+	// Free for the next measurement
+	zassert_ok(rtc_drift_start(rtc_dev, TEST_TICKS, drift_done, NULL));
+}
+
+ZTEST_SUITE(rtc_drift, NULL, NULL, rtc_drift_before, rtc_drift_after, NULL);
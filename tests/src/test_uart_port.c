@@ -0,0 +1,132 @@
+#include <zephyr/ztest.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <string.h>
+
+#include "uart_port.h"
+#include "dut_emul.h"
+#include "bench.h"
+
+#define TEST_PORT_RX_SIZE           512
+#define TEST_PORT_TX_SIZE           512
+#define TEST_LOOP_TIMEOUT           K_MSEC(100)
+
+/* Loopback throughput floor through both rings, bytes per second */
+#define TEST_LOOP_MIN_BYTES_PER_S   200000ULL
+#define TEST_LOOP_BYTES             (64 * 1024)
+
+UART_PORT_DEFINE(loop_port, DEVICE_DT_GET(DT_NODELABEL(uart_loop)), TEST_PORT_RX_SIZE, TEST_PORT_TX_SIZE);
+
+static uint8_t test_tx[TEST_PORT_TX_SIZE];
+static uint8_t test_rx[TEST_PORT_RX_SIZE];
+
+/* Reads until len bytes came back or nothing arrives for a while */
+static uint32_t loop_read(uint8_t *data, uint32_t len)
+{
+	uint32_t got = 0;
+
+	while (got < len) {
+		uint32_t n = uart_port_read(&loop_port, &data[got], len - got);
+
+		if (n == 0) {
+			if (k_sem_take(&loop_port.rx_sem, TEST_LOOP_TIMEOUT) != 0) {
+				break;
+			}
+		}
+		got += n;
+	}
+
+	return got;
+}
+
+static void *uart_port_setup(void)
+{
+	uart_emul_callback_tx_data_ready_set(loop_port.dev, dut_emul_uart_drain, NULL);
+	zassert_ok(uart_port_init(&loop_port));
+
+	for (size_t i = 0; i < sizeof(test_tx); i++) {
+		test_tx[i] = (uint8_t)((i * 31) + 7);
+	}
+
+	return NULL;
+}
+
+static void uart_port_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	k_msleep(10);
+	(void)uart_port_rx_discard(&loop_port);
+	loop_port.rx_dropped = 0;
+	loop_port.tx_dropped = 0;
+}
+
+ZTEST(uart_port, test_loopback)
+{
+	zassert_true(uart_port_write_all(&loop_port, test_tx, 300));
+	zassert_equal(loop_read(test_rx, 300), 300);
+	zassert_mem_equal(test_rx, test_tx, 300);
+	zassert_equal(loop_port.rx_dropped, 0);
+}
+
+ZTEST(uart_port, test_write_all_is_all_or_nothing)
+{
+	zassert_false(uart_port_write_all(&loop_port, test_tx, TEST_PORT_TX_SIZE + 1));
+	zassert_equal(loop_port.tx_dropped, TEST_PORT_TX_SIZE + 1);
+	zassert_equal(loop_read(test_rx, 1), 0, "nothing queued, nothing sent");
+}
+
+ZTEST(uart_port, test_rx_discard)
+{
+	zassert_equal(uart_port_write(&loop_port, test_tx, 100), 100);
+	k_msleep(10);
+
+	zassert_equal(uart_port_rx_discard(&loop_port), 100);
+	zassert_equal(uart_port_read(&loop_port, test_rx, sizeof(test_rx)), 0);
+
+	// The port still receives after a discard
+	zassert_equal(uart_port_write(&loop_port, test_tx, 10), 10);
+	zassert_equal(loop_read(test_rx, 10), 10);
+	zassert_mem_equal(test_rx, test_tx, 10);
+}
+
+ZTEST(uart_port, test_claim)
+{
+	zassert_ok(uart_port_claim(&loop_port));
+	zassert_equal(uart_port_claim(&loop_port), -EBUSY);
+	uart_port_release(&loop_port);
+	zassert_ok(uart_port_claim(&loop_port));
+	uart_port_release(&loop_port);
+}
+
+ZTEST(uart_port, test_loopback_throughput)
+{
+	uint32_t sent = 0;
+	uint32_t got = 0;
+	uint64_t start, ns, rate;
+
+	start = bench_start();
+	while (got < TEST_LOOP_BYTES) {
+		uint32_t n;
+
+		if (sent < TEST_LOOP_BYTES) {
+			sent += uart_port_write(&loop_port, test_tx, MIN(sizeof(test_tx) / 2, TEST_LOOP_BYTES - sent));
+		}
+		n = uart_port_read(&loop_port, test_rx, sizeof(test_rx));
+		if ((n == 0) && (k_sem_take(&loop_port.rx_sem, TEST_LOOP_TIMEOUT) != 0)) {
+			break;
+		}
+		got += n;
+	}
+	ns = bench_elapsed_ns(start);
+
+	zassert_equal(got, TEST_LOOP_BYTES);
+	zassert_equal(loop_port.rx_dropped, 0);
+
+	rate = bench_per_sec(got, ns);
+	TC_PRINT("uart_port loopback: %llu bytes/s\n", rate);
+	zassert_true(rate >= TEST_LOOP_MIN_BYTES_PER_S, "%llu bytes/s, expected %llu",
+		     rate, TEST_LOOP_MIN_BYTES_PER_S);
+}
+
+ZTEST_SUITE(uart_port, NULL, uart_port_setup, uart_port_before, NULL, NULL);
@@ -0,0 +1,501 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Reference host tool for the interface board binary protocol (src/host_proto.h).
+#
+# Usage: mdl_host.py [--port /dev/ttyACM0] <command> [args]
+#
+#   ping                    protocol version
+#   rails                   read all ADC rails in one scan
+#   test <id>               run a single test step
+#   gpio <id> <0|1>         drive a fixture pin
+#   stream <interval_us> <blocks> [out.bin]
+#                           capture ADC stream blocks
+#   cal <table.bin>         load an ADC calibration table
+#   bench <ms> <window> [sweep [baud ...]]
+#                           RS-232 loopback benchmark, or one per baud rate
+#   bridge                  pipe stdin/stdout to UART1 through the fixture until Ctrl-C
+#   bridge-stats            byte and drop counters of the last bridge session
+#   results [first_seq] [out.bin]
+#                           fetch stored test result records
+#   unit <serial>           DUT serial stored in the next result records
+#   timing [reset]          duration statistics of the test phases, optionally cleared
+#   export                  write results and captures to the USB drive, once the host
+#                           disconnects from the fixture if it is connected
+#   flash <image.bin> [max_baud]
+#                           program the DUT through its bootloader on UART1
+#   flash-abort             stop a DUT programming in progress
+#   check                   protocol harness: framing self-check, then ping/rails/gpio
+#                           round trips against the fixture
+
+import argparse
+import struct
+import sys
+import threading
+import time
+import zlib
+
+SYNC = b"\xa5\x5a"
+HEADER = struct.Struct("<2sHBB")
+RESPONSE = 0x80
+MAX_PAYLOAD = 1100
+
+CMD_PING = 0x01
+CMD_RUN_TEST = 0x02
+CMD_READ_RAILS = 0x03
+CMD_SET_GPIO = 0x04
+CMD_ADC_STREAM = 0x05
+CMD_LOAD_CAL = 0x06
+CMD_RS232_BENCH = 0x07
+CMD_BRIDGE = 0x08
+CMD_GET_RESULTS = 0x09
+CMD_SET_UNIT_ID = 0x0A
+CMD_GET_TIMING = 0x0B
+CMD_EXPORT = 0x0C
+CMD_FLASH_START = 0x0D
+CMD_FLASH_DATA = 0x0E
+CMD_FLASH_STATUS = 0x0F
+CMD_BRIDGE_STATS = 0x10
+CMD_FLASH_ABORT = 0x11
+EVT_ADC_BLOCK = 0xC0
+EVT_RESULTS = 0xC1
+EVT_TIMING = 0xC2
+EVT_BENCH = 0xC3
+
+SEQ_RESULTS = ["PENDING", "RUNNING", "PASSED", "FAILED", "TIMEOUT", "SKIPPED"]
+
+# struct result_record (src/result_log.h)
+RESULT_HEADER = struct.Struct("<BBBBIQI")
+RESULT_STEP = struct.Struct("<BBHi")
+RESULT_MAX_STEPS = 8
+RESULT_RECORD_SIZE = RESULT_HEADER.size + RESULT_MAX_STEPS * RESULT_STEP.size
+
+# struct phase_stats (src/phase_timing.h), preceded by the phase id
+TIMING_BUCKETS = 32
+TIMING_ENTRY = struct.Struct("<BIIIIQ%dH" % TIMING_BUCKETS)
+# enum phase_id, test steps follow in the order of the sequence (src/main.c)
+PHASES = ["sequence", "adc scan", "adc window", "adc burst", "i2c"]
+STEP_NAMES = ["Output voltage", "DUT current", "RTC", "RS-232", "Power on", "DUT I/O"]
+
+# struct dut_flash_status (src/dut_flash.h)
+FLASH_STATUS = struct.Struct("<BiIIIIII")
+FLASH_STATUS_FIELDS = "state err baudrate size acked retransmits crc_errors elapsed_ms".split()
+FLASH_STATES = ["idle", "syncing", "erasing", "writing", "verifying", "done", "failed"]
+# Image bytes per data frame, resent after FLASH_RETRY_S while the fixture buffer is full,
+# for at most FLASH_HOST_S (DUT_FLASH_HOST_MS, src/dut_flash.h)
+FLASH_CHUNK = 1024
+FLASH_RETRY_S = 0.005
+FLASH_HOST_S = 5
+EAGAIN = 11
+EBUSY = 16
+
+# struct bridge_stats (src/bridge.h)
+BRIDGE_FIELDS = "baudrate bytes_to_dut bytes_to_host host_rx_dropped dut_rx_dropped tx_dropped".split()
+
+BENCH_FIELDS = ("baudrate blocks_sent blocks_received blocks_lost crc_errors bit_errors "
+                "overruns bytes_per_s crc32 latency_p50_us latency_p95_us latency_p99_us "
+                "latency_max_us").split()
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    """Same CRC as Zephyr crc16_ccitt() (reflected 0x1021 polynomial)."""
+    for byte in data:
+        byte ^= crc & 0xFF
+        byte ^= (byte << 4) & 0xFF
+        crc = ((byte << 8) | (crc >> 8)) ^ (byte >> 4) ^ (byte << 3)
+        crc &= 0xFFFF
+    return crc
+
+
+def encode(ftype, seq, payload=b""):
+    if len(payload) > MAX_PAYLOAD:
+        raise ValueError("payload too long")
+    body = struct.pack("<HBB", len(payload), ftype, seq) + payload
+    return SYNC + body + struct.pack("<H", crc16_ccitt(body))
+
+
+class Decoder:
+    """Incremental frame decoder, skips text and resynchronizes on errors."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                del self.buf[:max(len(self.buf) - 1, 0)]
+                return frames
+            del self.buf[:start]
+            if len(self.buf) < HEADER.size:
+                return frames
+            _, length, ftype, seq = HEADER.unpack_from(self.buf)
+            if length > MAX_PAYLOAD:
+                del self.buf[:2]
+                continue
+            total = HEADER.size + length + 2
+            if len(self.buf) < total:
+                return frames
+            body = bytes(self.buf[2:HEADER.size + length])
+            (crc,) = struct.unpack_from("<H", self.buf, HEADER.size + length)
+            if crc == crc16_ccitt(body):
+                frames.append((ftype, seq, body[4:]))
+                del self.buf[:total]
+            else:
+                self.crc_errors += 1
+                del self.buf[:2]
+
+
+class Fixture:
+    def __init__(self, port, timeout=5.0):
+        import serial  # pyserial, only needed when talking to a fixture
+
+        self.ser = serial.Serial(port, 115200, timeout=0.05)
+        self.ser.dtr = True
+        self.timeout = timeout
+        self.seq = 0
+        self.dec = Decoder()
+        self.events = []
+        self.records = []
+        self.timing = []
+        self.bench_results = []
+
+    def close(self):
+        self.ser.close()
+
+    def _frames(self):
+        return self.dec.feed(self.ser.read(4096))
+
+    def send(self, cmd, payload=b""):
+        """Sends a command without waiting, returns its seq for wait()"""
+        self.seq = (self.seq + 1) & 0xFF
+        self.ser.write(encode(cmd, self.seq, payload))
+        return self.seq
+
+    def command(self, cmd, payload=b"", timeout=None):
+        return self.wait(cmd, self.send(cmd, payload), timeout)
+
+    def wait(self, cmd, cmd_seq, timeout=None):
+        deadline = time.monotonic() + (timeout or self.timeout)
+        while time.monotonic() < deadline:
+            for ftype, seq, data in self._frames():
+                if ftype == cmd | RESPONSE and seq == cmd_seq:
+                    if data[0] != 0:
+                        raise IOError(data[0], "command 0x%02x failed, errno %d" % (cmd, data[0]))
+                    return data[1:]
+                if ftype == EVT_ADC_BLOCK:
+                    self.events.append(data)
+                elif ftype == EVT_RESULTS:
+                    self.records += split_records(data)
+                elif ftype == EVT_TIMING:
+                    self.timing += split_timing(data)
+                elif ftype == EVT_BENCH:
+                    self.bench_results.append(decode_bench(data))
+        raise TimeoutError("no response to command 0x%02x" % cmd)
+
+    def ping(self):
+        return self.command(CMD_PING)[0]
+
+    def rails(self):
+        data = self.command(CMD_READ_RAILS)
+        timestamp, count = struct.unpack_from("<IB", data)
+        return timestamp, list(struct.unpack_from("<%di" % count, data, 5))
+
+    def run_test(self, test_id):
+        result, duration = struct.unpack("<BI", self.command(CMD_RUN_TEST, bytes([test_id]), 60))
+        return SEQ_RESULTS[result], duration
+
+    def set_gpio(self, gpio_id, value):
+        self.command(CMD_SET_GPIO, bytes([gpio_id, value]))
+
+    def load_cal(self, table):
+        self.command(CMD_LOAD_CAL, table)
+
+    def bench(self, duration_ms, window):
+        data = self.command(CMD_RS232_BENCH, struct.pack("<IB", duration_ms, window),
+                            duration_ms / 1000 + 5)
+        return decode_bench(data)
+
+    def bench_sweep(self, duration_ms, window, bauds=()):
+        """One result per baud rate, the fixture's default rates if none are given"""
+        self.bench_results = []
+        payload = struct.pack("<IBB%dI" % len(bauds), duration_ms, window, len(bauds), *bauds)
+        (count,) = struct.unpack("<B", self.command(CMD_RS232_BENCH, payload,
+                                                    16 * (duration_ms / 1000 + 1) + 5))
+        if count != len(self.bench_results):
+            raise IOError("%d rates announced, %d received" % (count, len(self.bench_results)))
+        return self.bench_results
+
+    def results(self, first_seq=0, max_count=0):
+        self.records = []
+        count, next_seq = struct.unpack("<II", self.command(
+            CMD_GET_RESULTS, struct.pack("<IH", first_seq, max_count), 30))
+        if count != len(self.records):
+            raise IOError("%d records announced, %d received" % (count, len(self.records)))
+        return self.records, next_seq
+
+    def get_timing(self, reset=False):
+        self.timing = []
+        (count,) = struct.unpack("<B", self.command(CMD_GET_TIMING, bytes([int(reset)])))
+        if count != len(self.timing):
+            raise IOError("%d phases announced, %d received" % (count, len(self.timing)))
+        return self.timing
+
+    def export(self):
+        """Writes results and captures to the USB drive, None if deferred until USB disconnects"""
+        try:
+            return self.command(CMD_EXPORT, timeout=30)[0]
+        except IOError as e:
+            if e.errno != EBUSY:
+                raise
+            return None
+
+    def flash_status(self):
+        status = dict(zip(FLASH_STATUS_FIELDS, FLASH_STATUS.unpack(self.command(CMD_FLASH_STATUS))))
+        status["state"] = FLASH_STATES[status["state"]]
+        return status
+
+    def flash_data(self, chunk):
+        """Sends the next image bytes, again and again while the fixture buffer is full"""
+        deadline = time.monotonic() + FLASH_HOST_S
+        while True:
+            try:
+                return self.command(CMD_FLASH_DATA, chunk)
+            except IOError as e:
+                if e.errno != EAGAIN or time.monotonic() > deadline:
+                    raise
+            time.sleep(FLASH_RETRY_S)
+
+    def flash_abort(self):
+        self.command(CMD_FLASH_ABORT)
+
+    def flash(self, image, max_baud=0):
+        """Programs the DUT, one data frame at a time so a refused one is never overtaken"""
+        self.command(CMD_FLASH_START, struct.pack("<III", len(image), zlib.crc32(image), max_baud))
+        try:
+            for offset in range(0, len(image), FLASH_CHUNK):
+                self.flash_data(image[offset:offset + FLASH_CHUNK])
+        except KeyboardInterrupt:
+            self.flash_abort()
+            raise
+        while True:
+            status = self.flash_status()
+            if status["state"] in ("done", "failed"):
+                return status
+            time.sleep(0.1)
+
+    def bridge(self):
+        """Pipes stdin/stdout to the DUT UART until Ctrl-C, the fixture stops the bridge when DTR drops"""
+        self.command(CMD_BRIDGE)
+        out = sys.stdout.buffer
+        out.write(bytes(self.dec.buf))
+        self.dec.buf.clear()
+
+        def to_dut():
+            for line in iter(sys.stdin.buffer.readline, b""):
+                self.ser.write(line)
+
+        threading.Thread(target=to_dut, daemon=True).start()
+        try:
+            while True:
+                data = self.ser.read(4096)
+                if data:
+                    out.write(data)
+                    out.flush()
+        except KeyboardInterrupt:
+            pass
+
+    def bridge_stats(self):
+        data = self.command(CMD_BRIDGE_STATS)
+        return dict(zip(BRIDGE_FIELDS, struct.unpack_from("<%dI" % len(BRIDGE_FIELDS), data)))
+
+    def set_unit_id(self, unit_id):
+        self.command(CMD_SET_UNIT_ID, struct.pack("<Q", unit_id))
+
+    def stream(self, interval_us, blocks):
+        self.events = []
+        self.command(CMD_ADC_STREAM, struct.pack("<BI", 1, interval_us))
+        try:
+            while len(self.events) < blocks:
+                for ftype, _, data in self._frames():
+                    if ftype == EVT_ADC_BLOCK:
+                        self.events.append(data)
+        finally:
+            stats = self.command(CMD_ADC_STREAM, struct.pack("<BI", 0, 0))
+        self.stream_stats = dict(zip(("blocks", "overruns", "errors"), struct.unpack_from("<III", stats)))
+        out = []
+        for data in self.events[:blocks]:
+            seq, ts, channels, samplings = struct.unpack_from("<IIHH", data)
+            samples = struct.unpack_from("<%dh" % (channels * samplings), data, 12)
+            out.append((seq, ts, channels, samples))
+        return out
+
+
+def decode_bench(data):
+    return dict(zip(BENCH_FIELDS, struct.unpack_from("<%dI" % len(BENCH_FIELDS), data)))
+
+
+def decode_record(raw):
+    version, count, verdict, _, seq, unit_id, timestamp = RESULT_HEADER.unpack_from(raw)
+    steps = []
+    for i in range(min(count, RESULT_MAX_STEPS)):
+        result, _, duration, value = RESULT_STEP.unpack_from(
+            raw, RESULT_HEADER.size + i * RESULT_STEP.size)
+        steps.append((SEQ_RESULTS[result], duration, value))
+    return {"version": version, "seq": seq, "unit_id": unit_id, "timestamp": timestamp,
+            "passed": verdict == 0, "steps": steps}
+
+
+def split_records(data):
+    count = data[0]
+    return [bytes(data[1 + i * RESULT_RECORD_SIZE:1 + (i + 1) * RESULT_RECORD_SIZE])
+            for i in range(count)]
+
+
+def split_timing(data):
+    entries = []
+    for i in range(data[0]):
+        fields = TIMING_ENTRY.unpack_from(data, 1 + i * TIMING_ENTRY.size)
+        phase_id, count, min_us, max_us, last_us, total_us = fields[:6]
+        if phase_id < len(PHASES):
+            name = PHASES[phase_id]
+        else:
+            step = phase_id - len(PHASES)
+            name = STEP_NAMES[step] if step < len(STEP_NAMES) else "step %d" % step
+        entries.append({"phase": name, "count": count, "min_us": min_us, "max_us": max_us,
+                        "last_us": last_us, "avg_us": total_us // max(count, 1),
+                        "hist": list(fields[6:])})
+    return entries
+
+
+def self_check():
+    """Framing checks that do not need a fixture."""
+    # CRC-16/CCITT as computed by Zephyr's crc16_ccitt(0xFFFF, ...)
+    assert crc16_ccitt(b"123456789") == 0x6F91
+    dec = Decoder()
+    frames = [encode(CMD_PING, 1), encode(CMD_READ_RAILS, 2, bytes(range(40)))]
+    corrupt = bytearray(encode(CMD_SET_GPIO, 3, b"\x01\x01"))
+    corrupt[-1] ^= 0xFF
+    stream = b"text before\n" + frames[0] + bytes(corrupt) + b"\xa5junk" + frames[1]
+    got = []
+    for i in range(0, len(stream), 7):
+        got += dec.feed(stream[i:i + 7])
+    assert [(t, s) for t, s, _ in got] == [(CMD_PING, 1), (CMD_READ_RAILS, 2)], got
+    assert got[1][2] == bytes(range(40))
+    assert dec.crc_errors == 1
+    assert RESULT_RECORD_SIZE == 84
+    raw = RESULT_HEADER.pack(1, 2, 1, 0, 7, 1234, 1664506805) + RESULT_STEP.pack(2, 0, 350, 3450) + \
+        RESULT_STEP.pack(3, 0, 1200, 25) + bytes(6 * RESULT_STEP.size)
+    rec = decode_record(split_records(bytes([1]) + raw)[0])
+    assert rec["seq"] == 7 and not rec["passed"]
+    assert rec["steps"] == [("PASSED", 350, 3450), ("FAILED", 1200, 25)], rec
+    assert TIMING_ENTRY.size == 89
+    raw = bytes([1]) + TIMING_ENTRY.pack(5, 2, 10, 30, 30, 40, *([0, 0, 0, 0, 1, 1] + [0] * 26))
+    t = split_timing(raw)[0]
+    assert (t["phase"], t["avg_us"], t["hist"][4]) == ("Output voltage", 20, 1), t
+    print("framing self-check OK")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Interface board host tool")
+    parser.add_argument("--port", default="/dev/ttyACM0")
+    parser.add_argument("command")
+    parser.add_argument("args", nargs="*")
+    args = parser.parse_args()
+
+    if args.command == "check":
+        self_check()
+
+    fx = Fixture(args.port)
+    try:
+        if args.command == "ping":
+            print("protocol version", fx.ping())
+        elif args.command == "rails":
+            timestamp, values = fx.rails()
+            print("timestamp", timestamp, "values", values)
+        elif args.command == "test":
+            print("%s in %d ms" % fx.run_test(int(args.args[0])))
+        elif args.command == "gpio":
+            fx.set_gpio(int(args.args[0]), int(args.args[1]))
+        elif args.command == "cal":
+            with open(args.args[0], "rb") as f:
+                fx.load_cal(f.read())
+        elif args.command == "bench" and len(args.args) > 2 and args.args[2] == "sweep":
+            for res in fx.bench_sweep(int(args.args[0]), int(args.args[1]),
+                                      [int(b) for b in args.args[3:]]):
+                print("%(baudrate)8d baud: %(bytes_per_s)7d B/s, %(blocks_lost)d lost, "
+                      "%(crc_errors)d CRC errors, %(bit_errors)d bit errors, p99 %(latency_p99_us)d us" % res)
+        elif args.command == "bench":
+            for key, value in fx.bench(int(args.args[0]), int(args.args[1])).items():
+                print("%-16s %d" % (key, value))
+        elif args.command == "stream":
+            blocks = fx.stream(int(args.args[0]), int(args.args[1]))
+            lost = sum(b[0] - a[0] - 1 for a, b in zip(blocks, blocks[1:]))
+            print("%d blocks, %d lost" % (len(blocks), lost))
+            print("fixture: %(blocks)d blocks, %(overruns)d samplings dropped, %(errors)d errors"
+                  % fx.stream_stats)
+            if len(args.args) > 2:
+                with open(args.args[2], "wb") as f:
+                    for _, _, _, samples in blocks:
+                        f.write(struct.pack("<%dh" % len(samples), *samples))
+        elif args.command == "results":
+            records, next_seq = fx.results(int(args.args[0]) if args.args else 0)
+            for raw in records:
+                rec = decode_record(raw)
+                print("#%d unit %d at %d: %s %s" % (rec["seq"], rec["unit_id"], rec["timestamp"],
+                                                    "PASSED" if rec["passed"] else "FAILED",
+                                                    rec["steps"]))
+            print("%d records, next seq %d" % (len(records), next_seq))
+            if len(args.args) > 1:
+                with open(args.args[1], "wb") as f:
+                    f.write(b"".join(records))
+        elif args.command == "timing":
+            for t in fx.get_timing(bool(args.args and args.args[0] == "reset")):
+                # bucket n holds durations below 2^n us
+                hist = " ".join("<%d:%d" % (1 << n, c) for n, c in enumerate(t["hist"]) if c)
+                print("%-16s n=%-5d min %9d avg %9d max %9d us  %s" % (
+                    t["phase"], t["count"], t["min_us"], t["avg_us"], t["max_us"], hist))
+        elif args.command == "export":
+            count = fx.export()
+            if count is None:
+                print("the host has the drive, export written once USB is disconnected")
+            else:
+                print("%d captures written, remount the drive to read them" % count)
+        elif args.command == "flash":
+            with open(args.args[0], "rb") as f:
+                status = fx.flash(f.read(), int(args.args[1]) if len(args.args) > 1 else 0)
+            for key, value in status.items():
+                print("%-16s %s" % (key, value))
+            if status["state"] != "done":
+                sys.exit(1)
+        elif args.command == "flash-abort":
+            fx.flash_abort()
+        elif args.command == "unit":
+            fx.set_unit_id(int(args.args[0], 0))
+        elif args.command == "bridge-stats":
+            for key, value in fx.bridge_stats().items():
+                print("%-16s %d" % (key, value))
+        elif args.command == "bridge":
+            print("bridge running, Ctrl-C to stop it", file=sys.stderr)
+            fx.bridge()
+        elif args.command == "check":
+            assert fx.ping() == 1
+            for _ in range(100):
+                fx.rails()
+            fx.set_gpio(0, 1)
+            fx.set_gpio(0, 0)
+            assert fx.dec.crc_errors == 0
+            print("fixture round trips OK")
+        else:
+            parser.error("unknown command " + args.command)
+    finally:
+        fx.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())